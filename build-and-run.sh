@@ -3,7 +3,18 @@ rm -rf build &&
 mkdir build &&
 cmake . -B build &&
 glslc -fshader-stage=vertex shaders/vertex.glsl -o build/vertex.spv &&
+glslc -fshader-stage=vertex -DQUANTIZED shaders/vertex.glsl -o build/vertex_quantized.spv &&
+glslc -fshader-stage=vertex -DINSTANCED shaders/vertex.glsl -o build/vertex_instanced.spv &&
+glslc -fshader-stage=vertex -DQUANTIZED -DINSTANCED shaders/vertex.glsl -o build/vertex_quantized_instanced.spv &&
 glslc -fshader-stage=fragment shaders/fragment.glsl -o build/fragment.spv &&
-glslc -fshader-stage=compute shaders/compute.glsl -o build/compute.spv &&
+glslc -fshader-stage=compute -DFORMAT=rgba8 shaders/compute.glsl -o build/compute_rgba8.spv &&
+glslc -fshader-stage=compute -DFORMAT=rgba16f shaders/compute.glsl -o build/compute_rgba16f.spv &&
+glslc -fshader-stage=vertex shaders/downsample_vertex.glsl -o build/downsample_vertex.spv &&
+glslc -fshader-stage=fragment shaders/downsample_fragment.glsl -o build/downsample_fragment.spv &&
+glslc -fshader-stage=compute shaders/cull.glsl -o build/cull.spv &&
+glslc -fshader-stage=compute shaders/hiz.glsl -o build/hiz.spv &&
 cmake --build build &&
+./build/cook assets/textures/asphalt.jpg build/asphalt.ctex bc1 --srgb &&
+./build/cook assets/textures/explosion.png build/explosion.ctex bc3 --srgb &&
+./build/cook assets/textures/uvtest.png build/uvtest.ctex bc7 --srgb &&
 ./build/bin
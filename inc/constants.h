@@ -2,24 +2,39 @@
 #define CONSTANTS_H
 
 #define PATH_SHADER_VERTEX "build/vertex.spv"
+#define PATH_SHADER_VERTEX_QUANTIZED "build/vertex_quantized.spv"
+#define PATH_SHADER_VERTEX_INSTANCED "build/vertex_instanced.spv"
+#define PATH_SHADER_VERTEX_QUANTIZED_INSTANCED "build/vertex_quantized_instanced.spv"
 #define PATH_SHADER_FRAGMENT "build/fragment.spv"
-#define PATH_SHADER_COMPUTE "build/compute.spv"
-#define PATH_TEXTURE_ASPHALT "assets/textures/asphalt.jpg"
-#define PATH_TEXTURE_EXPLOSION "assets/textures/explosion.png"
+#define PATH_SHADER_MIPMAP_RGBA8 "build/compute_rgba8.spv"
+#define PATH_SHADER_MIPMAP_RGBA16F "build/compute_rgba16f.spv"
+#define PATH_SHADER_DOWNSAMPLE_VERTEX "build/downsample_vertex.spv"
+#define PATH_SHADER_DOWNSAMPLE_FRAGMENT "build/downsample_fragment.spv"
+#define PATH_SHADER_CULL "build/cull.spv"
+#define PATH_SHADER_HIZ "build/hiz.spv"
+// cooked from assets/textures by build-and-run.sh
+#define PATH_TEXTURE_ASPHALT "build/asphalt.ctex"
+#define PATH_TEXTURE_EXPLOSION "build/explosion.ctex"
+#define PATH_TEXTURE_UVTEST "build/uvtest.ctex"
 #define PATH_MODEL_CAR "assets/models/car.obj"
 #define PATH_MODEL_CITY "assets/models/city.obj"
+#define MODEL_LOAD_FLAGS (MODEL_LOAD_OPTIMIZE | MODEL_LOAD_QUANTIZE)
 
 #define WINDOW_WIDTH 1200
 #define WINDOW_HEIGHT 800
+#define DEPTH_FORMAT WGPUTextureFormat_Depth24Plus
 
 #define VBO_STRIDE 32 // pos + norm + uv = (3 + 3 + 2) * 4
+#define VBO_STRIDE_QUANTIZED 16 // unorm16x4 pos + snorm16x2 oct norm + float16x2 uv
 #define VERTEX_ATTRIBUTE_COUNT 3
+#define INSTANCE_STRIDE 64 // mat4
+#define INSTANCE_ATTRIBUTE_COUNT 4 // one per mat4 column
 
-#define UBO_OBJECT_SLOT_SIZE 256
-#define UBO_OBJECT_SLOT_COUNT 2
-#define UBO_OBJECT_SIZE (UBO_OBJECT_SLOT_SIZE * UBO_OBJECT_SLOT_COUNT)
+#define BENCH_CAR_COUNT 10000
+#define BENCH_CAR_SPACING 6.0f
+
+#define UBO_OBJECT_SLOT_SIZE 256 // minUniformBufferOffsetAlignment
 
 #define BG_ENTRY_COUNT 3
-#define BG_COMP_ENTRY_COUNT 4
 
 #endif
@@ -0,0 +1,37 @@
+#ifndef CULL_H
+#define CULL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// World space bounding spheres in SoA, so one SIMD register holds the same
+// coordinate of 4 (SSE, NEON) or 8 (AVX) objects and each plane is tested
+// against all of them at once.
+typedef struct CullSet {
+    float *x;
+    float *y;
+    float *z;
+    float *radius;
+    uint8_t *visible;  // written by cull_test
+    size_t count;
+    size_t capacity;
+} CullSet;
+
+typedef struct CullStats {
+    uint32_t visible;
+    uint32_t culled;
+} CullStats;
+
+// Left, right, bottom, top, near, far as (a, b, c, d) with a*x + b*y + c*z + d
+// >= 0 inside, normalized. The near plane is taken at clip z = -w, which is
+// exact for GL depth and conservative for zero to one depth.
+void cull_frustum_planes(const float view_projection[4][4], float out_planes[6][4]);
+
+void cull_set_reset(CullSet *set);
+// Adds the sphere of a mesh's bounds under model and returns its index.
+size_t cull_set_add(CullSet *set, const float model[4][4], const float center[3], float radius);
+// Marks each sphere that is at least partly inside all six planes.
+void cull_test(CullSet *set, const float planes[6][4], CullStats *out_stats);
+void cull_set_release(CullSet *set);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef FILE_VIEW_H
+#define FILE_VIEW_H
+
+#include <stdlib.h>
+
+// Read-only view of a whole file. The contents are mapped when possible and
+// read into a heap buffer otherwise; either way data[size] is '\0'.
+typedef struct FileView {
+    const char *data;
+    size_t size;
+    void *base;
+    size_t base_size;
+    int mapped;
+} FileView;
+
+int file_view_open(const char *path, FileView *out_view);
+void file_view_close(FileView *view);
+
+#endif
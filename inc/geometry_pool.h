@@ -0,0 +1,61 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include <stdint.h>
+#include <webgpu.h>
+#include "model.h"
+#include "upload_ring.h"
+
+#define GEOMETRY_POOL_INITIAL_VERTICES (1 << 18)
+#define GEOMETRY_POOL_INITIAL_INDICES (1 << 20)
+
+typedef struct FreeRange {
+    uint32_t offset;
+    uint32_t size;
+} FreeRange;
+
+// Free ranges of an element array, first fit with coalescing.
+typedef struct RangeAllocator {
+    FreeRange *free;
+    size_t free_count;
+    size_t free_capacity;
+    uint32_t capacity;
+} RangeAllocator;
+
+// All meshes share one vertex and one index buffer, so a pass binds them
+// once. The buffers grow by copying into a larger one; handles stay valid,
+// but anything recorded against the old buffers has to be recorded again.
+typedef struct GeometryPool {
+    WGPUBuffer vbo;
+    WGPUBuffer ibo;
+    uint32_t generation;  // bumped when vbo or ibo is replaced
+    size_t vertex_stride;
+    RangeAllocator vertices;
+    RangeAllocator indices;
+} GeometryPool;
+
+// Where a mesh lives in the pool: draw its submeshes with
+// firstIndex = first_index + submesh.first_index and baseVertex = base_vertex.
+typedef struct GeometryHandle {
+    uint32_t base_vertex;
+    uint32_t vertex_count;
+    uint32_t first_index;
+    uint32_t index_count;
+} GeometryHandle;
+
+#define RANGE_ALLOC_FAILED 0xffffffffu
+
+void range_alloc_init(RangeAllocator *ra, uint32_t capacity);
+uint32_t range_alloc(RangeAllocator *ra, uint32_t size);
+void range_free(RangeAllocator *ra, uint32_t offset, uint32_t size);
+// Adds [old capacity, new_capacity) as free space.
+void range_alloc_grow(RangeAllocator *ra, uint32_t new_capacity);
+void range_alloc_release(RangeAllocator *ra);
+
+void geometry_pool_init(GeometryPool *pool, WGPUDevice device, size_t vertex_stride);
+// Uploads go through ring and land with its next submit.
+int geometry_pool_add(GeometryPool *pool, UploadRing *ring, const Mesh *mesh, GeometryHandle *out_handle);
+void geometry_pool_remove(GeometryPool *pool, const GeometryHandle *handle);
+void geometry_pool_release(GeometryPool *pool);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef GPU_CULL_H
+#define GPU_CULL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <webgpu.h>
+#include "model.h"
+#include "geometry_pool.h"
+#include "upload_ring.h"
+#include "hiz.h"
+
+#define GPU_CULL_WORKGROUP_SIZE 64
+#define GPU_CULL_ENTRY_COUNT 7
+// wgpuRenderPassEncoderDrawIndexedIndirect arguments, 5 uint32
+#define GPU_CULL_DRAW_SIZE 20
+
+// Matches Group in cull.glsl.
+typedef struct GpuCullGroup {
+    float sphere[4];
+    uint32_t first_draw;
+    uint32_t draw_count;
+    uint32_t first_instance;
+    uint32_t pad0;
+} GpuCullGroup;
+
+// Matches Cull in cull.glsl.
+typedef struct GpuCullUniforms {
+    float planes[6][4];
+    float view_projection[4][4];  // the one the Hi-Z pyramid was rendered with
+    uint32_t object_count;
+    uint32_t hiz_enabled;
+    uint32_t hiz_mip_count;
+    uint32_t pad0;
+    int32_t hiz_size[2];
+    int32_t pad1[2];
+} GpuCullUniforms;
+
+// Frustum culls instances on the GPU. A compute pass tests every instance of
+// every group and packs the visible ones per group into visible, counting
+// them straight into the instanceCount of the group's indirect draws, so the
+// CPU issues the same draws however many instances there are. Instances that
+// pass the frustum can also be tested against a Hi-Z pyramid.
+typedef struct GpuCull {
+    WGPUComputePipeline pipeline;
+    WGPUBindGroupLayout bgl;
+    WGPUBindGroup bg;
+    WGPUBuffer uniforms;
+    WGPUBuffer objects;        // mat4 per instance
+    WGPUBuffer object_groups;  // group index per instance
+    WGPUBuffer groups;
+    WGPUBuffer draw_templates; // draws with instanceCount 0, copied over draws every frame
+    WGPUBuffer draws;
+    WGPUBuffer visible;        // mat4 per visible instance, instance step vertex buffer
+    WGPUTextureView hiz_view;  // not owned
+    // CPU side of groups, and the instance buffers they are copied from
+    GpuCullGroup *group_info;
+    WGPUBuffer *group_sources;
+    size_t group_count;
+    size_t group_capacity;
+    uint32_t *draw_args;       // draw_templates on the CPU
+    size_t draw_capacity;
+    uint32_t draw_count;
+    uint32_t object_count;
+} GpuCull;
+
+void gpu_cull_init(GpuCull *cull, WGPUDevice device, WGPUShaderModule module);
+// Registers count instances of mesh whose model matrices are in instances
+// (which needs CopySrc usage). Returns the group index.
+size_t gpu_cull_add_group(GpuCull *cull, const Mesh *mesh, const GeometryHandle *geo,
+                          WGPUBuffer instances, uint32_t count);
+// (Re)creates the GPU buffers for the groups added so far.
+void gpu_cull_build(GpuCull *cull, WGPUDevice device, UploadRing *ring);
+// Binds the Hi-Z pyramid to test against, again whenever it is recreated.
+void gpu_cull_set_hiz(GpuCull *cull, WGPUDevice device, WGPUTextureView hiz_view);
+// hiz is NULL, or not valid, to only test the frustum.
+void gpu_cull_update(GpuCull *cull, UploadRing *ring, const float planes[6][4], const HiZ *hiz);
+// Resets the draw counts and records the cull dispatch, ahead of the passes
+// that draw from draws and visible.
+void gpu_cull_encode(GpuCull *cull, WGPUCommandEncoder encoder);
+void gpu_cull_release(GpuCull *cull);
+
+#endif
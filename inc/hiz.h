@@ -0,0 +1,47 @@
+#ifndef HIZ_H
+#define HIZ_H
+
+#include <stdint.h>
+#include <webgpu.h>
+#include "upload_ring.h"
+
+#define HIZ_MAX_LEVELS 16
+#define HIZ_WORKGROUP_SIZE 8
+#define HIZ_ENTRY_COUNT 3
+// per level uniforms are this far apart, minUniformBufferOffsetAlignment
+#define HIZ_LEVEL_UNIFORM_SIZE 256
+
+typedef struct HiZLevelUniforms {
+    int32_t src_size[2];
+    int32_t dst_size[2];
+} HiZLevelUniforms;
+
+// Depth pyramid: level 0 is the depth buffer, each level above it holds the
+// farthest depth of the texels below. Built at the end of a frame and
+// tested against in the next, so it lags the camera by a frame.
+typedef struct HiZ {
+    WGPUComputePipeline pipeline;
+    WGPUBindGroupLayout bgl;
+    WGPUTexture texture;  // R32Float with mip_count levels
+    WGPUTextureView view; // all levels, for the occlusion test
+    WGPUTextureView depth_view;
+    WGPUTextureView level_views[HIZ_MAX_LEVELS];
+    WGPUBindGroup level_bgs[HIZ_MAX_LEVELS];
+    WGPUBuffer uniforms;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mip_count;
+    float view_projection[4][4];  // the depth it was built from was rendered with this
+    bool valid;  // built last frame from the current depth buffer
+} HiZ;
+
+void hiz_init(HiZ *hiz, WGPUDevice device, WGPUShaderModule module);
+// Recreates the pyramid for a depth buffer, which needs TextureBinding usage.
+void hiz_resize(HiZ *hiz, WGPUDevice device, UploadRing *ring, WGPUTexture depth_texture,
+                uint32_t width, uint32_t height);
+// Records the reduction of every level, after the pass that wrote depth
+// with view_projection.
+void hiz_encode(HiZ *hiz, WGPUCommandEncoder encoder, const float view_projection[4][4]);
+void hiz_release(HiZ *hiz);
+
+#endif
@@ -4,5 +4,7 @@
 #include "state.h"
 
 void initialize(State *s);
+WGPUBindGroup create_bind_group(State *s, WGPUBuffer object_uniforms);
+void configure_surface(State *s, uint32_t width, uint32_t height);
 
 #endif
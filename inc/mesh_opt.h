@@ -0,0 +1,34 @@
+#ifndef MESH_OPT_H
+#define MESH_OPT_H
+
+#include <stdlib.h>
+
+// Entries of the simulated post-transform cache. 16 is a conservative fit
+// for current desktop GPUs; Tipsify is not very sensitive to the exact size.
+#define MESH_OPT_CACHE_SIZE 16
+// A soft cluster is closed once its running ACMR is within this factor of
+// its hard cluster's. Higher gives more, smaller clusters for the overdraw sort.
+#define MESH_OPT_OVERDRAW_THRESHOLD 1.05f
+
+typedef struct MeshCacheStats {
+    float acmr;  // cache misses per triangle, 0.5 at best, 3 at worst
+    float atvr;  // cache misses per vertex, 1 at best
+} MeshCacheStats;
+
+// Runs indices through a FIFO post-transform cache of cache_size entries.
+void mesh_opt_simulate_cache(const unsigned int *indices, size_t index_count, size_t vertex_count,
+                             int cache_size, MeshCacheStats *out_stats);
+
+// Reorders the triangles of an indexed triangle list in place: Tipsify for
+// vertex cache locality, then its clusters are sorted so outward facing
+// surfaces draw first. positions points at the x of vertex 0 with
+// vertex_stride bytes between vertices.
+int mesh_opt_reorder_triangles(unsigned int *indices, size_t index_count,
+                               const float *positions, size_t vertex_count, size_t vertex_stride);
+
+// Renumbers vertices in order of first use and permutes the vertex data to
+// match, so the vertex buffer is fetched front to back.
+int mesh_opt_reorder_vertices(unsigned int *indices, size_t index_count,
+                              void *vertices, size_t vertex_count, size_t vertex_stride);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <webgpu.h>
+#include "upload_ring.h"
+
+#define MIPMAP_MAX_LEVELS 16
+#define MIPMAP_MAX_FORMATS 8
+#define MIPMAP_LEVELS_PER_DISPATCH 4
+#define MIPMAP_WORKGROUP_SIZE 8
+#define MIPMAP_ENTRY_COUNT 6 // source, one storage view per level, uniforms
+#define MIPMAP_RENDER_ENTRY_COUNT 2 // source, uniforms
+// per dispatch uniforms are this far apart, minUniformBufferOffsetAlignment
+#define MIPMAP_UNIFORM_STRIDE 256
+
+// Matches Downsample in compute.glsl and downsample_fragment.glsl.
+typedef struct MipmapUniforms {
+    int32_t src_size[2];
+    int32_t level_count;
+    int32_t pad0;
+    int32_t dst_size[MIPMAP_LEVELS_PER_DISPATCH][4];  // xy
+} MipmapUniforms;
+
+// Everything that depends on the format, created the first time a texture
+// of that format is seen. Formats that can be storage bound get the compute
+// path, the rest (sRGB, R8, RG8) render one level per pass.
+typedef struct MipmapPipeline {
+    WGPUTextureFormat format;
+    WGPUBindGroupLayout bgl;
+    WGPUComputePipeline pipeline;         // NULL on the render path
+    WGPURenderPipeline render_pipeline;   // NULL on the compute path
+    WGPUTexture dummy;  // 1x1, bound to the levels a dispatch does not write
+    WGPUTextureView dummy_view;
+} MipmapPipeline;
+
+// Fills in mip chains on the GPU. Kept for the lifetime of the device so
+// pipelines are created once per format rather than once per texture.
+typedef struct MipmapGenerator {
+    WGPUDevice device;
+    MipmapPipeline pipelines[MIPMAP_MAX_FORMATS];
+    size_t pipeline_count;
+    WGPUBuffer uniforms;
+    uint32_t uniform_capacity;  // in dispatches
+} MipmapGenerator;
+
+void mipmap_generator_init(MipmapGenerator *gen, WGPUDevice device);
+// Generates every level below level 0 of each texture. Textures need
+// TextureBinding usage plus StorageBinding for RGBA8Unorm and RGBA16Float,
+// or RenderAttachment for RGBA8UnormSrgb, R8Unorm and RG8Unorm. sRGB
+// texels are filtered in linear space. All the chains go into one command
+// buffer and one submit, after the ring's pending copies. Textures of an
+// unsupported format or usage are skipped. Returns how many were generated.
+size_t mipmap_generate(MipmapGenerator *gen, UploadRing *ring, const WGPUTexture *textures, size_t count);
+void mipmap_generator_release(MipmapGenerator *gen);
+
+// CPU reference of the GPU filter for one level, on linear texels of
+// channels floats each. dst is max(1, width / 2) by max(1, height / 2).
+void mipmap_downsample_reference(const float *src, uint32_t width, uint32_t height,
+                                 uint32_t channels, float *dst);
+float mipmap_srgb_to_linear(float c);
+float mipmap_linear_to_srgb(float c);
+
+#endif
@@ -3,13 +3,52 @@
 
 #include <stdlib.h>
 
+#define MODEL_CACHE_EXTENSION ".meshcache"
+#define MODEL_CACHE_VERSION 6
+
+// Reorder triangles and vertices for the post-transform cache, overdraw and
+// vertex fetch. Adds to the cold load, cached loads are unaffected.
+#define MODEL_LOAD_OPTIMIZE (1 << 0)
+// Store vertices as QuantizedVertex (16 bytes) instead of 8 floats.
+#define MODEL_LOAD_QUANTIZE (1 << 1)
+
+// Object space bounds. The sphere is centered on the box, with the radius
+// of the farthest vertex rather than the half diagonal.
+typedef struct Bounds {
+    float aabb_min[3];
+    float aabb_max[3];
+    float center[3];
+    float radius;
+} Bounds;
+
+// Index range drawn with one material. A mesh's submeshes are sorted by
+// material and cover its index buffer.
+typedef struct Submesh {
+    unsigned int first_index;
+    unsigned int index_count;
+    int material_id;  // into the OBJ's mtl, -1 for none
+    unsigned int pad0;
+    Bounds bounds;
+} Submesh;
+
 typedef struct Mesh {
-    float *vertices;
+    void *vertices;
     unsigned int *indices;
     size_t vertex_count;
     size_t index_count;
+    size_t vertex_stride;
+    // positions decode as pos_min + pos * pos_extent, identity for float vertices
+    float pos_min[3];
+    float pos_extent[3];
+    Bounds bounds;
+    Submesh *submeshes;
+    size_t submesh_count;
+    // set when vertices/indices point into a mapped cache file
+    void *cache_map;
+    size_t cache_map_size;
 } Mesh;
 
-int model_load(const char *obj_path, Mesh *out_mesh);
+int model_load(const char *obj_path, Mesh *out_mesh, unsigned int flags);
+void model_free(Mesh *mesh);
 
 #endif
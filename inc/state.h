@@ -6,6 +6,52 @@
 #include <cglm/cglm.h>
 #include "constants.h"
 #include "model.h"
+#include "geometry_pool.h"
+#include "upload_ring.h"
+#include "uniform_arena.h"
+#include "cull.h"
+#include "gpu_cull.h"
+#include "hiz.h"
+#include "mipmap.h"
+#include "texture_loader.h"
+
+typedef struct UBOData_Frame {
+    mat4 view_projection;
+    float time;
+} UBOData_Frame;
+
+typedef struct UBOData_Object {
+    mat4 model;
+    // dequantizes positions, see Mesh
+    vec4 position_min;
+    vec4 position_extent;
+} UBOData_Object;
+
+typedef struct SceneObject {
+    const Mesh *mesh;
+    const GeometryHandle *geo;
+    UBOData_Object ubo;
+    uint32_t ubo_slot;  // this frame's slot in State.object_uniforms
+    float view_depth;   // sort key
+    bool visible;       // inside the frustum this frame
+} SceneObject;
+
+// One mesh drawn count times, model matrices come from an instance step
+// vertex buffer. The uniform slot only supplies the dequantization params.
+typedef struct InstanceBatch {
+    const Mesh *mesh;
+    const GeometryHandle *geo;
+    WGPUBuffer instances;
+    uint32_t count;
+    uint32_t ubo_slot;
+    bool hidden;
+} InstanceBatch;
+
+typedef struct RenderStats {
+    uint32_t draw_calls;
+    double encode_ms;
+    CullStats cull;
+} RenderStats;
 
 typedef struct State {
     SDL_Window *window;
@@ -14,27 +60,55 @@ typedef struct State {
     WGPUDevice device;
     WGPUInstance instance;
     WGPUSurface surface;
+    WGPUTextureFormat surface_format;
+    uint32_t width;
+    uint32_t height;
+    WGPUTexture depth_texture;
+    WGPUTextureView depth_view;
     WGPURenderPipeline pipeline;
+    WGPURenderPipeline pipeline_instanced;
+    // depth only, for the prepass
+    WGPURenderPipeline pipeline_depth;
+    WGPURenderPipeline pipeline_depth_instanced;
     WGPUQueue queue;
+    WGPUBindGroupLayout bgl;
     WGPUBindGroup bg;
-    WGPUBuffer ubo_object;
+    uint32_t bg_generation;  // object_uniforms generation bg was made for
+    WGPUSampler sampler;
     WGPUBuffer ubo_frame;
-    // TODO: buf
-    WGPUBuffer vbo_car;
-    WGPUBuffer vbo_city;
-    WGPUBuffer ibo_car;
-    WGPUBuffer ibo_city;
+    UniformArena object_uniforms;
+    UploadRing uploads;
+    MipmapGenerator mipmaps;
+    TextureLoader textures;
+    uint32_t texture_asphalt;
+    uint32_t texture_explosion;
+    uint32_t texture_uvtest;
+    GeometryPool geometry;
+    GeometryHandle geo_car;
+    GeometryHandle geo_city;
     Mesh mesh_car;
     Mesh mesh_city;
+    SceneObject *objects;
+    size_t object_count;
+    size_t object_capacity;
+    // objects[0, static_object_count) never move and are drawn from a render
+    // bundle. Their uniforms live in ubo_static at fixed offsets, so the
+    // offsets recorded in the bundle stay valid.
+    size_t static_object_count;
+    WGPURenderBundle static_bundle;
+    WGPURenderBundle static_depth_bundle;
+    WGPUBuffer ubo_static;
+    WGPUBindGroup bg_static;
+    uint32_t static_draw_calls;
+    uint32_t static_geometry_generation;
+    bool static_dirty;
+    InstanceBatch *batches;
+    size_t batch_count;
+    size_t batch_capacity;
+    CullSet cull;
+    GpuCull gpu_cull;  // one group per batch, in batch order
+    HiZ hiz;
+    RenderStats stats;
 } State;
 
-typedef struct UBOData_Frame {
-    mat4 view_projection;
-    float time;
-} UBOData_Frame;
-
-typedef struct UBOData_Object {
-    mat4 model;
-} UBOData_Object;
-
 #endif
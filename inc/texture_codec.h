@@ -0,0 +1,56 @@
+#ifndef TEXTURE_CODEC_H
+#define TEXTURE_CODEC_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define TEXTURE_BLOCK_DIM 4
+#define TEXTURE_FILE_MAX_LEVELS 16
+#define TEXTURE_FILE_MAGIC 0x31585443u  // "CTX1"
+// level data starts on multiples of this, for the copy offset alignment
+#define TEXTURE_FILE_ALIGNMENT 16
+
+typedef enum BlockFormat {
+    BLOCK_FORMAT_BC1 = 1,  // RGB, 8 bytes per block
+    BLOCK_FORMAT_BC3 = 2,  // RGBA, BC1 color plus BC4 alpha
+    BLOCK_FORMAT_BC7 = 3,  // RGBA, only mode 6 is written and decoded
+} BlockFormat;
+
+#define TEXTURE_FILE_SRGB 0x1u
+
+// A cooked texture, laid out like KTX2 without the format descriptor: a
+// header, then a level index, then every level's blocks, level 0 first.
+typedef struct TextureFileHeader {
+    uint32_t magic;
+    uint32_t format;  // BlockFormat
+    uint32_t flags;
+    uint32_t width;
+    uint32_t height;
+    uint32_t level_count;
+} TextureFileHeader;
+
+typedef struct TextureFileLevel {
+    uint64_t offset;  // from the start of the file
+    uint64_t size;
+} TextureFileLevel;
+
+// Points into the file's contents, which have to stay alive.
+typedef struct TextureFile {
+    const TextureFileHeader *header;
+    const TextureFileLevel *levels;
+    const uint8_t *data;
+} TextureFile;
+
+uint32_t texture_block_size(BlockFormat format);
+// Bytes of a width x height level, partial blocks rounded up.
+size_t texture_level_size(BlockFormat format, uint32_t width, uint32_t height);
+// rgba is width x height RGBA8, dst gets texture_level_size bytes.
+void texture_encode(BlockFormat format, const uint8_t *rgba, uint32_t width, uint32_t height, uint8_t *dst);
+void texture_decode(BlockFormat format, const uint8_t *blocks, uint32_t width, uint32_t height, uint8_t *rgba);
+
+// Checks the header and that every level lies inside size bytes.
+int texture_file_parse(const void *data, size_t size, TextureFile *out_file);
+int texture_file_write(const char *path, BlockFormat format, uint32_t flags, uint32_t width, uint32_t height,
+                       const uint8_t *const *levels, uint32_t level_count);
+
+#endif
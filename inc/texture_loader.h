@@ -0,0 +1,92 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <SDL3/SDL.h>
+#include <webgpu.h>
+#include "file_view.h"
+#include "upload_ring.h"
+#include "mipmap.h"
+#include "texture_codec.h"
+
+#define TEXTURE_LOADER_MAX_THREADS 8
+// textures created and uploaded per poll, bounds the work a frame takes on
+#define TEXTURE_LOADER_POLL_BATCH 8
+
+typedef enum TextureStatus {
+    TEXTURE_QUEUED,
+    TEXTURE_DECODING,
+    TEXTURE_DECODED,  // data waiting for the render thread
+    TEXTURE_READY,
+    TEXTURE_FAILED
+} TextureStatus;
+
+typedef enum TextureSource {
+    TEXTURE_SOURCE_IMAGE,    // PNG/JPG, mips generated on the GPU
+    TEXTURE_SOURCE_BLOCKS,   // cooked, uploaded straight from the mapped file
+    TEXTURE_SOURCE_DECODED,  // cooked, decoded to RGBA8 without BC support
+} TextureSource;
+
+typedef struct TextureJob {
+    const char *path;  // not copied, has to outlive the loader
+    bool srgb;
+    TextureStatus status;
+    // written by the worker that decoded it
+    TextureSource source;
+    WGPUTextureFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t level_count;  // levels in the file, 1 for an image
+    uint32_t block_size;   // TEXTURE_SOURCE_BLOCKS only
+    const uint8_t *levels[TEXTURE_FILE_MAX_LEVELS];  // into pixels or file
+    uint8_t *pixels;       // freed once uploaded
+    FileView file;         // TEXTURE_SOURCE_BLOCKS only, closed once uploaded
+    double decode_ms;
+    // written by the render thread
+    WGPUTexture texture;
+} TextureJob;
+
+typedef struct TextureLoaderStats {
+    uint32_t requested;
+    uint32_t ready;
+    uint32_t failed;
+    double decode_ms;  // summed over workers
+    uint64_t bytes;    // staged for upload, level 0 only for images
+} TextureLoaderStats;
+
+// Decodes PNG/JPG files on worker threads. Files are mapped and decoded with
+// stbi_load_from_memory; the render thread only creates the textures and
+// stages level 0 in the upload ring, the rest of the chain comes from the
+// mipmap generator. Files written by tools/cook.cpp already hold every level
+// as BC blocks, staged as they are when the device has TextureCompressionBC
+// and decoded to RGBA8 on the worker otherwise. Everything in jobs except
+// texture is guarded by mutex. jobs only grows from the render thread, so a
+// worker finds its job by index.
+typedef struct TextureLoader {
+    SDL_Thread *threads[TEXTURE_LOADER_MAX_THREADS];
+    int thread_count;
+    SDL_Mutex *mutex;
+    SDL_Condition *wake;
+    bool quit;
+    bool block_compression;  // the device can sample BC formats
+    TextureJob *jobs;
+    size_t job_count;
+    size_t job_capacity;
+    size_t next_job;  // first job no worker has taken
+    TextureLoaderStats stats;
+} TextureLoader;
+
+// thread_count 0 uses one thread per logical core but one.
+void texture_loader_init(TextureLoader *loader, int thread_count, bool block_compression);
+// Queues an image or cooked file and returns its handle. Call from the
+// render thread. srgb only applies to images, cooked files carry a flag.
+uint32_t texture_loader_request(TextureLoader *loader, const char *path, bool srgb);
+// Uploads decoded textures and generates their mips. Never waits on a worker:
+// if one holds the lock the poll is skipped. Returns how many became ready.
+size_t texture_loader_poll(TextureLoader *loader, UploadRing *ring, MipmapGenerator *mipmaps);
+// NULL until the texture is ready, or if it failed to load.
+WGPUTexture texture_loader_get(const TextureLoader *loader, uint32_t handle);
+void texture_loader_release(TextureLoader *loader);
+
+#endif
@@ -83,6 +83,9 @@ typedef struct {
 
 
 #define TINYOBJ_FLAG_TRIANGULATE (1 << 0)
+/* Parse line ranges on worker threads. Output is identical to the serial
+ * parse. Ignored when built with TINYOBJ_NO_THREADS. */
+#define TINYOBJ_FLAG_PARALLEL (1 << 1)
 
 #define TINYOBJ_INVALID_INDEX (0x80000000)
 
@@ -90,6 +93,18 @@ typedef struct {
 #define TINYOBJ_ERROR_EMPTY (-1)
 #define TINYOBJ_ERROR_INVALID_PARAMETER (-2)
 #define TINYOBJ_ERROR_FILE_OPERATION (-3)
+#define TINYOBJ_ERROR_OUT_OF_MEMORY (-4)
+
+/* Bump allocator. Everything allocated from an arena is released at once by
+ * tinyobj_arena_free. */
+typedef struct tinyobj_arena_block_t tinyobj_arena_block_t;
+
+typedef struct {
+  tinyobj_arena_block_t *blocks;
+  size_t block_size; /* minimum size of each block */
+  size_t used;       /* bytes handed out */
+  size_t reserved;   /* bytes allocated from TINYOBJ_MALLOC */
+} tinyobj_arena_t;
 
 /* Provide a callback that can read text file without any parsing or modification.
  * The obj and mtl parser is going to read all the necessary data:
@@ -124,6 +139,15 @@ extern int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
                              size_t *num_materials, const char *file_name, file_reader_callback file_reader,
                              void *ctx, unsigned int flags);
 
+/* Same as tinyobj_parse_obj, but the arrays in `attrib` are allocated from
+ * `arena` and released with it. Do not call tinyobj_attrib_free on them.
+ * Shapes and materials are still released with their free functions.
+ */
+extern int tinyobj_parse_obj_arena(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
+                                   size_t *num_shapes, tinyobj_material_t **materials,
+                                   size_t *num_materials, const char *file_name, file_reader_callback file_reader,
+                                   void *ctx, unsigned int flags, tinyobj_arena_t *arena);
+
 /* Parse wavefront .mtl
  *
  * @param[out] materials_out
@@ -141,6 +165,10 @@ extern int tinyobj_parse_mtl_file(tinyobj_material_t **materials_out,
                                   const char *filename, const char *obj_filename, file_reader_callback file_reader,
 				  void *ctx);
 
+extern void tinyobj_arena_init(tinyobj_arena_t *arena, size_t block_size);
+extern void *tinyobj_arena_alloc(tinyobj_arena_t *arena, size_t size);
+extern void tinyobj_arena_free(tinyobj_arena_t *arena);
+
 extern void tinyobj_attrib_init(tinyobj_attrib_t *attrib);
 extern void tinyobj_attrib_free(tinyobj_attrib_t *attrib);
 extern void tinyobj_shapes_free(tinyobj_shape_t *shapes, size_t num_shapes);
@@ -154,10 +182,33 @@ extern void tinyobj_materials_free(tinyobj_material_t *materials,
 
 #ifdef TINYOBJ_LOADER_C_IMPLEMENTATION
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
 
+#if defined(_WIN32) && !defined(TINYOBJ_NO_THREADS)
+#define TINYOBJ_NO_THREADS
+#endif
+
+#ifndef TINYOBJ_NO_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/* The NEON line scanner has only been checked against emulated intrinsics,
+ * define TINYOBJ_ENABLE_NEON to use it; aarch64 scans with scalar code
+ * otherwise. */
+#ifndef TINYOBJ_NO_SIMD
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TINYOBJ_SIMD_X86
+#include <immintrin.h>
+#elif defined(TINYOBJ_ENABLE_NEON) && defined(__aarch64__) && defined(__ARM_NEON)
+#define TINYOBJ_SIMD_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
 #if defined(TINYOBJ_MALLOC) && defined(TINYOBJ_CALLOC) && defined(TINYOBJ_FREE) && (defined(TINYOBJ_REALLOC) || defined(TINYOBJ_REALLOC_SIZED))
 /* ok */
 #elif !defined(TINYOBJ_MALLOC) && !defined(TINYOBJ_CALLOC) && !defined(TINYOBJ_FREE) && !defined(TINYOBJ_REALLOC) && !defined(TINYOBJ_REALLOC_SIZED)
@@ -178,8 +229,21 @@ extern void tinyobj_materials_free(tinyobj_material_t *materials,
 #define TINYOBJ_REALLOC_SIZED(p,oldsz,newsz) TINYOBJ_REALLOC(p,newsz)
 #endif
 
-#define TINYOBJ_MAX_FACES_PER_F_LINE (256)
+/* Initial capacity of the per thread face scratch, grown on demand. */
+#define TINYOBJ_FACE_SCRATCH_SIZE (256)
+#define TINYOBJ_COMMAND_CHUNK_SIZE (64 * 1024)
+#define TINYOBJ_ARENA_DEFAULT_BLOCK_SIZE (1024 * 1024)
+#define TINYOBJ_ARENA_ALIGN (16)
 #define TINYOBJ_MAX_FILEPATH (8192)
+#define TINYOBJ_MAX_THREADS (32)
+/* Smaller ranges are not worth a thread. */
+#ifndef TINYOBJ_MIN_LINES_PER_THREAD
+#define TINYOBJ_MIN_LINES_PER_THREAD (16384)
+#endif
+/* Caps the shard count; tests override it to shard on a single core. */
+#ifndef TINYOBJ_ONLINE_CPUS
+#define TINYOBJ_ONLINE_CPUS() sysconf(_SC_NPROCESSORS_ONLN)
+#endif
 
 #define IS_SPACE(x) (((x) == ' ') || ((x) == '\t'))
 #define IS_DIGIT(x) ((unsigned int)((x) - '0') < (unsigned int)(10))
@@ -199,28 +263,19 @@ static void skip_space_and_cr(const char **token) {
 
 static int until_space(const char *token) {
   const char *p = token;
-  while (p[0] != '\0' && p[0] != ' ' && p[0] != '\t' && p[0] != '\r') {
+  while (p[0] != '\0' && p[0] != ' ' && p[0] != '\t' && p[0] != '\r' && p[0] != '\n') {
     p++;
   }
 
   return (int)(p - token);
 }
 
-static size_t length_until_newline(const char *token, size_t n) {
-  size_t len = 0;
+/* Length of the text from token up to line_end, without trailing
+ * whitespace or the '\r' of a CRLF ending. */
+static size_t length_until_line_end(const char *token, const char *line_end) {
+  size_t len = (size_t)(line_end - token);
 
-  /* Assume token[n-1] = '\0' */
-  assert(token[n-1] == '\0');
-  for (len = 0; len < n - 1; len++) {
-    if (token[len] == '\n') {
-      break;
-    }
-    if ((token[len] == '\r') && ((len < (n - 2)) && (token[len + 1] != '\n'))) {
-      break;
-    }
-  }
-  /* remove trailing whitespace */
-  while (len > 0 && IS_SPACE(token[len - 1])) {
+  while (len > 0 && (IS_SPACE(token[len - 1]) || token[len - 1] == '\r')) {
     len--;
   }
 
@@ -274,6 +329,7 @@ static tinyobj_vertex_index_t parseRawTriple(const char **token) {
 
   vi.v_idx = my_atoi((*token));
   while ((*token)[0] != '\0' && (*token)[0] != '/' && (*token)[0] != ' ' &&
+         (*token)[0] != '\n' &&
          (*token)[0] != '\t' && (*token)[0] != '\r') {
     (*token)++;
   }
@@ -287,6 +343,7 @@ static tinyobj_vertex_index_t parseRawTriple(const char **token) {
     (*token)++;
     vi.vn_idx = my_atoi((*token));
     while ((*token)[0] != '\0' && (*token)[0] != '/' && (*token)[0] != ' ' &&
+         (*token)[0] != '\n' &&
            (*token)[0] != '\t' && (*token)[0] != '\r') {
       (*token)++;
     }
@@ -296,6 +353,7 @@ static tinyobj_vertex_index_t parseRawTriple(const char **token) {
   /* i/j/k or i/j */
   vi.vt_idx = my_atoi((*token));
   while ((*token)[0] != '\0' && (*token)[0] != '/' && (*token)[0] != ' ' &&
+         (*token)[0] != '\n' &&
          (*token)[0] != '\t' && (*token)[0] != '\r') {
     (*token)++;
   }
@@ -307,6 +365,7 @@ static tinyobj_vertex_index_t parseRawTriple(const char **token) {
   (*token)++; /* skip '/' */
   vi.vn_idx = my_atoi((*token));
   while ((*token)[0] != '\0' && (*token)[0] != '/' && (*token)[0] != ' ' &&
+         (*token)[0] != '\n' &&
          (*token)[0] != '\t' && (*token)[0] != '\r') {
     (*token)++;
   }
@@ -485,15 +544,99 @@ fail:
   return 0;
 }
 
+/* 10^k for k <= 10 is exact in a float. */
+static const float tinyobj_pow10f[] = {
+  1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+/*
+ * Fast path for plain fixed point numbers such as `1.198639` or `-0.5`, the
+ * form exporters like Blender write. When the digits form an integer m <= 2^24
+ * with at most 10 fraction digits, both m and 10^k are exact floats, so a
+ * single float division is correctly rounded.
+ *
+ * Scans the token once and returns its end, or NULL without touching result
+ * if it has any other shape (exponent, too many digits, trailing garbage).
+ */
+static const char *tryParseFloatFast(const char *s, float *result) {
+  const char *curr = s;
+  unsigned long long mantissa = 0;
+  int num_digits = 0;
+  int frac_digits = 0;
+  int negative = 0;
+  float f;
+
+  if (*curr == '+' || *curr == '-') {
+    negative = (*curr == '-');
+    curr++;
+  }
+
+  while (IS_DIGIT(*curr)) {
+    if (num_digits == 18) return NULL;
+    mantissa = mantissa * 10 + (unsigned long long)(*curr - '0');
+    num_digits++;
+    curr++;
+  }
+
+  if (*curr == '.') {
+    curr++;
+    while (IS_DIGIT(*curr)) {
+      if (num_digits == 18) return NULL;
+      mantissa = mantissa * 10 + (unsigned long long)(*curr - '0');
+      num_digits++;
+      frac_digits++;
+      curr++;
+    }
+  }
+
+  if (!(IS_SPACE(*curr) || IS_NEW_LINE(*curr)) || num_digits == 0) return NULL;
+  if (mantissa > (1ull << 24) || frac_digits > 10) return NULL;
+
+  f = (float)mantissa / tinyobj_pow10f[frac_digits];
+  *result = negative ? -f : f;
+  return curr;
+}
+
+/* Correctly rounded fallback through strtof. Only the characters that can
+ * appear in a decimal float are handed over, so hex floats, inf and nan are
+ * still rejected as before. Well formed tokens go by strtof alone, so ".5"
+ * parses the same here as in the fast path; anything else keeps the old
+ * tryParseDouble check. */
+static float parseFloatSlow(const char *s, const char *s_end) {
+  char buf[64];
+  char *end;
+  size_t len = 0;
+  double val = 0.0;
+  float f;
+
+  while (s + len < s_end && len < sizeof(buf) - 1 &&
+         (IS_DIGIT(s[len]) || s[len] == '+' || s[len] == '-' || s[len] == '.' ||
+          s[len] == 'e' || s[len] == 'E')) {
+    buf[len] = s[len];
+    len++;
+  }
+
+  if (len < sizeof(buf) - 1) {
+    buf[len] = '\0';
+    f = strtof(buf, &end);
+    if (len > 0 && end == buf + len) return f;
+    return tryParseDouble(s, s + len, &val) ? f : 0.0f;
+  }
+
+  /* Absurdly long token, keep the old approximate parse. */
+  tryParseDouble(s, s_end, &val);
+  return (float)val;
+}
+
 static float parseFloat(const char **token) {
   const char *end;
-  double val = 0.0;
   float f = 0.0f;
   skip_space(token);
-  end = (*token) + until_space((*token));
-  val = 0.0;
-  tryParseDouble((*token), end, &val);
-  f = (float)(val);
+  end = tryParseFloatFast((*token), &f);
+  if (!end) {
+    end = (*token) + until_space((*token));
+    f = parseFloatSlow((*token), end);
+  }
   (*token) = end;
   return f;
 }
@@ -526,6 +669,7 @@ static char *my_strdup(const char *s, size_t max_length) {
 
   /* trim line ending and append '\0' */
   d = (char *)TINYOBJ_MALLOC(len + 1); /* + '\0' */
+  if (!d) return NULL;
   memcpy(d, s, (size_t)(len));
   d[len] = '\0';
 
@@ -598,6 +742,96 @@ static void initMaterial(tinyobj_material_t *material) {
   material->ior = 1.f;
 }
 
+/* Arena */
+
+struct tinyobj_arena_block_t {
+  tinyobj_arena_block_t *next;
+  size_t size;
+  size_t used;
+};
+
+#define TINYOBJ_ARENA_HEADER_SIZE \
+  ((sizeof(tinyobj_arena_block_t) + TINYOBJ_ARENA_ALIGN - 1) & ~(size_t)(TINYOBJ_ARENA_ALIGN - 1))
+
+void tinyobj_arena_init(tinyobj_arena_t *arena, size_t block_size) {
+  arena->blocks = NULL;
+  arena->block_size = block_size ? block_size : TINYOBJ_ARENA_DEFAULT_BLOCK_SIZE;
+  arena->used = 0;
+  arena->reserved = 0;
+}
+
+void *tinyobj_arena_alloc(tinyobj_arena_t *arena, size_t size) {
+  tinyobj_arena_block_t *block = arena->blocks;
+  char *p;
+
+  size = (size + TINYOBJ_ARENA_ALIGN - 1) & ~(size_t)(TINYOBJ_ARENA_ALIGN - 1);
+  if (size == 0) size = TINYOBJ_ARENA_ALIGN;
+
+  if (block == NULL || block->size - block->used < size) {
+    size_t block_size = size > arena->block_size ? size : arena->block_size;
+    block = (tinyobj_arena_block_t *)TINYOBJ_MALLOC(TINYOBJ_ARENA_HEADER_SIZE + block_size);
+    if (block == NULL) return NULL;
+    block->size = block_size;
+    block->used = 0;
+    arena->reserved += TINYOBJ_ARENA_HEADER_SIZE + block_size;
+
+    /* An oversized block is filled by this request alone, so keep bumping
+     * in the current head block. */
+    if (arena->blocks && block_size > arena->block_size) {
+      block->next = arena->blocks->next;
+      arena->blocks->next = block;
+    } else {
+      block->next = arena->blocks;
+      arena->blocks = block;
+    }
+  }
+
+  p = (char *)block + TINYOBJ_ARENA_HEADER_SIZE + block->used;
+  block->used += size;
+  arena->used += size;
+  return p;
+}
+
+void tinyobj_arena_free(tinyobj_arena_t *arena) {
+  tinyobj_arena_block_t *block = arena->blocks;
+  while (block) {
+    tinyobj_arena_block_t *next = block->next;
+    TINYOBJ_FREE(block);
+    block = next;
+  }
+  arena->blocks = NULL;
+  arena->used = 0;
+  arena->reserved = 0;
+}
+
+/* Moves every block of src into dst, so freeing dst releases both. */
+static void arena_absorb(tinyobj_arena_t *dst, tinyobj_arena_t *src) {
+  tinyobj_arena_block_t *tail = src->blocks;
+  if (tail == NULL) return;
+  while (tail->next) tail = tail->next;
+
+  if (dst->blocks) {
+    tail->next = dst->blocks->next;
+    dst->blocks->next = src->blocks;
+  } else {
+    dst->blocks = src->blocks;
+  }
+  dst->used += src->used;
+  dst->reserved += src->reserved;
+  src->blocks = NULL;
+  src->used = 0;
+  src->reserved = 0;
+}
+
+/* Zeroed allocation from arena, or the heap if arena is NULL. */
+static void *arena_calloc(tinyobj_arena_t *arena, size_t count, size_t size) {
+  void *p;
+  if (arena == NULL) return TINYOBJ_CALLOC(count, size);
+  p = tinyobj_arena_alloc(arena, count * size);
+  if (p) memset(p, 0, count * size);
+  return p;
+}
+
 /* Implementation of string to int hashtable */
 
 #define HASH_TABLE_ERROR 1
@@ -621,6 +855,7 @@ typedef struct
   hash_table_entry_t* entries;
   size_t capacity;
   size_t n;
+  tinyobj_arena_t* arena; /* NULL = heap */
 } hash_table_t;
 
 static unsigned long hash_djb2(const unsigned char* str)
@@ -635,18 +870,36 @@ static unsigned long hash_djb2(const unsigned char* str)
   return hash;
 }
 
-static void create_hash_table(size_t start_capacity, hash_table_t* hash_table)
+/* hash_djb2 of the first len bytes, for names that are not NUL terminated. */
+static unsigned long hash_djb2_len(const unsigned char* str, size_t len)
+{
+  unsigned long hash = 5381;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    hash = ((hash << 5) + hash) + (unsigned long)(str[i]);
+  }
+
+  return hash;
+}
+
+static int create_hash_table(size_t start_capacity, hash_table_t* hash_table, tinyobj_arena_t* arena)
 {
   if (start_capacity < 1)
     start_capacity = HASH_TABLE_DEFAULT_SIZE;
-  hash_table->hashes = (unsigned long*) TINYOBJ_MALLOC(start_capacity * sizeof(unsigned long));
-  hash_table->entries = (hash_table_entry_t*) TINYOBJ_CALLOC(start_capacity, sizeof(hash_table_entry_t));
+  hash_table->arena = arena;
+  hash_table->hashes = (unsigned long*) arena_calloc(arena, start_capacity, sizeof(unsigned long));
+  hash_table->entries = (hash_table_entry_t*) arena_calloc(arena, start_capacity, sizeof(hash_table_entry_t));
   hash_table->capacity = start_capacity;
   hash_table->n = 0;
+  if (hash_table->hashes == NULL || hash_table->entries == NULL) return HASH_TABLE_ERROR;
+  return HASH_TABLE_SUCCESS;
 }
 
 static void destroy_hash_table(hash_table_t* hash_table)
 {
+  /* Arena backed tables go away with their arena. */
+  if (hash_table->arena) return;
   TINYOBJ_FREE(hash_table->entries);
   TINYOBJ_FREE(hash_table->hashes);
 }
@@ -707,7 +960,8 @@ static hash_table_entry_t* hash_table_find(unsigned long hash, hash_table_t* has
   return NULL;
 }
 
-static void hash_table_grow(hash_table_t* hash_table)
+/* Leaves the table as it was and returns HASH_TABLE_ERROR when out of memory. */
+static int hash_table_grow(hash_table_t* hash_table)
 {
   size_t new_capacity;
   hash_table_t new_hash_table;
@@ -715,11 +969,24 @@ static void hash_table_grow(hash_table_t* hash_table)
 
   new_capacity = 2 * hash_table->capacity;
   /* Create a new hash table. We're not calling create_hash_table because we want to realloc the hash array */
-  new_hash_table.hashes = hash_table->hashes = (unsigned long*) TINYOBJ_REALLOC_SIZED(
-      (void*) hash_table->hashes, sizeof(unsigned long) * hash_table->capacity, sizeof(unsigned long) * new_capacity);
-  new_hash_table.entries = (hash_table_entry_t*) TINYOBJ_CALLOC(new_capacity, sizeof(hash_table_entry_t));
+  new_hash_table.entries = (hash_table_entry_t*) arena_calloc(hash_table->arena, new_capacity, sizeof(hash_table_entry_t));
+  if (new_hash_table.entries == NULL) return HASH_TABLE_ERROR;
+  if (hash_table->arena) {
+    new_hash_table.hashes = (unsigned long*) tinyobj_arena_alloc(hash_table->arena, sizeof(unsigned long) * new_capacity);
+    if (new_hash_table.hashes == NULL) return HASH_TABLE_ERROR;
+    memcpy(new_hash_table.hashes, hash_table->hashes, sizeof(unsigned long) * hash_table->capacity);
+  } else {
+    new_hash_table.hashes = (unsigned long*) TINYOBJ_REALLOC_SIZED(
+        (void*) hash_table->hashes, sizeof(unsigned long) * hash_table->capacity, sizeof(unsigned long) * new_capacity);
+    if (new_hash_table.hashes == NULL) {
+      TINYOBJ_FREE(new_hash_table.entries);
+      return HASH_TABLE_ERROR;
+    }
+  }
+  hash_table->hashes = new_hash_table.hashes;
   new_hash_table.capacity = new_capacity;
   new_hash_table.n = hash_table->n;
+  new_hash_table.arena = hash_table->arena;
 
   /* Rehash */
   for (i = 0; i < hash_table->capacity; i++)
@@ -730,16 +997,13 @@ static void hash_table_grow(hash_table_t* hash_table)
     }
   }
 
-  TINYOBJ_FREE(hash_table->entries);
+  if (hash_table->arena == NULL) TINYOBJ_FREE(hash_table->entries);
   (*hash_table) = new_hash_table;
+  return HASH_TABLE_SUCCESS;
 }
 
-static int hash_table_exists(const char* name, hash_table_t* hash_table)
-{
-  return hash_table_find(hash_djb2((const unsigned char*)name), hash_table) != NULL;
-}
 
-static void hash_table_set(const char* name, size_t val, hash_table_t* hash_table)
+static int hash_table_set(const char* name, size_t val, hash_table_t* hash_table)
 {
   /* Hash name */
   unsigned long hash = hash_djb2((const unsigned char *)name);
@@ -748,23 +1012,19 @@ static void hash_table_set(const char* name, size_t val, hash_table_t* hash_tabl
   if (entry)
   {
     entry->value = (long)val;
-    return;
+    return HASH_TABLE_SUCCESS;
   }
 
   /* Expand if necessary
    * Grow until the element has been added
    */
   while (hash_table_insert(hash, (long)val, hash_table) != HASH_TABLE_SUCCESS) {
-    hash_table_grow(hash_table);
+    if (hash_table_grow(hash_table) != HASH_TABLE_SUCCESS) return HASH_TABLE_ERROR;
   }
+  return HASH_TABLE_SUCCESS;
 }
 
-static long hash_table_get(const char* name, hash_table_t* hash_table)
-{
-  hash_table_entry_t* ret = hash_table_find(hash_djb2((const unsigned char*)(name)), hash_table);
-  return ret->value;
-}
-
+/* Returns NULL and leaves prev alone when out of memory. */
 static tinyobj_material_t *tinyobj_material_add(tinyobj_material_t *prev,
                                                 size_t num_materials,
                                                 tinyobj_material_t *new_mat) {
@@ -772,11 +1032,25 @@ static tinyobj_material_t *tinyobj_material_add(tinyobj_material_t *prev,
   size_t num_bytes = sizeof(tinyobj_material_t) * num_materials;
   dst = (tinyobj_material_t *)TINYOBJ_REALLOC_SIZED(
                                       prev, num_bytes, num_bytes + sizeof(tinyobj_material_t));
+  if (dst == NULL) return NULL;
 
   dst[num_materials] = (*new_mat); /* Just copy pointer for char* members */
   return dst;
 }
 
+static void free_material(tinyobj_material_t *material) {
+  if (material->name) TINYOBJ_FREE(material->name);
+  if (material->ambient_texname) TINYOBJ_FREE(material->ambient_texname);
+  if (material->diffuse_texname) TINYOBJ_FREE(material->diffuse_texname);
+  if (material->specular_texname) TINYOBJ_FREE(material->specular_texname);
+  if (material->specular_highlight_texname)
+    TINYOBJ_FREE(material->specular_highlight_texname);
+  if (material->bump_texname) TINYOBJ_FREE(material->bump_texname);
+  if (material->displacement_texname)
+    TINYOBJ_FREE(material->displacement_texname);
+  if (material->alpha_texname) TINYOBJ_FREE(material->alpha_texname);
+}
+
 static int is_line_ending(const char *p, size_t i, size_t end_i) {
   if (p[i] == '\0') return 1;
   if (p[i] == '\n') return 1; /* this includes \r\n */
@@ -793,51 +1067,182 @@ typedef struct {
   size_t len;
 } LineInfo;
 
-/* Find '\n' and create line data. */
+/* Line table being filled by a single pass over the buffer. */
+typedef struct {
+  LineInfo *infos;
+  size_t num_lines;
+  size_t capacity;
+  size_t prev_pos;
+  size_t last_line_ending;
+  int failed;
+} LineScan;
+
+/* Called for every '\n', '\r' or '\0'; the vector scanners only find
+ * candidates, is_line_ending settles the '\r\n' case. */
+static void line_scan_candidate(LineScan *scan, const char *buf, size_t i, size_t end_idx) {
+  if (!is_line_ending(buf, i, end_idx)) return;
+
+  if (scan->num_lines == scan->capacity) {
+    size_t capacity = scan->capacity * 2;
+    LineInfo *grown = (LineInfo *)TINYOBJ_REALLOC_SIZED(
+        scan->infos, sizeof(LineInfo) * scan->capacity, sizeof(LineInfo) * capacity);
+    if (!grown) {
+      scan->failed = 1;
+      return;
+    }
+    scan->infos = grown;
+    scan->capacity = capacity;
+  }
+
+  scan->infos[scan->num_lines].pos = scan->prev_pos;
+  scan->infos[scan->num_lines].len = i - scan->prev_pos;
+  scan->num_lines++;
+  scan->prev_pos = i + 1;
+  scan->last_line_ending = i;
+}
+
+static void scan_lines_scalar(const char *buf, size_t begin, size_t end_idx, LineScan *scan) {
+  size_t i;
+  for (i = begin; i < end_idx; i++) {
+    if (buf[i] == '\n' || buf[i] == '\r' || buf[i] == '\0') {
+      line_scan_candidate(scan, buf, i, end_idx);
+    }
+  }
+}
+
+#ifdef TINYOBJ_SIMD_X86
+static void scan_lines_sse2(const char *buf, size_t end_idx, LineScan *scan) {
+  const __m128i lf = _mm_set1_epi8('\n');
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i nul = _mm_setzero_si128();
+  size_t i = 0;
+
+  for (; i + 16 <= end_idx; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+    __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)),
+                               _mm_cmpeq_epi8(v, nul));
+    unsigned int mask = (unsigned int)_mm_movemask_epi8(hit);
+    while (mask) {
+      line_scan_candidate(scan, buf, i + (size_t)__builtin_ctz(mask), end_idx);
+      mask &= mask - 1;
+    }
+  }
+  scan_lines_scalar(buf, i, end_idx, scan);
+}
+
+__attribute__((target("avx2")))
+static void scan_lines_avx2(const char *buf, size_t end_idx, LineScan *scan) {
+  const __m256i lf = _mm256_set1_epi8('\n');
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i nul = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 32 <= end_idx; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+    __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)),
+                                  _mm256_cmpeq_epi8(v, nul));
+    unsigned int mask = (unsigned int)_mm256_movemask_epi8(hit);
+    while (mask) {
+      line_scan_candidate(scan, buf, i + (size_t)__builtin_ctz(mask), end_idx);
+      mask &= mask - 1;
+    }
+  }
+  scan_lines_scalar(buf, i, end_idx, scan);
+}
+#endif
+
+#ifdef TINYOBJ_SIMD_NEON
+static void scan_lines_neon(const char *buf, size_t end_idx, LineScan *scan) {
+  const uint8x16_t lf = vdupq_n_u8('\n');
+  const uint8x16_t cr = vdupq_n_u8('\r');
+  const uint8x16_t nul = vdupq_n_u8(0);
+  size_t i = 0;
+
+  for (; i + 16 <= end_idx; i += 16) {
+    uint8x16_t v = vld1q_u8((const uint8_t *)(buf + i));
+    uint8x16_t hit = vorrq_u8(vorrq_u8(vceqq_u8(v, lf), vceqq_u8(v, cr)), vceqq_u8(v, nul));
+    /* Narrow to one nibble per byte since NEON has no movemask. */
+    uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+    while (mask) {
+      line_scan_candidate(scan, buf, i + (size_t)(__builtin_ctzll(mask) >> 2), end_idx);
+      mask &= ~(0xfull << (__builtin_ctzll(mask) & ~3));
+    }
+  }
+  scan_lines_scalar(buf, i, end_idx, scan);
+}
+#endif
+
+/* Picks the widest scanner the CPU supports, once. */
+static void scan_lines(const char *buf, size_t end_idx, LineScan *scan) {
+#if defined(TINYOBJ_SIMD_X86)
+  static int has_avx2 = -1;
+  if (has_avx2 < 0) has_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+  if (has_avx2) {
+    scan_lines_avx2(buf, end_idx, scan);
+  } else {
+    scan_lines_sse2(buf, end_idx, scan);
+  }
+#elif defined(TINYOBJ_SIMD_NEON)
+  scan_lines_neon(buf, end_idx, scan);
+#else
+  scan_lines_scalar(buf, 0, end_idx, scan);
+#endif
+}
+
+/* Find '\n' and create line data in a single pass. */
 static int get_line_infos(const char *buf, size_t buf_len, LineInfo **line_infos, size_t *num_lines)
 {
-  size_t i = 0;
   size_t end_idx = buf_len;
-  size_t prev_pos = 0;
-  size_t line_no = 0;
-  size_t last_line_ending = 0;
-
-  /* Count # of lines. */
-  for (i = 0; i < end_idx; i++) {
-    if (is_line_ending(buf, i, end_idx)) {
-      (*num_lines)++;
-      last_line_ending = i;
-    }
+  LineScan scan;
+
+  scan.capacity = buf_len / 32 + 16; /* grown as needed */
+  scan.infos = (LineInfo *)TINYOBJ_MALLOC(sizeof(LineInfo) * scan.capacity);
+  scan.num_lines = 0;
+  scan.prev_pos = 0;
+  scan.last_line_ending = 0;
+  scan.failed = (scan.infos == NULL);
+
+  if (!scan.failed) {
+    scan_lines(buf, end_idx, &scan);
   }
+
   /* The last char from the input may not be a line
     * ending character so add an extra line if there
     * are more characters after the last line ending
     * that was found. */
-  if (end_idx - last_line_ending > 1) {
-      (*num_lines)++;
-  }
-
-  if (*num_lines == 0) return TINYOBJ_ERROR_EMPTY;
-
-  *line_infos = (LineInfo *)TINYOBJ_MALLOC(sizeof(LineInfo) * (*num_lines));
-
-  /* Fill line infos. */
-  for (i = 0; i < end_idx; i++) {
-    if (is_line_ending(buf, i, end_idx)) {
-      (*line_infos)[line_no].pos = prev_pos;
-      (*line_infos)[line_no].len = i - prev_pos;
-      prev_pos = i + 1;
-      line_no++;
+  if (!scan.failed && end_idx - scan.last_line_ending > 1) {
+    LineInfo *grown = (LineInfo *)TINYOBJ_REALLOC_SIZED(
+        scan.infos, sizeof(LineInfo) * scan.capacity, sizeof(LineInfo) * (scan.num_lines + 1));
+    if (grown) {
+      scan.infos = grown;
+      scan.infos[scan.num_lines].pos = scan.prev_pos;
+      scan.infos[scan.num_lines].len = end_idx - 1 - scan.last_line_ending;
+      scan.num_lines++;
+    } else {
+      scan.failed = 1;
     }
   }
-  if (end_idx - last_line_ending > 1) {
-    (*line_infos)[line_no].pos = prev_pos;
-    (*line_infos)[line_no].len = end_idx - 1 - last_line_ending;
+
+  if (scan.failed || scan.num_lines == 0) {
+    if (scan.infos) TINYOBJ_FREE(scan.infos);
+    *line_infos = NULL;
+    return scan.failed ? TINYOBJ_ERROR_OUT_OF_MEMORY : TINYOBJ_ERROR_EMPTY;
   }
 
+  *line_infos = scan.infos;
+  *num_lines = scan.num_lines;
   return 0;
 }
 
+/* Releases everything the mtl parse holds and reports running out of memory. */
+static int mtl_out_of_memory(LineInfo *line_infos, tinyobj_material_t *pending,
+                             tinyobj_material_t *materials, size_t num_materials) {
+  TINYOBJ_FREE(line_infos);
+  free_material(pending);
+  tinyobj_materials_free(materials, num_materials);
+  return TINYOBJ_ERROR_OUT_OF_MEMORY;
+}
+
 static int tinyobj_parse_and_index_mtl_file(tinyobj_material_t **materials_out,
                                             size_t *num_materials_out,
                                             const char *mtl_filename, const char *obj_filename, file_reader_callback file_reader, void *ctx,
@@ -852,6 +1257,7 @@ static int tinyobj_parse_and_index_mtl_file(tinyobj_material_t **materials_out,
   size_t i = 0;
   char *buf = NULL;
   size_t len = 0;
+  int ret = 0;
 
   if (materials_out == NULL) {
     return TINYOBJ_ERROR_INVALID_PARAMETER;
@@ -868,9 +1274,9 @@ static int tinyobj_parse_and_index_mtl_file(tinyobj_material_t **materials_out,
   if (len < 1) return TINYOBJ_ERROR_INVALID_PARAMETER;
   if (buf == NULL) return TINYOBJ_ERROR_INVALID_PARAMETER;
 
-  if (get_line_infos(buf, len, &line_infos, &num_lines) != 0) {
-		TINYOBJ_FREE(line_infos);
-    return TINYOBJ_ERROR_EMPTY;
+  ret = get_line_infos(buf, len, &line_infos, &num_lines);
+  if (ret != 0) {
+    return ret;
   }
 
   /* Create a default material */
@@ -904,7 +1310,9 @@ static int tinyobj_parse_and_index_mtl_file(tinyobj_material_t **materials_out,
 
       /* flush previous material. */
       if (has_previous_material) {
-        materials = tinyobj_material_add(materials, num_materials, &material);
+        tinyobj_material_t *grown = tinyobj_material_add(materials, num_materials, &material);
+        if (grown == NULL) return mtl_out_of_memory(line_infos, &material, materials, num_materials);
+        materials = grown;
         num_materials++;
       } else {
         has_previous_material = 1;
@@ -921,10 +1329,13 @@ static int tinyobj_parse_and_index_mtl_file(tinyobj_material_t **materials_out,
       sscanf(token, "%s", namebuf);
 #endif
       material.name = my_strdup(namebuf, (size_t) (line_end - token));
+      if (material.name == NULL) return mtl_out_of_memory(line_infos, &material, materials, num_materials);
 
       /* Add material to material table */
-      if (material_table)
-        hash_table_set(material.name, num_materials, material_table);
+      if (material_table &&
+          hash_table_set(material.name, num_materials, material_table) != HASH_TABLE_SUCCESS) {
+        return mtl_out_of_memory(line_infos, &material, materials, num_materials);
+      }
 
       continue;
     }
@@ -1077,14 +1488,16 @@ static int tinyobj_parse_and_index_mtl_file(tinyobj_material_t **materials_out,
     /* @todo { unknown parameter } */
   }
 
-	TINYOBJ_FREE(line_infos);
-
   if (material.name) {
     /* Flush last material element */
-    materials = tinyobj_material_add(materials, num_materials, &material);
+    tinyobj_material_t *grown = tinyobj_material_add(materials, num_materials, &material);
+    if (grown == NULL) return mtl_out_of_memory(line_infos, &material, materials, num_materials);
+    materials = grown;
     num_materials++;
   }
 
+	TINYOBJ_FREE(line_infos);
+
   (*num_materials_out) = num_materials;
   (*materials_out) = materials;
 
@@ -1112,46 +1525,224 @@ typedef enum {
 
 } CommandType;
 
+/* Decoded view of one parsed line. In the command stream each line only
+ * takes as many 32-bit words as its content needs:
+ *
+ *   V, VN:                  type, x, y, z
+ *   VT:                     type, x, y
+ *   F:                      type, num_f, num_f_num_verts, f[num_f], f_num_verts[]
+ *   G, O, USEMTL, MTLLIB:   type, name_len, name (pointer into the source)
+ *
+ * and empty or unknown lines are not stored at all. */
 typedef struct {
-  float vx, vy, vz;
-  float nx, ny, nz;
-  float tx, ty;
+  CommandType type;
+  float x, y, z;
 
-  /* @todo { Use dynamic array } */
-  tinyobj_vertex_index_t f[TINYOBJ_MAX_FACES_PER_F_LINE];
+  const tinyobj_vertex_index_t *f;
   size_t num_f;
-
-  int f_num_verts[TINYOBJ_MAX_FACES_PER_F_LINE];
+  const int *f_num_verts;
   size_t num_f_num_verts;
 
-  const char *group_name;
-  unsigned int group_name_len;
-  int pad0;
+  const char *name;
+  unsigned int name_len;
+} Command;
 
-  const char *object_name;
-  unsigned int object_name_len;
-  int pad1;
+/* Command records of one line range, in arena allocated chunks. */
+typedef struct CommandChunk {
+  struct CommandChunk *next;
+  size_t used;     /* words */
+  size_t capacity; /* words */
+} CommandChunk;
 
-  const char *material_name;
-  unsigned int material_name_len;
-  int pad2;
+#define COMMAND_CHUNK_WORDS(chunk) \
+  ((unsigned int *)((char *)(chunk) + sizeof(CommandChunk)))
 
-  const char *mtllib_name;
-  unsigned int mtllib_name_len;
+typedef struct {
+  tinyobj_arena_t *arena;
+  CommandChunk *head;
+  CommandChunk *tail;
+} CommandStream;
 
-  CommandType type;
-} Command;
+typedef struct {
+  const CommandChunk *chunk;
+  size_t offset;
+} CommandCursor;
+
+static unsigned int *command_stream_reserve(CommandStream *stream, size_t num_words) {
+  CommandChunk *chunk = stream->tail;
+  unsigned int *w;
+
+  if (chunk == NULL || chunk->capacity - chunk->used < num_words) {
+    size_t capacity = TINYOBJ_COMMAND_CHUNK_SIZE / sizeof(unsigned int);
+    if (capacity < num_words) capacity = num_words;
+    chunk = (CommandChunk *)tinyobj_arena_alloc(stream->arena,
+                                                sizeof(CommandChunk) + capacity * sizeof(unsigned int));
+    if (chunk == NULL) return NULL;
+    chunk->next = NULL;
+    chunk->used = 0;
+    chunk->capacity = capacity;
+    if (stream->tail) {
+      stream->tail->next = chunk;
+    } else {
+      stream->head = chunk;
+    }
+    stream->tail = chunk;
+  }
 
-static int parseLine(Command *command, const char *p, size_t p_len,
-                     int triangulate) {
-  char linebuf[4096];
-  const char *token;
-  assert(p_len < 4095);
+  w = COMMAND_CHUNK_WORDS(chunk) + chunk->used;
+  chunk->used += num_words;
+  return w;
+}
+
+/* Returns the stored record, NULL for commands that are not kept (and on
+ * allocation failure, which sets *failed). */
+static const unsigned int *append_command(CommandStream *stream, const Command *command, int *failed) {
+  size_t num_words;
+  unsigned int *w;
+
+  switch (command->type) {
+    case COMMAND_V:
+    case COMMAND_VN:
+      num_words = 4;
+      break;
+    case COMMAND_VT:
+      num_words = 3;
+      break;
+    case COMMAND_F:
+      num_words = 3 + 3 * command->num_f + command->num_f_num_verts;
+      break;
+    case COMMAND_G:
+    case COMMAND_O:
+    case COMMAND_USEMTL:
+    case COMMAND_MTLLIB:
+      num_words = 2 + sizeof(const char *) / sizeof(unsigned int);
+      break;
+    default:
+      return NULL;
+  }
+
+  w = command_stream_reserve(stream, num_words);
+  if (w == NULL) {
+    *failed = 1;
+    return NULL;
+  }
+
+  w[0] = (unsigned int)command->type;
+  switch (command->type) {
+    case COMMAND_V:
+    case COMMAND_VN:
+      memcpy(&w[1], &command->x, sizeof(float));
+      memcpy(&w[2], &command->y, sizeof(float));
+      memcpy(&w[3], &command->z, sizeof(float));
+      break;
+    case COMMAND_VT:
+      memcpy(&w[1], &command->x, sizeof(float));
+      memcpy(&w[2], &command->y, sizeof(float));
+      break;
+    case COMMAND_F:
+      w[1] = (unsigned int)command->num_f;
+      w[2] = (unsigned int)command->num_f_num_verts;
+      memcpy(&w[3], command->f, sizeof(tinyobj_vertex_index_t) * command->num_f);
+      memcpy(&w[3 + 3 * command->num_f], command->f_num_verts, sizeof(int) * command->num_f_num_verts);
+      break;
+    default:
+      w[1] = command->name_len;
+      memcpy(&w[2], &command->name, sizeof(const char *));
+      break;
+  }
+  return w;
+}
 
-  memcpy(linebuf, p, p_len);
-  linebuf[p_len] = '\0';
+/* Decodes the record at w and returns the number of words it takes. */
+static size_t decode_command(const unsigned int *w, Command *command) {
+  command->type = (CommandType)w[0];
+  switch (command->type) {
+    case COMMAND_V:
+    case COMMAND_VN:
+      memcpy(&command->x, &w[1], sizeof(float));
+      memcpy(&command->y, &w[2], sizeof(float));
+      memcpy(&command->z, &w[3], sizeof(float));
+      return 4;
+    case COMMAND_VT:
+      memcpy(&command->x, &w[1], sizeof(float));
+      memcpy(&command->y, &w[2], sizeof(float));
+      return 3;
+    case COMMAND_F:
+      command->num_f = w[1];
+      command->num_f_num_verts = w[2];
+      command->f = (const tinyobj_vertex_index_t *)(const void *)&w[3];
+      command->f_num_verts = (const int *)(const void *)&w[3 + 3 * command->num_f];
+      return 3 + 3 * command->num_f + command->num_f_num_verts;
+    default:
+      command->name_len = w[1];
+      memcpy(&command->name, &w[2], sizeof(const char *));
+      return 2 + sizeof(const char *) / sizeof(unsigned int);
+  }
+}
 
-  token = linebuf;
+static void command_cursor_init(CommandCursor *cursor, const CommandStream *stream) {
+  cursor->chunk = stream->head;
+  cursor->offset = 0;
+}
+
+static int next_command(CommandCursor *cursor, Command *command) {
+  while (cursor->chunk && cursor->offset == cursor->chunk->used) {
+    cursor->chunk = cursor->chunk->next;
+    cursor->offset = 0;
+  }
+  if (cursor->chunk == NULL) return 0;
+  cursor->offset += decode_command(COMMAND_CHUNK_WORDS(cursor->chunk) + cursor->offset, command);
+  return 1;
+}
+
+/* Reused storage for the faces of the line being parsed, grown in the arena. */
+typedef struct {
+  tinyobj_arena_t *arena;
+  tinyobj_vertex_index_t *f;
+  size_t cap_f;
+  int *f_num_verts;
+  size_t cap_f_num_verts;
+} FaceScratch;
+
+static int grow_scratch(tinyobj_arena_t *arena, void **array, size_t elem_size, size_t *capacity,
+                        size_t used) {
+  size_t new_capacity = *capacity ? *capacity * 2 : TINYOBJ_FACE_SCRATCH_SIZE;
+  void *grown = tinyobj_arena_alloc(arena, elem_size * new_capacity);
+  if (grown == NULL) return 0;
+  if (used) memcpy(grown, *array, elem_size * used);
+  *array = grown;
+  *capacity = new_capacity;
+  return 1;
+}
+
+static int push_face(FaceScratch *scratch, Command *command, const tinyobj_vertex_index_t *vi,
+                     size_t count) {
+  size_t k;
+  while (command->num_f + count > scratch->cap_f) {
+    if (!grow_scratch(scratch->arena, (void **)&scratch->f, sizeof(tinyobj_vertex_index_t),
+                      &scratch->cap_f, command->num_f)) return 0;
+  }
+  if (command->num_f_num_verts == scratch->cap_f_num_verts) {
+    if (!grow_scratch(scratch->arena, (void **)&scratch->f_num_verts, sizeof(int),
+                      &scratch->cap_f_num_verts, command->num_f_num_verts)) return 0;
+  }
+  for (k = 0; k < count; k++) {
+    scratch->f[command->num_f + k] = vi[k];
+  }
+  command->num_f += count;
+  scratch->f_num_verts[command->num_f_num_verts] = (int)count;
+  command->num_f_num_verts++;
+  return 1;
+}
+
+/* Tokenizes the line in place: p[p_len] is the line ending (or the
+ * terminating NUL of the buffer), which every tokenizer stops at. Face
+ * indices go to scratch and stay valid until the next call. Returns 1 for a
+ * command, 0 for a line without one and -1 if scratch could not grow. */
+static int parseLine(Command *command, const char *p, size_t p_len,
+                     int triangulate, FaceScratch *scratch) {
+  const char *token = p;
+  const char *line_end = p + p_len;
 
   command->type = COMMAND_EMPTY;
 
@@ -1159,7 +1750,7 @@ static int parseLine(Command *command, const char *p, size_t p_len,
   skip_space(&token);
 
   assert(token);
-  if (token[0] == '\0') { /* empty line */
+  if (token >= line_end || IS_NEW_LINE(token[0])) { /* empty line */
     return 0;
   }
 
@@ -1172,9 +1763,9 @@ static int parseLine(Command *command, const char *p, size_t p_len,
     float x, y, z;
     token += 2;
     parseFloat3(&x, &y, &z, &token);
-    command->vx = x;
-    command->vy = y;
-    command->vz = z;
+    command->x = x;
+    command->y = y;
+    command->z = z;
     command->type = COMMAND_V;
     return 1;
   }
@@ -1184,9 +1775,9 @@ static int parseLine(Command *command, const char *p, size_t p_len,
     float x, y, z;
     token += 3;
     parseFloat3(&x, &y, &z, &token);
-    command->nx = x;
-    command->ny = y;
-    command->nz = z;
+    command->x = x;
+    command->y = y;
+    command->z = z;
     command->type = COMMAND_VN;
     return 1;
   }
@@ -1196,8 +1787,8 @@ static int parseLine(Command *command, const char *p, size_t p_len,
     float x, y;
     token += 3;
     parseFloat2(&x, &y, &token);
-    command->tx = x;
-    command->ty = y;
+    command->x = x;
+    command->y = y;
     command->type = COMMAND_VT;
     return 1;
   }
@@ -1205,7 +1796,7 @@ static int parseLine(Command *command, const char *p, size_t p_len,
   /* line */
   if (token[0] == 'l' && IS_SPACE((token[1]))) {
     size_t num_f = 0;
-    
+
     tinyobj_vertex_index_t f[2];
     token += 2;
     skip_space(&token);
@@ -1214,17 +1805,17 @@ static int parseLine(Command *command, const char *p, size_t p_len,
       tinyobj_vertex_index_t vi = parseRawTriple(&token);
       skip_space_and_cr(&token);
 
-      f[num_f] = vi;
+      if (num_f < 2) f[num_f] = vi;
       num_f++;
     }
 
     assert(num_f == 2);
+    command->num_f = 0;
+    command->num_f_num_verts = 0;
+    if (!push_face(scratch, command, f, 2)) return -1;
     command->type = COMMAND_F;
-    command->f[0] = f[0];
-    command->f[1] = f[1];
-    command->num_f = 2;
-    command->f_num_verts[0] = (int)num_f;
-    command->num_f_num_verts = 1;
+    command->f = scratch->f;
+    command->f_num_verts = scratch->f_num_verts;
 
     return 1;
   }
@@ -1232,56 +1823,59 @@ static int parseLine(Command *command, const char *p, size_t p_len,
   /* face */
   if (token[0] == 'f' && IS_SPACE((token[1]))) {
     size_t num_f = 0;
+    tinyobj_vertex_index_t tri[3];
+    int ok = 1;
 
-    tinyobj_vertex_index_t f[TINYOBJ_MAX_FACES_PER_F_LINE];
     token += 2;
     skip_space(&token);
 
-    while (!IS_NEW_LINE(token[0])) {
+    /* Triangles are emitted as the fan's vertices are read, so the line is
+     * never staged in a fixed size buffer. */
+    command->num_f = 0;
+    command->num_f_num_verts = 0;
+
+    while (ok && !IS_NEW_LINE(token[0])) {
       tinyobj_vertex_index_t vi = parseRawTriple(&token);
       skip_space_and_cr(&token);
 
-      f[num_f] = vi;
+      if (triangulate) {
+        if (num_f < 2) {
+          tri[num_f] = vi;
+        } else {
+          tri[2] = vi;
+          ok = push_face(scratch, command, tri, 3);
+          tri[1] = vi;
+        }
+      } else {
+        if (num_f == scratch->cap_f) {
+          ok = grow_scratch(scratch->arena, (void **)&scratch->f, sizeof(tinyobj_vertex_index_t),
+                            &scratch->cap_f, num_f);
+        }
+        if (ok) scratch->f[num_f] = vi;
+      }
       num_f++;
     }
 
-    command->type = COMMAND_F;
-
-    if (triangulate) {
-      size_t k;
-      size_t n = 0;
-
-      tinyobj_vertex_index_t i0 = f[0];
-      tinyobj_vertex_index_t i1;
-      tinyobj_vertex_index_t i2 = f[1];
-
-      assert(3 * num_f < TINYOBJ_MAX_FACES_PER_F_LINE);
-
-      for (k = 2; k < num_f; k++) {
-        i1 = i2;
-        i2 = f[k];
-        command->f[3 * n + 0] = i0;
-        command->f[3 * n + 1] = i1;
-        command->f[3 * n + 2] = i2;
-
-        command->f_num_verts[n] = 3;
-        n++;
+    if (ok && !triangulate) {
+      command->num_f = 0;
+      command->num_f_num_verts = 0;
+      if (scratch->cap_f_num_verts == 0) {
+        ok = grow_scratch(scratch->arena, (void **)&scratch->f_num_verts, sizeof(int),
+                          &scratch->cap_f_num_verts, 0);
       }
-      command->num_f = 3 * n;
-      command->num_f_num_verts = n;
-
-    } else {
-      size_t k = 0;
-      assert(num_f < TINYOBJ_MAX_FACES_PER_F_LINE);
-      for (k = 0; k < num_f; k++) {
-        command->f[k] = f[k];
+      if (ok) {
+        command->num_f = num_f;
+        scratch->f_num_verts[0] = (int)num_f;
+        command->num_f_num_verts = 1;
       }
-
-      command->num_f = num_f;
-      command->f_num_verts[0] = (int)num_f;
-      command->num_f_num_verts = 1;
     }
 
+    if (!ok) return -1;
+
+    command->type = COMMAND_F;
+    command->f = scratch->f;
+    command->f_num_verts = scratch->f_num_verts;
+
     return 1;
   }
 
@@ -1290,9 +1884,8 @@ static int parseLine(Command *command, const char *p, size_t p_len,
     token += 7;
 
     skip_space(&token);
-    command->material_name = p + (token - linebuf);
-    command->material_name_len = (unsigned int)length_until_newline(
-                                                                    token, (p_len - (size_t)(token - linebuf)) + 1);
+    command->name = token;
+    command->name_len = (unsigned int)length_until_line_end(token, line_end);
     command->type = COMMAND_USEMTL;
 
     return 1;
@@ -1304,9 +1897,8 @@ static int parseLine(Command *command, const char *p, size_t p_len,
     token += 7;
 
     skip_space(&token);
-    command->mtllib_name = p + (token - linebuf);
-    command->mtllib_name_len = (unsigned int)length_until_newline(
-                                                                  token, (p_len - (size_t)(token - linebuf)) + 1);
+    command->name = token;
+    command->name_len = (unsigned int)length_until_line_end(token, line_end);
     command->type = COMMAND_MTLLIB;
 
     return 1;
@@ -1317,9 +1909,8 @@ static int parseLine(Command *command, const char *p, size_t p_len,
     /* @todo { multiple group name. } */
     token += 2;
 
-    command->group_name = p + (token - linebuf);
-    command->group_name_len = (unsigned int)length_until_newline(
-                                                                 token, (p_len - (size_t)(token - linebuf)) + 1);
+    command->name = token;
+    command->name_len = (unsigned int)length_until_line_end(token, line_end);
     command->type = COMMAND_G;
 
     return 1;
@@ -1330,9 +1921,8 @@ static int parseLine(Command *command, const char *p, size_t p_len,
     /* @todo { multiple object name? } */
     token += 2;
 
-    command->object_name = p + (token - linebuf);
-    command->object_name_len = (unsigned int)length_until_newline(
-                                                                  token, (p_len - (size_t)(token - linebuf)) + 1);
+    command->name = token;
+    command->name_len = (unsigned int)length_until_line_end(token, line_end);
     command->type = COMMAND_O;
 
     return 1;
@@ -1341,6 +1931,211 @@ static int parseLine(Command *command, const char *p, size_t p_len,
   return 0;
 }
 
+/* Line range of the obj parsed by one thread, with the per-range counts
+ * from the parse phase and the starting offsets for the construct phase. */
+typedef struct {
+  const char *buf;
+  const LineInfo *line_infos;
+  size_t line_begin;
+  size_t line_end;
+  int triangulate;
+
+  /* Records and scratch of this range; merged into the parse arena after. */
+  tinyobj_arena_t arena;
+  CommandStream stream;
+  int failed;
+
+  size_t num_v;
+  size_t num_vn;
+  size_t num_vt;
+  size_t num_f;
+  size_t num_faces;
+  size_t num_shape_commands;
+  const unsigned int *mtllib;
+  const unsigned int *last_usemtl;
+
+  tinyobj_attrib_t *attrib;
+  hash_table_t *material_table;
+  size_t v_begin;
+  size_t vn_begin;
+  size_t vt_begin;
+  size_t f_begin;
+  size_t face_begin;
+  int material_id_begin;
+} ParseShard;
+
+static void *parse_shard_worker(void *arg) {
+  ParseShard *shard = (ParseShard *)arg;
+  FaceScratch scratch;
+  Command command;
+  size_t i;
+
+  shard->stream.arena = &shard->arena;
+  shard->stream.head = NULL;
+  shard->stream.tail = NULL;
+  shard->failed = 0;
+  shard->num_v = 0;
+  shard->num_vn = 0;
+  shard->num_vt = 0;
+  shard->num_f = 0;
+  shard->num_faces = 0;
+  shard->num_shape_commands = 0;
+  shard->mtllib = NULL;
+  shard->last_usemtl = NULL;
+
+  scratch.arena = &shard->arena;
+  scratch.f = NULL;
+  scratch.cap_f = 0;
+  scratch.f_num_verts = NULL;
+  scratch.cap_f_num_verts = 0;
+
+  for (i = shard->line_begin; i < shard->line_end && !shard->failed; i++) {
+    int ret = parseLine(&command, &shard->buf[shard->line_infos[i].pos],
+                        shard->line_infos[i].len, shard->triangulate, &scratch);
+    if (ret < 0) {
+      shard->failed = 1;
+    } else if (ret) {
+      const unsigned int *record = append_command(&shard->stream, &command, &shard->failed);
+      if (command.type == COMMAND_V) {
+        shard->num_v++;
+      } else if (command.type == COMMAND_VN) {
+        shard->num_vn++;
+      } else if (command.type == COMMAND_VT) {
+        shard->num_vt++;
+      } else if (command.type == COMMAND_F) {
+        shard->num_f += command.num_f;
+        shard->num_faces += command.num_f_num_verts;
+      } else if (command.type == COMMAND_USEMTL) {
+        if (command.name && command.name_len > 0) {
+          shard->last_usemtl = record;
+        }
+      } else if (command.type == COMMAND_G || command.type == COMMAND_O) {
+        shard->num_shape_commands++;
+      }
+
+      if (command.type == COMMAND_MTLLIB) {
+        shard->mtllib = record;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+static int resolve_material_id(const Command *command, hash_table_t *material_table,
+                               int current_material_id) {
+  int material_id = current_material_id;
+  if (command->name && command->name_len > 0) {
+    /* Hashed in place, the name is not NUL terminated in the buffer. */
+    hash_table_entry_t *entry = hash_table_find(
+        hash_djb2_len((const unsigned char *)command->name, command->name_len), material_table);
+    material_id = entry ? (int)entry->value : -1;
+  }
+  return material_id;
+}
+
+static void *construct_shard_worker(void *arg) {
+  ParseShard *shard = (ParseShard *)arg;
+  tinyobj_attrib_t *attrib = shard->attrib;
+  size_t v_count = shard->v_begin;
+  size_t n_count = shard->vn_begin;
+  size_t t_count = shard->vt_begin;
+  size_t f_count = shard->f_begin;
+  size_t face_count = shard->face_begin;
+  int material_id = shard->material_id_begin;
+  CommandCursor cursor;
+  Command command;
+
+  command_cursor_init(&cursor, &shard->stream);
+  while (next_command(&cursor, &command)) {
+    if (command.type == COMMAND_USEMTL) {
+      material_id = resolve_material_id(&command, shard->material_table, material_id);
+    } else if (command.type == COMMAND_V) {
+      attrib->vertices[3 * v_count + 0] = command.x;
+      attrib->vertices[3 * v_count + 1] = command.y;
+      attrib->vertices[3 * v_count + 2] = command.z;
+      v_count++;
+    } else if (command.type == COMMAND_VN) {
+      attrib->normals[3 * n_count + 0] = command.x;
+      attrib->normals[3 * n_count + 1] = command.y;
+      attrib->normals[3 * n_count + 2] = command.z;
+      n_count++;
+    } else if (command.type == COMMAND_VT) {
+      attrib->texcoords[2 * t_count + 0] = command.x;
+      attrib->texcoords[2 * t_count + 1] = command.y;
+      t_count++;
+    } else if (command.type == COMMAND_F) {
+      size_t k = 0;
+      for (k = 0; k < command.num_f; k++) {
+        tinyobj_vertex_index_t vi = command.f[k];
+        int v_idx = fixIndex(vi.v_idx, v_count);
+        int vn_idx = fixIndex(vi.vn_idx, n_count);
+        int vt_idx = fixIndex(vi.vt_idx, t_count);
+        attrib->faces[f_count + k].v_idx = v_idx;
+        attrib->faces[f_count + k].vn_idx = vn_idx;
+        attrib->faces[f_count + k].vt_idx = vt_idx;
+      }
+
+      for (k = 0; k < command.num_f_num_verts; k++) {
+        attrib->material_ids[face_count + k] = material_id;
+        attrib->face_num_verts[face_count + k] = command.f_num_verts[k];
+      }
+
+      f_count += command.num_f;
+      face_count += command.num_f_num_verts;
+    }
+  }
+
+  return NULL;
+}
+
+static size_t choose_num_shards(size_t num_lines, unsigned int flags) {
+#ifdef TINYOBJ_NO_THREADS
+  (void)num_lines;
+  (void)flags;
+  return 1;
+#else
+  long num_cpus;
+  size_t num_shards;
+
+  if (!(flags & TINYOBJ_FLAG_PARALLEL)) return 1;
+
+  num_cpus = TINYOBJ_ONLINE_CPUS();
+  num_shards = num_lines / TINYOBJ_MIN_LINES_PER_THREAD;
+  if (num_cpus > 0 && num_shards > (size_t)num_cpus) num_shards = (size_t)num_cpus;
+  if (num_shards > TINYOBJ_MAX_THREADS) num_shards = TINYOBJ_MAX_THREADS;
+  if (num_shards < 1) num_shards = 1;
+  return num_shards;
+#endif
+}
+
+/* Runs shard 0 on the calling thread and the rest on worker threads. A
+ * shard whose thread fails to start is run inline instead. */
+static void run_shards(ParseShard *shards, size_t num_shards, void *(*worker)(void *)) {
+#ifdef TINYOBJ_NO_THREADS
+  size_t s;
+  for (s = 0; s < num_shards; s++) {
+    worker(&shards[s]);
+  }
+#else
+  pthread_t threads[TINYOBJ_MAX_THREADS];
+  int started[TINYOBJ_MAX_THREADS];
+  size_t s;
+
+  for (s = 1; s < num_shards; s++) {
+    started[s] = pthread_create(&threads[s], NULL, worker, &shards[s]) == 0;
+  }
+  worker(&shards[0]);
+  for (s = 1; s < num_shards; s++) {
+    if (started[s]) {
+      pthread_join(threads[s], NULL);
+    } else {
+      worker(&shards[s]);
+    }
+  }
+#endif
+}
+
 static size_t basename_len(const char *filename, size_t filename_length) {
   /* Count includes NUL terminator. */
   const char *p = &filename[filename_length - 1];
@@ -1389,6 +2184,7 @@ static char *generate_mtl_filename(const char *obj_filename,
   obj_basename_length = basename_len(obj_filename, obj_filename_length);
   mtl_filename_length = (obj_filename_length - obj_basename_length) + mtllib_name_length;
   mtl_filename = (char *)TINYOBJ_MALLOC(mtl_filename_length);
+  if (mtl_filename == NULL) return NULL;
 
   /* Copy over the obj's path */
   memcpy(mtl_filename, obj_filename, (obj_filename_length - obj_basename_length));
@@ -1399,13 +2195,26 @@ static char *generate_mtl_filename(const char *obj_filename,
   return mtl_filename;
 }
 
-int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
-                      size_t *num_shapes, tinyobj_material_t **materials_out,
-                      size_t *num_materials_out, const char *obj_filename,
-                      file_reader_callback file_reader, void *ctx,
-                      unsigned int flags) {
+static void free_shards(ParseShard *shards, size_t num_shards, tinyobj_arena_t *parse_arena) {
+  size_t s;
+  for (s = 0; s < num_shards; s++) {
+    tinyobj_arena_free(&shards[s].arena);
+  }
+  tinyobj_arena_free(parse_arena);
+}
+
+/* Heap allocation when arena is NULL, for the classic API. */
+static void *attrib_alloc(tinyobj_arena_t *arena, size_t size) {
+  if (arena) return tinyobj_arena_alloc(arena, size);
+  return TINYOBJ_MALLOC(size);
+}
+
+static int parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
+                     size_t *num_shapes, tinyobj_material_t **materials_out,
+                     size_t *num_materials_out, const char *obj_filename,
+                     file_reader_callback file_reader, void *ctx,
+                     unsigned int flags, tinyobj_arena_t *attrib_arena) {
   LineInfo *line_infos = NULL;
-  Command *commands = NULL;
   size_t num_lines = 0;
 
   size_t num_v = 0;
@@ -1413,12 +2222,21 @@ int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
   size_t num_vt = 0;
   size_t num_f = 0;
   size_t num_faces = 0;
+  size_t num_shape_commands = 0;
+
+  ParseShard shards[TINYOBJ_MAX_THREADS];
+  size_t num_shards = 1;
+  size_t s = 0;
+  int failed = 0;
+  int ret = 0;
 
-  int mtllib_line_index = -1;
+  const unsigned int *mtllib = NULL;
 
   tinyobj_material_t *materials = NULL;
   size_t num_materials = 0;
 
+  /* Intermediates (command records, material table), released in one go. */
+  tinyobj_arena_t parse_arena;
   hash_table_t material_table;
 
   char *buf = NULL;
@@ -1436,37 +2254,44 @@ int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
   tinyobj_attrib_init(attrib);
 
   /* 1. create line data */
-  if (get_line_infos(buf, len, &line_infos, &num_lines) != 0) {
-    return TINYOBJ_ERROR_EMPTY;
+  ret = get_line_infos(buf, len, &line_infos, &num_lines);
+  if (ret != 0) {
+    return ret;
   }
 
-  commands = (Command *)TINYOBJ_MALLOC(sizeof(Command) * num_lines);
+  tinyobj_arena_init(&parse_arena, 0);
+  if (create_hash_table(HASH_TABLE_DEFAULT_SIZE, &material_table, &parse_arena) != HASH_TABLE_SUCCESS) {
+    TINYOBJ_FREE(line_infos);
+    tinyobj_arena_free(&parse_arena);
+    return TINYOBJ_ERROR_OUT_OF_MEMORY;
+  }
 
-  create_hash_table(HASH_TABLE_DEFAULT_SIZE, &material_table);
+  num_shards = choose_num_shards(num_lines, flags);
+  for (s = 0; s < num_shards; s++) {
+    shards[s].buf = buf;
+    shards[s].line_infos = line_infos;
+    shards[s].line_begin = num_lines * s / num_shards;
+    shards[s].line_end = num_lines * (s + 1) / num_shards;
+    shards[s].triangulate = (int)(flags & TINYOBJ_FLAG_TRIANGULATE);
+    shards[s].attrib = attrib;
+    shards[s].material_table = &material_table;
+    tinyobj_arena_init(&shards[s].arena, 0);
+  }
 
   /* 2. parse each line */
-  {
-    size_t i = 0;
-    for (i = 0; i < num_lines; i++) {
-      int ret = parseLine(&commands[i], &buf[line_infos[i].pos],
-                          line_infos[i].len, flags & TINYOBJ_FLAG_TRIANGULATE);
-      if (ret) {
-        if (commands[i].type == COMMAND_V) {
-          num_v++;
-        } else if (commands[i].type == COMMAND_VN) {
-          num_vn++;
-        } else if (commands[i].type == COMMAND_VT) {
-          num_vt++;
-        } else if (commands[i].type == COMMAND_F) {
-          num_f += commands[i].num_f;
-          num_faces += commands[i].num_f_num_verts;
-        }
-
-        if (commands[i].type == COMMAND_MTLLIB) {
-          mtllib_line_index = (int)i;
-        }
-      }
+  run_shards(shards, num_shards, parse_shard_worker);
+
+  for (s = 0; s < num_shards; s++) {
+    num_v += shards[s].num_v;
+    num_vn += shards[s].num_vn;
+    num_vt += shards[s].num_vt;
+    num_f += shards[s].num_f;
+    num_faces += shards[s].num_faces;
+    num_shape_commands += shards[s].num_shape_commands;
+    if (shards[s].mtllib) {
+      mtllib = shards[s].mtllib;
     }
+    failed |= shards[s].failed;
   }
 
   /* line_infos are not used anymore. Release memory. */
@@ -1474,42 +2299,85 @@ int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
     TINYOBJ_FREE(line_infos);
   }
 
+  if (failed) {
+    free_shards(shards, num_shards, &parse_arena);
+    return TINYOBJ_ERROR_OUT_OF_MEMORY;
+  }
+
   /* Load material (if it exists) */
-  if (mtllib_line_index >= 0 && commands[mtllib_line_index].mtllib_name &&
-      commands[mtllib_line_index].mtllib_name_len > 0) {
-    /* Maximum length allowed by Linux - higher than Windows and macOS */
-    size_t obj_filename_len = my_strnlen(obj_filename, 4096 + 255) + 1;
-    char *mtl_filename;
-    char *mtllib_name;
-    size_t mtllib_name_len = 0;
-    int ret;
-
-    mtllib_name_len = length_until_line_feed(commands[mtllib_line_index].mtllib_name,
-                                             commands[mtllib_line_index].mtllib_name_len);
-
-    mtllib_name = my_strndup(commands[mtllib_line_index].mtllib_name,
-                             mtllib_name_len);
-
-    /* allow for NUL terminator */
-    mtllib_name_len++;
-    mtl_filename = generate_mtl_filename(obj_filename, obj_filename_len,
-                                         mtllib_name, mtllib_name_len);
-
-    ret = tinyobj_parse_and_index_mtl_file(&materials, &num_materials,
-                                           mtl_filename, obj_filename,
-                                           file_reader, ctx,
-                                           &material_table);
-
-    if (ret != TINYOBJ_SUCCESS) {
-      /* warning. */
-      fprintf(stderr, "TINYOBJ: Failed to parse material file '%s': %d\n", mtl_filename, ret);
+  if (mtllib) {
+    Command mtllib_command;
+    decode_command(mtllib, &mtllib_command);
+    if (mtllib_command.name && mtllib_command.name_len > 0) {
+      /* Maximum length allowed by Linux - higher than Windows and macOS */
+      size_t obj_filename_len = my_strnlen(obj_filename, 4096 + 255) + 1;
+      char *mtl_filename;
+      char *mtllib_name;
+      size_t mtllib_name_len = 0;
+
+      mtllib_name_len = length_until_line_feed(mtllib_command.name, mtllib_command.name_len);
+
+      mtllib_name = my_strndup(mtllib_command.name, mtllib_name_len);
+
+      /* allow for NUL terminator */
+      mtllib_name_len++;
+      mtl_filename = mtllib_name ? generate_mtl_filename(obj_filename, obj_filename_len,
+                                                         mtllib_name, mtllib_name_len) : NULL;
+
+      if (mtl_filename == NULL) {
+        ret = TINYOBJ_ERROR_OUT_OF_MEMORY;
+      } else {
+        ret = tinyobj_parse_and_index_mtl_file(&materials, &num_materials,
+                                               mtl_filename, obj_filename,
+                                               file_reader, ctx,
+                                               &material_table);
+
+        if (ret != TINYOBJ_SUCCESS && ret != TINYOBJ_ERROR_OUT_OF_MEMORY) {
+          /* warning. */
+          fprintf(stderr, "TINYOBJ: Failed to parse material file '%s': %d\n", mtl_filename, ret);
+        }
+        TINYOBJ_FREE(mtl_filename);
+      }
+      if (mtllib_name) TINYOBJ_FREE(mtllib_name);
+      /* a missing or broken mtl is only a warning, running out of memory is not */
+      if (ret == TINYOBJ_ERROR_OUT_OF_MEMORY) {
+        free_shards(shards, num_shards, &parse_arena);
+        return TINYOBJ_ERROR_OUT_OF_MEMORY;
+      }
     }
-    TINYOBJ_FREE(mtl_filename);
-    TINYOBJ_FREE(mtllib_name);
   }
 
   /* Construct attributes */
 
+  attrib->vertices = (float *)attrib_alloc(attrib_arena, sizeof(float) * num_v * 3);
+  attrib->num_vertices = (unsigned int)num_v;
+  attrib->normals = (float *)attrib_alloc(attrib_arena, sizeof(float) * num_vn * 3);
+  attrib->num_normals = (unsigned int)num_vn;
+  attrib->texcoords = (float *)attrib_alloc(attrib_arena, sizeof(float) * num_vt * 2);
+  attrib->num_texcoords = (unsigned int)num_vt;
+  attrib->faces = (tinyobj_vertex_index_t *)attrib_alloc(attrib_arena,
+                                                     sizeof(tinyobj_vertex_index_t) * num_f);
+  attrib->num_faces = (unsigned int)num_f;
+  attrib->face_num_verts = (int *)attrib_alloc(attrib_arena, sizeof(int) * num_faces);
+  attrib->material_ids = (int *)attrib_alloc(attrib_arena, sizeof(int) * num_faces);
+  attrib->num_face_num_verts = (unsigned int)num_faces;
+
+  /* The heap can hand back NULL for an empty array, only a non-empty one
+   * without storage is a failure. */
+  if ((num_v && attrib->vertices == NULL) || (num_vn && attrib->normals == NULL) ||
+      (num_vt && attrib->texcoords == NULL) || (num_f && attrib->faces == NULL) ||
+      (num_faces && (attrib->face_num_verts == NULL || attrib->material_ids == NULL))) {
+    /* arena allocations go with the caller's arena */
+    if (attrib_arena == NULL) tinyobj_attrib_free(attrib);
+    tinyobj_attrib_init(attrib);
+    tinyobj_materials_free(materials, num_materials);
+    free_shards(shards, num_shards, &parse_arena);
+    return TINYOBJ_ERROR_OUT_OF_MEMORY;
+  }
+
+  /* Prefix sums give each shard the counts the serial parse would have
+   * reached at its first line, so relative indices and the active
+   * material resolve exactly as if the lines were processed in order. */
   {
     size_t v_count = 0;
     size_t n_count = 0;
@@ -1517,97 +2385,37 @@ int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
     size_t f_count = 0;
     size_t face_count = 0;
     int material_id = -1; /* -1 = default unknown material. */
-    size_t i = 0;
-
-    attrib->vertices = (float *)TINYOBJ_MALLOC(sizeof(float) * num_v * 3);
-    attrib->num_vertices = (unsigned int)num_v;
-    attrib->normals = (float *)TINYOBJ_MALLOC(sizeof(float) * num_vn * 3);
-    attrib->num_normals = (unsigned int)num_vn;
-    attrib->texcoords = (float *)TINYOBJ_MALLOC(sizeof(float) * num_vt * 2);
-    attrib->num_texcoords = (unsigned int)num_vt;
-    attrib->faces = (tinyobj_vertex_index_t *)TINYOBJ_MALLOC(
-                                                     sizeof(tinyobj_vertex_index_t) * num_f);
-    attrib->num_faces = (unsigned int)num_f;
-    attrib->face_num_verts = (int *)TINYOBJ_MALLOC(sizeof(int) * num_faces);
-    attrib->material_ids = (int *)TINYOBJ_MALLOC(sizeof(int) * num_faces);
-    attrib->num_face_num_verts = (unsigned int)num_faces;
-
-    for (i = 0; i < num_lines; i++) {
-      if (commands[i].type == COMMAND_EMPTY) {
-        continue;
-      } else if (commands[i].type == COMMAND_USEMTL) {
-        /* @todo
-           if (commands[t][i].material_name &&
-           commands[t][i].material_name_len > 0) {
-           std::string material_name(commands[t][i].material_name,
-           commands[t][i].material_name_len);
-
-           if (material_map.find(material_name) != material_map.end()) {
-           material_id = material_map[material_name];
-           } else {
-        // Assign invalid material ID
-        material_id = -1;
-        }
-        }
-        */
-        if (commands[i].material_name &&
-           commands[i].material_name_len >0)
-        {
-          /* Create a null terminated string */
-          char* material_name_null_term = (char*) TINYOBJ_MALLOC(commands[i].material_name_len + 1);
-          memcpy((void*) material_name_null_term, (const void*) commands[i].material_name, commands[i].material_name_len);
-          material_name_null_term[commands[i].material_name_len] = 0;
-
-          if (hash_table_exists(material_name_null_term, &material_table))
-            material_id = (int)hash_table_get(material_name_null_term, &material_table);
-          else
-            material_id = -1;
-
-          TINYOBJ_FREE(material_name_null_term);
-        }
-      } else if (commands[i].type == COMMAND_V) {
-        attrib->vertices[3 * v_count + 0] = commands[i].vx;
-        attrib->vertices[3 * v_count + 1] = commands[i].vy;
-        attrib->vertices[3 * v_count + 2] = commands[i].vz;
-        v_count++;
-      } else if (commands[i].type == COMMAND_VN) {
-        attrib->normals[3 * n_count + 0] = commands[i].nx;
-        attrib->normals[3 * n_count + 1] = commands[i].ny;
-        attrib->normals[3 * n_count + 2] = commands[i].nz;
-        n_count++;
-      } else if (commands[i].type == COMMAND_VT) {
-        attrib->texcoords[2 * t_count + 0] = commands[i].tx;
-        attrib->texcoords[2 * t_count + 1] = commands[i].ty;
-        t_count++;
-      } else if (commands[i].type == COMMAND_F) {
-        size_t k = 0;
-        for (k = 0; k < commands[i].num_f; k++) {
-          tinyobj_vertex_index_t vi = commands[i].f[k];
-          int v_idx = fixIndex(vi.v_idx, v_count);
-          int vn_idx = fixIndex(vi.vn_idx, n_count);
-          int vt_idx = fixIndex(vi.vt_idx, t_count);
-          attrib->faces[f_count + k].v_idx = v_idx;
-          attrib->faces[f_count + k].vn_idx = vn_idx;
-          attrib->faces[f_count + k].vt_idx = vt_idx;
-        }
 
-        for (k = 0; k < commands[i].num_f_num_verts; k++) {
-          attrib->material_ids[face_count + k] = material_id;
-          attrib->face_num_verts[face_count + k] = commands[i].f_num_verts[k];
-        }
-
-        f_count += commands[i].num_f;
-        face_count += commands[i].num_f_num_verts;
+    for (s = 0; s < num_shards; s++) {
+      shards[s].v_begin = v_count;
+      shards[s].vn_begin = n_count;
+      shards[s].vt_begin = t_count;
+      shards[s].f_begin = f_count;
+      shards[s].face_begin = face_count;
+      shards[s].material_id_begin = material_id;
+
+      v_count += shards[s].num_v;
+      n_count += shards[s].num_vn;
+      t_count += shards[s].num_vt;
+      f_count += shards[s].num_f;
+      face_count += shards[s].num_faces;
+      if (shards[s].last_usemtl) {
+        Command usemtl;
+        decode_command(shards[s].last_usemtl, &usemtl);
+        material_id = resolve_material_id(&usemtl, &material_table, material_id);
       }
     }
   }
 
+  run_shards(shards, num_shards, construct_shard_worker);
+
   /* 5. Construct shape information. */
   {
     unsigned int face_count = 0;
-    size_t i = 0;
-    size_t n = 0;
+    size_t n = num_shape_commands;
     size_t shape_idx = 0;
+    CommandCursor cursor;
+    Command command;
 
     const char *shape_name = NULL;
     unsigned int shape_name_len = 0;
@@ -1617,27 +2425,24 @@ int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
     unsigned int prev_face_offset = 0;
     tinyobj_shape_t prev_shape = {NULL, 0, 0};
 
-    /* Find the number of shapes in .obj */
-    for (i = 0; i < num_lines; i++) {
-      if (commands[i].type == COMMAND_O || commands[i].type == COMMAND_G) {
-        n++;
-      }
-    }
-
     /* Allocate array of shapes with maximum possible size(+1 for unnamed
      * group/object).
      * Actual # of shapes found in .obj is determined in the later */
     (*shapes) = (tinyobj_shape_t*)TINYOBJ_MALLOC(sizeof(tinyobj_shape_t) * (n + 1));
+    if (*shapes == NULL) {
+      if (attrib_arena == NULL) tinyobj_attrib_free(attrib);
+      tinyobj_attrib_init(attrib);
+      tinyobj_materials_free(materials, num_materials);
+      free_shards(shards, num_shards, &parse_arena);
+      return TINYOBJ_ERROR_OUT_OF_MEMORY;
+    }
 
-    for (i = 0; i < num_lines; i++) {
-      if (commands[i].type == COMMAND_O || commands[i].type == COMMAND_G) {
-        if (commands[i].type == COMMAND_O) {
-          shape_name = commands[i].object_name;
-          shape_name_len = commands[i].object_name_len;
-        } else {
-          shape_name = commands[i].group_name;
-          shape_name_len = commands[i].group_name_len;
-        }
+    for (s = 0; s < num_shards; s++) {
+     command_cursor_init(&cursor, &shards[s].stream);
+     while (next_command(&cursor, &command)) {
+      if (command.type == COMMAND_O || command.type == COMMAND_G) {
+        shape_name = command.name;
+        shape_name_len = command.name_len;
 
         if (face_count == 0) {
           /* 'o' or 'g' appears before any 'f' */
@@ -1673,9 +2478,10 @@ int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
           prev_shape_face_offset = face_count;
         }
       }
-      if (commands[i].type == COMMAND_F) {
+      if (command.type == COMMAND_F) {
         face_count++;
       }
+     }
     }
 
     if ((face_count - prev_face_offset) > 0) {
@@ -1695,11 +2501,11 @@ int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
     (*num_shapes) = shape_idx;
   }
 
-  if (commands) {
-    TINYOBJ_FREE(commands);
-  }
-
   destroy_hash_table(&material_table);
+  for (s = 0; s < num_shards; s++) {
+    arena_absorb(&parse_arena, &shards[s].arena);
+  }
+  tinyobj_arena_free(&parse_arena);
 
   (*materials_out) = materials;
   (*num_materials_out) = num_materials;
@@ -1707,6 +2513,25 @@ int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
   return TINYOBJ_SUCCESS;
 }
 
+int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
+                      size_t *num_shapes, tinyobj_material_t **materials_out,
+                      size_t *num_materials_out, const char *obj_filename,
+                      file_reader_callback file_reader, void *ctx,
+                      unsigned int flags) {
+  return parse_obj(attrib, shapes, num_shapes, materials_out, num_materials_out,
+                   obj_filename, file_reader, ctx, flags, NULL);
+}
+
+int tinyobj_parse_obj_arena(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
+                            size_t *num_shapes, tinyobj_material_t **materials_out,
+                            size_t *num_materials_out, const char *obj_filename,
+                            file_reader_callback file_reader, void *ctx,
+                            unsigned int flags, tinyobj_arena_t *arena) {
+  if (arena == NULL) return TINYOBJ_ERROR_INVALID_PARAMETER;
+  return parse_obj(attrib, shapes, num_shapes, materials_out, num_materials_out,
+                   obj_filename, file_reader, ctx, flags, arena);
+}
+
 void tinyobj_attrib_init(tinyobj_attrib_t *attrib) {
   attrib->vertices = NULL;
   attrib->num_vertices = 0;
@@ -1747,16 +2572,7 @@ void tinyobj_materials_free(tinyobj_material_t *materials,
   if (materials == NULL) return;
 
   for (i = 0; i < num_materials; i++) {
-    if (materials[i].name) TINYOBJ_FREE(materials[i].name);
-    if (materials[i].ambient_texname) TINYOBJ_FREE(materials[i].ambient_texname);
-    if (materials[i].diffuse_texname) TINYOBJ_FREE(materials[i].diffuse_texname);
-    if (materials[i].specular_texname) TINYOBJ_FREE(materials[i].specular_texname);
-    if (materials[i].specular_highlight_texname)
-      TINYOBJ_FREE(materials[i].specular_highlight_texname);
-    if (materials[i].bump_texname) TINYOBJ_FREE(materials[i].bump_texname);
-    if (materials[i].displacement_texname)
-      TINYOBJ_FREE(materials[i].displacement_texname);
-    if (materials[i].alpha_texname) TINYOBJ_FREE(materials[i].alpha_texname);
+    free_material(&materials[i]);
   }
 
   TINYOBJ_FREE(materials);
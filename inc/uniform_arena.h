@@ -0,0 +1,39 @@
+#ifndef UNIFORM_ARENA_H
+#define UNIFORM_ARENA_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <webgpu.h>
+#include "upload_ring.h"
+
+#define UNIFORM_ARENA_INITIAL_SLOTS 64
+
+// Per frame linear allocator of fixed size uniform slots, bound through a
+// dynamic offset. The buffer holds one region per frame in flight, so a frame
+// never overwrites slots an earlier frame may still read. Slots are staged in
+// a CPU copy and uploaded with one write per frame; when a frame needs more
+// slots than a region has, the buffer is recreated twice as large and
+// generation changes, telling bind groups on it to be rebuilt.
+typedef struct UniformArena {
+    WGPUBuffer buffer;
+    size_t slot_size;
+    uint32_t slot_capacity;  // per region
+    uint32_t slot_count;     // used this frame
+    int region;
+    uint8_t *staged;
+    uint32_t staged_capacity;
+    uint32_t generation;
+} UniformArena;
+
+// slot_size must be a multiple of minUniformBufferOffsetAlignment.
+void uniform_arena_init(UniformArena *arena, WGPUDevice device, size_t slot_size);
+void uniform_arena_begin_frame(UniformArena *arena);
+// Copies size bytes into a new slot and returns its index, valid this frame.
+uint32_t uniform_arena_push(UniformArena *arena, const void *data, size_t size);
+// Grows the buffer if needed and uploads this frame's slots.
+void uniform_arena_flush(UniformArena *arena, WGPUDevice device, UploadRing *ring);
+// Dynamic offset of a slot, valid once the frame is flushed.
+uint32_t uniform_arena_offset(const UniformArena *arena, uint32_t slot);
+void uniform_arena_release(UniformArena *arena);
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef UPLOAD_RING_H
+#define UPLOAD_RING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <webgpu.h>
+
+#define UPLOAD_RING_FRAMES 3
+#define UPLOAD_RING_SIZE (4 << 20)
+// copyBufferToBuffer offsets and sizes are multiples of this
+#define UPLOAD_COPY_ALIGNMENT 4
+// bytesPerRow of copyBufferToTexture, texture rows are padded to it
+#define UPLOAD_ROW_ALIGNMENT 256
+// texels per side of a compressed block (BC, ETC2, 4x4 ASTC)
+#define UPLOAD_BLOCK_DIM 4
+
+typedef struct UploadCopy {
+    WGPUBuffer dst;
+    uint64_t dst_offset;
+    uint64_t src_offset;
+    uint64_t size;
+} UploadCopy;
+
+// Texel rows [y, y + rows) of a texture level. Staging rows are
+// bytes_per_row apart and hold a block's worth of texel rows each.
+typedef struct UploadTextureCopy {
+    WGPUTexture dst;
+    uint32_t mip_level;
+    uint32_t y;
+    uint32_t width;
+    uint32_t rows;
+    uint32_t bytes_per_row;
+    uint64_t src_offset;
+} UploadTextureCopy;
+
+typedef enum StagingState {
+    STAGING_IN_FLIGHT,  // submitted, its map has not completed yet
+    STAGING_MAPPED,     // mapped and no longer read by the GPU
+    STAGING_MAP_FAILED
+} StagingState;
+
+typedef struct UploadStats {
+    uint64_t bytes_last_frame;
+    uint64_t bytes_this_frame;
+    uint64_t submits;
+    // times a staging buffer was still in flight when it was needed again
+    uint64_t stalls;
+} UploadStats;
+
+// Staging buffers that take turns per frame in flight. Writes are copied into
+// the mapped current buffer and recorded; upload_ring_submit unmaps it,
+// issues every recorded copy in one command buffer and maps it again. That
+// map completing is the fence telling the buffer is free to reuse.
+typedef struct UploadRing {
+    WGPUInstance instance;
+    WGPUDevice device;
+    WGPUQueue queue;
+    WGPUBuffer staging[UPLOAD_RING_FRAMES];
+    StagingState state[UPLOAD_RING_FRAMES];  // written by the map callbacks
+    int current;
+    uint8_t *mapping;  // current buffer's mapped range, NULL until first write
+    size_t head;
+    UploadCopy *copies;
+    size_t copy_count;
+    size_t copy_capacity;
+    UploadTextureCopy *texture_copies;
+    size_t texture_copy_count;
+    size_t texture_copy_capacity;
+    UploadStats stats;
+} UploadRing;
+
+void upload_ring_init(UploadRing *ring, WGPUInstance instance, WGPUDevice device, WGPUQueue queue);
+// size and dst_offset must be multiples of UPLOAD_COPY_ALIGNMENT. Writes
+// larger than the space left are split across staging buffers.
+void upload_ring_write(UploadRing *ring, WGPUBuffer dst, uint64_t dst_offset, const void *data, size_t size);
+// Writes width x height texels of texel_size bytes, tightly packed in data,
+// into a level of dst, which needs CopyDst usage. Rows are padded in
+// staging and split across staging buffers when they do not fit.
+void upload_ring_write_texture(UploadRing *ring, WGPUTexture dst, uint32_t mip_level, const void *data,
+                               uint32_t width, uint32_t height, uint32_t texel_size);
+// Same for a compressed level of width x height texels, given as rows of
+// UPLOAD_BLOCK_DIM square blocks of block_size bytes, partial blocks included.
+void upload_ring_write_texture_blocks(UploadRing *ring, WGPUTexture dst, uint32_t mip_level, const void *data,
+                                      uint32_t width, uint32_t height, uint32_t block_size);
+// Submits the pending copies, if any. Runs before anything else is
+// submitted that has to see them.
+void upload_ring_submit(UploadRing *ring);
+// Submits and rolls the per frame counters.
+void upload_ring_end_frame(UploadRing *ring);
+void upload_ring_release(UploadRing *ring);
+
+#endif
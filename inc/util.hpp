@@ -4,9 +4,11 @@
 #include <webgpu.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include "file_view.h"
 
-void u_load_spirv(const char* path, uint32_t** out_data, int* out_word_count);
+void u_load_spirv(const char* path, FileView* out_view, const uint32_t** out_data, int* out_word_count);
 void u_print_adapter_info(WGPUAdapter adapter);
+bool u_adapter_has_feature(WGPUAdapter adapter, WGPUFeatureName feature);
 void u_print_device_info(WGPUDevice device);
 
 #endif
@@ -0,0 +1,32 @@
+#ifndef VERTEX_QUANT_H
+#define VERTEX_QUANT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Compact vertex, 16 bytes instead of 32:
+//   pos  unorm16x4  position within the mesh AABB, w unused
+//   norm snorm16x2  octahedral encoded normal
+//   uv   float16x2
+typedef struct QuantizedVertex {
+    uint16_t pos[4];
+    int16_t norm[2];
+    uint16_t uv[2];
+} QuantizedVertex;
+
+// Largest round trip error seen while quantizing.
+typedef struct VertexQuantError {
+    float position;    // world units
+    float normal_deg;  // angle between the normal and its decoding
+    float uv;
+} VertexQuantError;
+
+// Quantizes count interleaved pos/norm/uv float vertices. Positions decode as
+// pos_min + pos / 65535 * pos_extent per axis.
+void vertex_quantize(const float *src, size_t count, QuantizedVertex *dst,
+                     float pos_min[3], float pos_extent[3], VertexQuantError *out_error);
+
+uint16_t vertex_float_to_half(float f);
+float vertex_half_to_float(uint16_t h);
+
+#endif
@@ -1,37 +1,68 @@
 #version 450
+#extension GL_EXT_samplerless_texture_functions : require
+#extension GL_GOOGLE_include_directive : require
 
-layout(local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
 
-layout(set = 0, binding = 0) uniform sampler u_sampler;
-layout(set = 0, binding = 1) uniform texture2D u_src;
-layout(set = 0, binding = 2, rgba8) uniform writeonly image2D u_dst;
-layout(set = 0, binding = 3) uniform SrcDim {
-    int w;
-    int h;
-} u_src_dim;
+// storage format of the levels, one build per format
+#ifndef FORMAT
+#define FORMAT rgba8
+#endif
 
+// Writes up to four mip levels per dispatch. Each workgroup reduces a 16x16
+// source tile into 8x8 texels of the first level, then keeps halving that
+// tile in shared memory for the levels after it. Only the first level may
+// have an odd source, the CPU ends a dispatch before any later one would.
+layout(set = 0, binding = 0) uniform texture2D u_src;
+layout(set = 0, binding = 1, FORMAT) uniform writeonly image2D u_dst1;
+layout(set = 0, binding = 2, FORMAT) uniform writeonly image2D u_dst2;
+layout(set = 0, binding = 3, FORMAT) uniform writeonly image2D u_dst3;
+layout(set = 0, binding = 4, FORMAT) uniform writeonly image2D u_dst4;
+layout(set = 0, binding = 5) uniform Downsample {
+    ivec2 u_src_size;
+    int u_level_count;
+    int u_pad0;
+    ivec4 u_dst_size[4];  // xy
+};
+
+#include "downsample.glsl"
+
+shared vec4 s_tile[8][8];
+
+void store(int level, ivec2 pos, vec4 color) {
+    if (level == 1) imageStore(u_dst2, pos, color);
+    else if (level == 2) imageStore(u_dst3, pos, color);
+    else imageStore(u_dst4, pos, color);
+}
 
 void main() {
-    ivec2 dst_pos = ivec2(gl_GlobalInvocationID.xy);
-
-    // sample source mipmap
-    vec2 src_pos[4];
-    src_pos[0] = 2 * dst_pos;
-    src_pos[1] = ivec2(src_pos[0].x + 1, src_pos[0].y);
-    src_pos[2] = ivec2(src_pos[0].x, src_pos[0].y + 1);
-    src_pos[3] = ivec2(src_pos[0].x + 1, src_pos[0].y + 1);
-
-    ivec2 src_dim = ivec2(u_src_dim.w, u_src_dim.h);
-
-    // average samples
-    vec2 uv[4];
-    vec4 c_tot = vec4(0.0);
-    for (int i = 0; i < 4; i++) {
-        uv[i] = src_pos[i] / src_dim;
-        c_tot += texture(sampler2D(u_src, u_sampler), uv[i]);
-    }
+    ivec2 lid = ivec2(gl_LocalInvocationID.xy);
+    ivec2 group = ivec2(gl_WorkGroupID.xy);
+
+    // threads past the edge compute the edge texel again, so the tile
+    // holds clamped values for the levels that read it
+    ivec2 dst_pos = group * 8 + lid;
+    ivec2 pos = min(dst_pos, u_dst_size[0].xy - 1);
+    vec4 color = downsample(pos, u_dst_size[0].xy);
+    if (all(lessThan(dst_pos, u_dst_size[0].xy))) imageStore(u_dst1, dst_pos, color);
 
-    vec4 avg = c_tot / 4.0;
+    for (int level = 1; level < 4; level++) {
+        if (level >= u_level_count) break;
 
-    imageStore(u_dst, dst_pos, avg);
+        s_tile[lid.y][lid.x] = color;
+        memoryBarrierShared();
+        barrier();
+
+        int size = 8 >> level;
+        if (all(lessThan(lid, ivec2(size)))) {
+            dst_pos = group * size + lid;
+            pos = min(dst_pos, u_dst_size[level].xy - 1);
+            ivec2 t = pos * 2 - group * size * 2;
+            color = (s_tile[t.y][t.x] + s_tile[t.y][t.x + 1]
+                   + s_tile[t.y + 1][t.x] + s_tile[t.y + 1][t.x + 1]) * 0.25;
+            if (all(lessThan(dst_pos, u_dst_size[level].xy))) store(level, dst_pos, color);
+        }
+        memoryBarrierShared();
+        barrier();
+    }
 }
@@ -0,0 +1,100 @@
+#version 450
+#extension GL_EXT_samplerless_texture_functions : require
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// One per instance batch: the mesh's object space sphere, its indirect draw
+// records (one per submesh) and where its visible instances are packed.
+struct Group {
+    vec4 sphere;
+    uint first_draw;
+    uint draw_count;
+    uint first_instance;
+    uint pad0;
+};
+
+layout(set = 0, binding = 0) uniform Cull {
+    vec4 u_planes[6];
+    mat4 u_view_projection;  // what the Hi-Z pyramid was rendered with
+    uint u_object_count;
+    uint u_hiz_enabled;
+    uint u_hiz_mip_count;
+    uint u_pad0;
+    ivec2 u_hiz_size;
+};
+layout(std430, set = 0, binding = 1) readonly buffer Objects {
+    mat4 models[];
+};
+layout(std430, set = 0, binding = 2) readonly buffer ObjectGroups {
+    uint object_groups[];
+};
+layout(std430, set = 0, binding = 3) readonly buffer Groups {
+    Group groups[];
+};
+// DrawIndexedIndirect records, 5 uints each: index count, instance count,
+// first index, base vertex, first instance
+layout(std430, set = 0, binding = 4) buffer Draws {
+    uint draws[];
+};
+layout(std430, set = 0, binding = 5) writeonly buffer Visible {
+    mat4 visible[];
+};
+// farthest depth per texel, level 0 is the depth buffer
+layout(set = 0, binding = 6) uniform texture2D u_hiz;
+
+// Compares the nearest depth of the sphere's box with the farthest depth
+// under its screen rect, read from the level where the rect covers at most
+// 2x2 texels.
+bool occluded(vec3 center, float radius) {
+    vec3 ndc_min = vec3(1e30);
+    vec3 ndc_max = vec3(-1e30);
+    for (int c = 0; c < 8; c++) {
+        vec3 corner = center + radius * vec3((c & 1) != 0 ? 1.0 : -1.0,
+                                             (c & 2) != 0 ? 1.0 : -1.0,
+                                             (c & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = u_view_projection * vec4(corner, 1.0);
+        // reaches behind the camera, the rect is unbounded
+        if (clip.w <= 0.0) return false;
+        vec3 ndc = clip.xyz / clip.w;
+        ndc_min = min(ndc_min, ndc);
+        ndc_max = max(ndc_max, ndc);
+    }
+
+    // texture space has y down
+    vec2 uv_min = clamp(vec2(ndc_min.x, -ndc_max.y) * 0.5 + 0.5, 0.0, 1.0);
+    vec2 uv_max = clamp(vec2(ndc_max.x, -ndc_min.y) * 0.5 + 0.5, 0.0, 1.0);
+    vec2 extent = (uv_max - uv_min) * vec2(u_hiz_size);
+    int level = int(ceil(log2(max(max(extent.x, extent.y), 1.0))));
+    level = min(level, int(u_hiz_mip_count) - 1);
+
+    ivec2 level_max = max(u_hiz_size >> level, ivec2(1)) - 1;
+    ivec2 lo = min(ivec2(uv_min * vec2(u_hiz_size)) >> level, level_max);
+    ivec2 hi = min(ivec2(uv_max * vec2(u_hiz_size)) >> level, level_max);
+    float depth = max(max(texelFetch(u_hiz, lo, level).r, texelFetch(u_hiz, ivec2(hi.x, lo.y), level).r),
+                      max(texelFetch(u_hiz, ivec2(lo.x, hi.y), level).r, texelFetch(u_hiz, hi, level).r));
+    return ndc_min.z > depth;
+}
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= u_object_count) return;
+
+    mat4 model = models[i];
+    Group g = groups[object_groups[i]];
+
+    vec3 center = (model * vec4(g.sphere.xyz, 1.0)).xyz;
+    float scale_sq = max(max(dot(model[0].xyz, model[0].xyz), dot(model[1].xyz, model[1].xyz)),
+                         dot(model[2].xyz, model[2].xyz));
+    float radius = g.sphere.w * sqrt(scale_sq);
+    for (int p = 0; p < 6; p++) {
+        if (dot(u_planes[p].xyz, center) + u_planes[p].w < -radius) return;
+    }
+    if (u_hiz_enabled != 0 && occluded(center, radius)) return;
+
+    // every submesh draws the same instances, so their counts move together
+    uint slot = atomicAdd(draws[g.first_draw * 5 + 1], 1);
+    for (uint d = 1; d < g.draw_count; d++) {
+        atomicAdd(draws[(g.first_draw + d) * 5 + 1], 1);
+    }
+    visible[g.first_instance + slot] = model;
+}
@@ -0,0 +1,35 @@
+// Filter from one mip level to the next, shared by compute.glsl and
+// downsample_fragment.glsl. Expects u_src and u_src_size to be declared.
+// Texels are fetched at exact positions; sRGB views decode them to linear.
+
+// Source texels under destination texel x along one axis. An odd size
+// 2n + 1 spreads over n texels, so each one covers three source texels
+// with box weights that sum to one.
+int footprint(int x, int src_size, int dst_size, out vec3 weights) {
+    if (src_size == 1) {
+        weights = vec3(1.0, 0.0, 0.0);
+        return 1;
+    }
+    if ((src_size & 1) == 0) {
+        weights = vec3(0.5, 0.5, 0.0);
+        return 2;
+    }
+    float n = float(dst_size);
+    weights = vec3(n - float(x), n, float(x) + 1.0) / (2.0 * n + 1.0);
+    return 3;
+}
+
+vec4 downsample(ivec2 pos, ivec2 dst_size) {
+    vec3 wx;
+    vec3 wy;
+    int nx = footprint(pos.x, u_src_size.x, dst_size.x, wx);
+    int ny = footprint(pos.y, u_src_size.y, dst_size.y, wy);
+    ivec2 first = min(pos * 2, u_src_size - 1);
+    vec4 color = vec4(0.0);
+    for (int y = 0; y < ny; y++) {
+        for (int x = 0; x < nx; x++) {
+            color += wx[x] * wy[y] * texelFetch(u_src, first + ivec2(x, y), 0);
+        }
+    }
+    return color;
+}
@@ -0,0 +1,21 @@
+#version 450
+#extension GL_EXT_samplerless_texture_functions : require
+#extension GL_GOOGLE_include_directive : require
+
+// One mip level per pass, for formats that cannot be storage bound (sRGB,
+// R8, RG8). Rendering through an sRGB view encodes the linear result.
+layout(set = 0, binding = 0) uniform texture2D u_src;
+layout(set = 0, binding = 1) uniform Downsample {
+    ivec2 u_src_size;
+    int u_level_count;
+    int u_pad0;
+    ivec4 u_dst_size[4];  // xy, only the first is used
+};
+
+#include "downsample.glsl"
+
+layout(location = 0) out vec4 color;
+
+void main() {
+    color = downsample(ivec2(gl_FragCoord.xy), u_dst_size[0].xy);
+}
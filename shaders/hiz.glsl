@@ -0,0 +1,39 @@
+#version 450
+#extension GL_EXT_samplerless_texture_functions : require
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+// Level 0 copies the depth buffer, every later level keeps the farthest
+// depth of its source footprint.
+layout(set = 0, binding = 0) uniform texture2D u_src;
+layout(set = 0, binding = 1, r32f) uniform writeonly image2D u_dst;
+layout(set = 0, binding = 2) uniform Level {
+    ivec2 u_src_size;
+    ivec2 u_dst_size;
+};
+
+void main() {
+    ivec2 dst_pos = ivec2(gl_GlobalInvocationID.xy);
+    if (dst_pos.x >= u_dst_size.x || dst_pos.y >= u_dst_size.y) return;
+
+    if (u_src_size == u_dst_size) {
+        imageStore(u_dst, dst_pos, vec4(texelFetch(u_src, dst_pos, 0).r));
+        return;
+    }
+
+    // an odd source dimension leaves a row or column that only the last
+    // texel of the destination can cover, it takes three texels instead of two
+    ivec2 taps = ivec2(2);
+    if ((u_src_size.x & 1) != 0 && dst_pos.x == u_dst_size.x - 1) taps.x = 3;
+    if ((u_src_size.y & 1) != 0 && dst_pos.y == u_dst_size.y - 1) taps.y = 3;
+
+    ivec2 base = dst_pos * 2;
+    float depth = 0.0;
+    for (int y = 0; y < taps.y; y++) {
+        for (int x = 0; x < taps.x; x++) {
+            ivec2 src_pos = min(base + ivec2(x, y), u_src_size - 1);
+            depth = max(depth, texelFetch(u_src, src_pos, 0).r);
+        }
+    }
+    imageStore(u_dst, dst_pos, vec4(depth));
+}
@@ -7,11 +7,21 @@ layout(set = 0, binding = 0) uniform frame {
 
 layout(set = 0, binding = 1) uniform object {
     mat4 u_model;
+    vec4 u_position_min;
+    vec4 u_position_extent;
 };
 
+#ifdef QUANTIZED
+layout(location = 0) in vec4 a_pos;  // unorm16x4
+layout(location = 1) in vec2 a_norm; // snorm16x2, octahedral
+#else
 layout(location = 0) in vec3 a_pos;
 layout(location = 1) in vec3 a_norm;
+#endif
 layout(location = 2) in vec2 a_uv;
+#ifdef INSTANCED
+layout(location = 3) in mat4 a_model; // instance step, locations 3 to 6
+#endif
 
 layout(location = 0) out vec2 v_uv;
 
@@ -19,7 +29,15 @@ void main()
 {
     float t = u_time;
 
-    gl_Position = u_view_projection * u_model * vec4(a_pos, 1.0);
+    vec3 pos = u_position_min.xyz + a_pos.xyz * u_position_extent.xyz;
+
+#ifdef INSTANCED
+    mat4 model = a_model;
+#else
+    mat4 model = u_model;
+#endif
+
+    gl_Position = u_view_projection * model * vec4(pos, 1.0);
 
     v_uv = a_uv;
 }
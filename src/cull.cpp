@@ -0,0 +1,214 @@
+#include "cull.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__SSE__) || defined(_M_X64)
+#define CULL_SIMD_SSE
+#include <immintrin.h>
+// built for AVX with a target attribute and picked at runtime, since the
+// rest of the build only assumes SSE
+#if defined(__GNUC__) || defined(__clang__)
+#define CULL_SIMD_AVX
+#endif
+#elif defined(__ARM_NEON)
+#define CULL_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+// Gribb and Hartmann, "Fast Extraction of Viewing Frustum Planes from the
+// World-View-Projection Matrix". view_projection is column major.
+void cull_frustum_planes(const float view_projection[4][4], float out_planes[6][4]) {
+    for (int k = 0; k < 4; k++) {
+        float row0 = view_projection[k][0];
+        float row1 = view_projection[k][1];
+        float row2 = view_projection[k][2];
+        float row3 = view_projection[k][3];
+        out_planes[0][k] = row3 + row0;
+        out_planes[1][k] = row3 - row0;
+        out_planes[2][k] = row3 + row1;
+        out_planes[3][k] = row3 - row1;
+        out_planes[4][k] = row3 + row2;
+        out_planes[5][k] = row3 - row2;
+    }
+    for (int p = 0; p < 6; p++) {
+        float *plane = out_planes[p];
+        float len = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        if (len == 0.0f) continue;
+        for (int k = 0; k < 4; k++) plane[k] /= len;
+    }
+}
+
+void cull_set_reset(CullSet *set) {
+    set->count = 0;
+}
+
+static void _reserve(CullSet *set, size_t capacity) {
+    if (capacity <= set->capacity) return;
+    size_t grown = set->capacity ? set->capacity : 64;
+    while (grown < capacity) grown *= 2;
+
+    float **arrays[4] = {&set->x, &set->y, &set->z, &set->radius};
+    for (int i = 0; i < 4; i++) {
+        float *array = (float*)realloc(*arrays[i], sizeof(float) * grown);
+        if (!array) {
+            fprintf(stderr, "Out of memory growing the cull set\n");
+            exit(1);
+        }
+        *arrays[i] = array;
+    }
+    uint8_t *visible = (uint8_t*)realloc(set->visible, grown);
+    if (!visible) {
+        fprintf(stderr, "Out of memory growing the cull set\n");
+        exit(1);
+    }
+    set->visible = visible;
+    set->capacity = grown;
+}
+
+size_t cull_set_add(CullSet *set, const float model[4][4], const float center[3], float radius) {
+    _reserve(set, set->count + 1);
+    size_t i = set->count++;
+
+    float world[3];
+    for (int k = 0; k < 3; k++) {
+        world[k] = model[0][k] * center[0] + model[1][k] * center[1] + model[2][k] * center[2] + model[3][k];
+    }
+    // the largest axis scale keeps the sphere conservative under non uniform scale
+    float scale_sq = 0.0f;
+    for (int c = 0; c < 3; c++) {
+        float sq = model[c][0] * model[c][0] + model[c][1] * model[c][1] + model[c][2] * model[c][2];
+        scale_sq = fmaxf(scale_sq, sq);
+    }
+
+    set->x[i] = world[0];
+    set->y[i] = world[1];
+    set->z[i] = world[2];
+    set->radius[i] = radius * sqrtf(scale_sq);
+    return i;
+}
+
+static size_t _test_scalar(CullSet *set, const float planes[6][4], size_t begin) {
+    size_t visible = 0;
+    for (size_t i = begin; i < set->count; i++) {
+        int inside = 1;
+        for (int p = 0; p < 6 && inside; p++) {
+            float d = planes[p][0] * set->x[i] + planes[p][1] * set->y[i] + planes[p][2] * set->z[i] + planes[p][3];
+            inside = d >= -set->radius[i];
+        }
+        set->visible[i] = (uint8_t)inside;
+        visible += (size_t)inside;
+    }
+    return visible;
+}
+
+#if defined(CULL_SIMD_SSE)
+static size_t _test_sse(CullSet *set, const float planes[6][4], size_t begin) {
+    size_t i = begin;
+    size_t visible = 0;
+    for (; i + 4 <= set->count; i += 4) {
+        __m128 x = _mm_loadu_ps(set->x + i);
+        __m128 y = _mm_loadu_ps(set->y + i);
+        __m128 z = _mm_loadu_ps(set->z + i);
+        __m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(set->radius + i));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            __m128 d = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(planes[p][0])),
+                           _mm_mul_ps(y, _mm_set1_ps(planes[p][1]))),
+                _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(planes[p][2])),
+                           _mm_set1_ps(planes[p][3])));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, neg_r));
+        }
+        int mask = _mm_movemask_ps(inside);
+        for (int k = 0; k < 4; k++) set->visible[i + k] = (uint8_t)((mask >> k) & 1);
+        visible += (size_t)__builtin_popcount((unsigned int)mask);
+    }
+    return visible + _test_scalar(set, planes, i);
+}
+#endif
+
+#if defined(CULL_SIMD_AVX)
+// Leaves the last 4 to 7 spheres to the SSE loop.
+__attribute__((target("avx")))
+static size_t _test_avx(CullSet *set, const float planes[6][4], size_t begin) {
+    size_t i = begin;
+    size_t visible = 0;
+    for (; i + 8 <= set->count; i += 8) {
+        __m256 x = _mm256_loadu_ps(set->x + i);
+        __m256 y = _mm256_loadu_ps(set->y + i);
+        __m256 z = _mm256_loadu_ps(set->z + i);
+        __m256 neg_r = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(set->radius + i));
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            __m256 d = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(planes[p][0])),
+                              _mm256_mul_ps(y, _mm256_set1_ps(planes[p][1]))),
+                _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(planes[p][2])),
+                              _mm256_set1_ps(planes[p][3])));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, neg_r, _CMP_GE_OQ));
+        }
+        int mask = _mm256_movemask_ps(inside);
+        for (int k = 0; k < 8; k++) set->visible[i + k] = (uint8_t)((mask >> k) & 1);
+        visible += (size_t)__builtin_popcount((unsigned int)mask);
+    }
+    return visible + _test_sse(set, planes, i);
+}
+#endif
+
+#if defined(CULL_SIMD_NEON)
+static size_t _test_neon(CullSet *set, const float planes[6][4], size_t begin) {
+    size_t i = begin;
+    size_t visible = 0;
+    for (; i + 4 <= set->count; i += 4) {
+        float32x4_t x = vld1q_f32(set->x + i);
+        float32x4_t y = vld1q_f32(set->y + i);
+        float32x4_t z = vld1q_f32(set->z + i);
+        float32x4_t neg_r = vnegq_f32(vld1q_f32(set->radius + i));
+        uint32x4_t inside = vdupq_n_u32(0xffffffffu);
+        for (int p = 0; p < 6; p++) {
+            float32x4_t d = vdupq_n_f32(planes[p][3]);
+            d = vmlaq_n_f32(d, x, planes[p][0]);
+            d = vmlaq_n_f32(d, y, planes[p][1]);
+            d = vmlaq_n_f32(d, z, planes[p][2]);
+            inside = vandq_u32(inside, vcgeq_f32(d, neg_r));
+        }
+        // lanes are all ones or all zeros, keep one bit of each
+        uint32x4_t bits = vshrq_n_u32(inside, 31);
+        set->visible[i + 0] = (uint8_t)vgetq_lane_u32(bits, 0);
+        set->visible[i + 1] = (uint8_t)vgetq_lane_u32(bits, 1);
+        set->visible[i + 2] = (uint8_t)vgetq_lane_u32(bits, 2);
+        set->visible[i + 3] = (uint8_t)vgetq_lane_u32(bits, 3);
+        visible += (size_t)vaddvq_u32(bits);
+    }
+    return visible + _test_scalar(set, planes, i);
+}
+#endif
+
+// Takes the widest loop the CPU supports, checked once.
+void cull_test(CullSet *set, const float planes[6][4], CullStats *out_stats) {
+    size_t visible;
+#if defined(CULL_SIMD_AVX)
+    static int has_avx = -1;
+    if (has_avx < 0) has_avx = __builtin_cpu_supports("avx") ? 1 : 0;
+    visible = has_avx ? _test_avx(set, planes, 0) : _test_sse(set, planes, 0);
+#elif defined(CULL_SIMD_SSE)
+    visible = _test_sse(set, planes, 0);
+#elif defined(CULL_SIMD_NEON)
+    visible = _test_neon(set, planes, 0);
+#else
+    visible = _test_scalar(set, planes, 0);
+#endif
+    if (out_stats) {
+        out_stats->visible = (uint32_t)visible;
+        out_stats->culled = (uint32_t)(set->count - visible);
+    }
+}
+
+void cull_set_release(CullSet *set) {
+    free(set->x);
+    free(set->y);
+    free(set->z);
+    free(set->radius);
+    free(set->visible);
+    memset(set, 0, sizeof(CullSet));
+}
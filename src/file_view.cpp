@@ -0,0 +1,100 @@
+#include "file_view.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Reserves size + 1 bytes rounded up to whole pages of zeroed anonymous
+// memory, then maps the file over the front of it. The tail of the file's
+// last page and the reserved page after it are both zero, so the view is
+// terminated without copying the file.
+static int _map(int fd, size_t size, FileView *view) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t base_size = (size + 1 + page - 1) / page * page;
+
+    void *base = mmap(NULL, base_size, PROT_READ, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (base == MAP_FAILED) return -1;
+
+    void *file = mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    if (file == MAP_FAILED) {
+        munmap(base, base_size);
+        return -1;
+    }
+
+    view->data = (const char *)base;
+    view->size = size;
+    view->base = base;
+    view->base_size = base_size;
+    view->mapped = 1;
+    return 0;
+}
+
+static int _read(int fd, size_t size_hint, FileView *view) {
+    size_t cap = size_hint + 1;
+    size_t len = 0;
+    char *buf = (char *)malloc(cap);
+    if (!buf) return -1;
+
+    for (;;) {
+        if (len + 1 == cap) {
+            char *grown = (char *)realloc(buf, cap * 2);
+            if (!grown) {
+                free(buf);
+                return -1;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+        ssize_t r = read(fd, buf + len, cap - 1 - len);
+        if (r < 0) {
+            free(buf);
+            return -1;
+        }
+        if (r == 0) break;
+        len += (size_t)r;
+    }
+    buf[len] = '\0';
+
+    view->data = buf;
+    view->size = len;
+    view->base = buf;
+    view->base_size = cap;
+    view->mapped = 0;
+    return 0;
+}
+
+int file_view_open(const char *path, FileView *out_view) {
+    memset(out_view, 0, sizeof(FileView));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    // empty and non-regular files (pipes, devices) can't be mapped
+    int ret = -1;
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        ret = _map(fd, (size_t)st.st_size, out_view);
+    }
+    if (ret != 0) {
+        ret = _read(fd, st.st_size > 0 ? (size_t)st.st_size : 0, out_view);
+    }
+    close(fd);
+    return ret;
+}
+
+void file_view_close(FileView *view) {
+    if (!view || !view->base) return;
+    if (view->mapped) {
+        munmap(view->base, view->base_size);
+    } else {
+        free(view->base);
+    }
+    memset(view, 0, sizeof(FileView));
+}
@@ -0,0 +1,161 @@
+#include "geometry_pool.h"
+#include <stdio.h>
+#include <string.h>
+
+void range_alloc_init(RangeAllocator *ra, uint32_t capacity) {
+    memset(ra, 0, sizeof(RangeAllocator));
+    range_alloc_grow(ra, capacity);
+}
+
+uint32_t range_alloc(RangeAllocator *ra, uint32_t size) {
+    if (size == 0) return 0;
+    for (size_t i = 0; i < ra->free_count; i++) {
+        FreeRange *r = &ra->free[i];
+        if (r->size < size) continue;
+        uint32_t offset = r->offset;
+        r->offset += size;
+        r->size -= size;
+        if (r->size == 0) {
+            memmove(r, r + 1, sizeof(*r) * (ra->free_count - i - 1));
+            ra->free_count--;
+        }
+        return offset;
+    }
+    return RANGE_ALLOC_FAILED;
+}
+
+void range_free(RangeAllocator *ra, uint32_t offset, uint32_t size) {
+    if (size == 0) return;
+
+    // free ranges are kept sorted by offset
+    size_t i = 0;
+    while (i < ra->free_count && ra->free[i].offset < offset) i++;
+
+    int merge_prev = i > 0 && ra->free[i - 1].offset + ra->free[i - 1].size == offset;
+    int merge_next = i < ra->free_count && offset + size == ra->free[i].offset;
+
+    if (merge_prev && merge_next) {
+        ra->free[i - 1].size += size + ra->free[i].size;
+        memmove(&ra->free[i], &ra->free[i + 1], sizeof(ra->free[0]) * (ra->free_count - i - 1));
+        ra->free_count--;
+    } else if (merge_prev) {
+        ra->free[i - 1].size += size;
+    } else if (merge_next) {
+        ra->free[i].offset = offset;
+        ra->free[i].size += size;
+    } else {
+        if (ra->free_count == ra->free_capacity) {
+            size_t capacity = ra->free_capacity ? ra->free_capacity * 2 : 16;
+            void *grown = realloc(ra->free, sizeof(ra->free[0]) * capacity);
+            // out of memory leaks the range rather than corrupting the list
+            if (!grown) return;
+            ra->free = (FreeRange*)grown;
+            ra->free_capacity = capacity;
+        }
+        memmove(&ra->free[i + 1], &ra->free[i], sizeof(ra->free[0]) * (ra->free_count - i));
+        ra->free[i].offset = offset;
+        ra->free[i].size = size;
+        ra->free_count++;
+    }
+}
+
+void range_alloc_grow(RangeAllocator *ra, uint32_t new_capacity) {
+    if (new_capacity <= ra->capacity) return;
+    uint32_t old_capacity = ra->capacity;
+    ra->capacity = new_capacity;
+    range_free(ra, old_capacity, new_capacity - old_capacity);
+}
+
+void range_alloc_release(RangeAllocator *ra) {
+    free(ra->free);
+    memset(ra, 0, sizeof(RangeAllocator));
+}
+
+static WGPUBuffer _create_buffer(WGPUDevice device, WGPUBufferUsage usage, size_t size) {
+    WGPUBufferDescriptor desc = {
+        .nextInChain = NULL,
+        .usage = usage | WGPUBufferUsage_CopyDst | WGPUBufferUsage_CopySrc,
+        .size = size,
+        .mappedAtCreation = false
+    };
+    return wgpuDeviceCreateBuffer(device, &desc);
+}
+
+// Doubles the buffer until needed more elements fit, copying the old contents.
+static void _grow(UploadRing *ring, WGPUBuffer *buffer, WGPUBufferUsage usage,
+                  RangeAllocator *ra, size_t element_size, uint32_t needed) {
+    uint32_t capacity = ra->capacity;
+    while (capacity - ra->capacity < needed) capacity *= 2;
+
+    // staged writes to the old buffer have to land before it is copied
+    upload_ring_submit(ring);
+
+    WGPUBuffer grown = _create_buffer(ring->device, usage, capacity * element_size);
+    WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(ring->device, NULL);
+    wgpuCommandEncoderCopyBufferToBuffer(encoder, *buffer, 0, grown, 0, ra->capacity * element_size);
+    WGPUCommandBuffer command_buffer = wgpuCommandEncoderFinish(encoder, NULL);
+    wgpuCommandEncoderRelease(encoder);
+    wgpuQueueSubmit(ring->queue, 1, &command_buffer);
+    wgpuCommandBufferRelease(command_buffer);
+
+    wgpuBufferRelease(*buffer);
+    *buffer = grown;
+    printf("Geometry pool grew to %u elements of %zu bytes\n", capacity, element_size);
+    range_alloc_grow(ra, capacity);
+}
+
+void geometry_pool_init(GeometryPool *pool, WGPUDevice device, size_t vertex_stride) {
+    pool->vertex_stride = vertex_stride;
+    pool->generation = 0;
+    range_alloc_init(&pool->vertices, GEOMETRY_POOL_INITIAL_VERTICES);
+    range_alloc_init(&pool->indices, GEOMETRY_POOL_INITIAL_INDICES);
+    pool->vbo = _create_buffer(device, WGPUBufferUsage_Vertex, GEOMETRY_POOL_INITIAL_VERTICES * vertex_stride);
+    pool->ibo = _create_buffer(device, WGPUBufferUsage_Index, GEOMETRY_POOL_INITIAL_INDICES * sizeof(uint32_t));
+}
+
+int geometry_pool_add(GeometryPool *pool, UploadRing *ring, const Mesh *mesh, GeometryHandle *out_handle) {
+    if (mesh->vertex_stride != pool->vertex_stride) {
+        fprintf(stderr, "Mesh vertex stride %zu does not match the geometry pool's %zu\n",
+                mesh->vertex_stride, pool->vertex_stride);
+        return -1;
+    }
+
+    uint32_t vertex_count = (uint32_t)mesh->vertex_count;
+    uint32_t index_count = (uint32_t)mesh->index_count;
+
+    uint32_t base_vertex = range_alloc(&pool->vertices, vertex_count);
+    if (base_vertex == RANGE_ALLOC_FAILED) {
+        _grow(ring, &pool->vbo, WGPUBufferUsage_Vertex, &pool->vertices, pool->vertex_stride, vertex_count);
+        pool->generation++;
+        base_vertex = range_alloc(&pool->vertices, vertex_count);
+    }
+    uint32_t first_index = range_alloc(&pool->indices, index_count);
+    if (first_index == RANGE_ALLOC_FAILED) {
+        _grow(ring, &pool->ibo, WGPUBufferUsage_Index, &pool->indices, sizeof(uint32_t), index_count);
+        pool->generation++;
+        first_index = range_alloc(&pool->indices, index_count);
+    }
+
+    upload_ring_write(ring, pool->vbo, (uint64_t)base_vertex * pool->vertex_stride,
+                      mesh->vertices, mesh->vertex_count * pool->vertex_stride);
+    upload_ring_write(ring, pool->ibo, (uint64_t)first_index * sizeof(uint32_t),
+                      mesh->indices, mesh->index_count * sizeof(uint32_t));
+
+    out_handle->base_vertex = base_vertex;
+    out_handle->vertex_count = vertex_count;
+    out_handle->first_index = first_index;
+    out_handle->index_count = index_count;
+    return 0;
+}
+
+void geometry_pool_remove(GeometryPool *pool, const GeometryHandle *handle) {
+    range_free(&pool->vertices, handle->base_vertex, handle->vertex_count);
+    range_free(&pool->indices, handle->first_index, handle->index_count);
+}
+
+void geometry_pool_release(GeometryPool *pool) {
+    wgpuBufferRelease(pool->vbo);
+    wgpuBufferRelease(pool->ibo);
+    range_alloc_release(&pool->vertices);
+    range_alloc_release(&pool->indices);
+}
@@ -0,0 +1,309 @@
+#include "gpu_cull.h"
+#include <stdio.h>
+#include <string.h>
+
+#define GPU_CULL_DRAW_WORDS (GPU_CULL_DRAW_SIZE / sizeof(uint32_t))
+
+void gpu_cull_init(GpuCull *cull, WGPUDevice device, WGPUShaderModule module) {
+    memset(cull, 0, sizeof(GpuCull));
+
+    WGPUBindGroupLayoutEntry bgl_entries[GPU_CULL_ENTRY_COUNT] = {
+        {
+            .binding = 0,
+            .visibility = WGPUShaderStage_Compute,
+            .buffer.type = WGPUBufferBindingType_Uniform,
+        },
+        {
+            .binding = 1,
+            .visibility = WGPUShaderStage_Compute,
+            .buffer.type = WGPUBufferBindingType_ReadOnlyStorage,
+        },
+        {
+            .binding = 2,
+            .visibility = WGPUShaderStage_Compute,
+            .buffer.type = WGPUBufferBindingType_ReadOnlyStorage,
+        },
+        {
+            .binding = 3,
+            .visibility = WGPUShaderStage_Compute,
+            .buffer.type = WGPUBufferBindingType_ReadOnlyStorage,
+        },
+        {
+            .binding = 4,
+            .visibility = WGPUShaderStage_Compute,
+            .buffer.type = WGPUBufferBindingType_Storage,
+        },
+        {
+            .binding = 5,
+            .visibility = WGPUShaderStage_Compute,
+            .buffer.type = WGPUBufferBindingType_Storage,
+        },
+        {
+            .binding = 6,
+            .visibility = WGPUShaderStage_Compute,
+            .texture = {
+                .sampleType = WGPUTextureSampleType_UnfilterableFloat,
+                .viewDimension = WGPUTextureViewDimension_2D,
+            }
+        }
+    };
+
+    WGPUBindGroupLayoutDescriptor bgl_desc = {
+        .nextInChain = NULL,
+        .entryCount = GPU_CULL_ENTRY_COUNT,
+        .entries = bgl_entries
+    };
+    cull->bgl = wgpuDeviceCreateBindGroupLayout(device, &bgl_desc);
+
+    WGPUPipelineLayoutDescriptor pipeline_layout_desc = {
+        .nextInChain = NULL,
+        .bindGroupLayoutCount = 1,
+        .bindGroupLayouts = &cull->bgl
+    };
+    WGPUPipelineLayout pipeline_layout = wgpuDeviceCreatePipelineLayout(device, &pipeline_layout_desc);
+
+    WGPUComputePipelineDescriptor pipeline_desc = {
+        .nextInChain = NULL,
+        .layout = pipeline_layout,
+        .compute.module = module,
+        .compute.entryPoint = {
+            .data = "main",
+            .length = WGPU_STRLEN
+        }
+    };
+    cull->pipeline = wgpuDeviceCreateComputePipeline(device, &pipeline_desc);
+    wgpuPipelineLayoutRelease(pipeline_layout);
+
+    WGPUBufferDescriptor uniforms_desc = {
+        .nextInChain = NULL,
+        .usage = WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst,
+        .size = sizeof(GpuCullUniforms),
+        .mappedAtCreation = false
+    };
+    cull->uniforms = wgpuDeviceCreateBuffer(device, &uniforms_desc);
+}
+
+size_t gpu_cull_add_group(GpuCull *cull, const Mesh *mesh, const GeometryHandle *geo,
+                          WGPUBuffer instances, uint32_t count) {
+    if (cull->group_count == cull->group_capacity) {
+        size_t capacity = cull->group_capacity ? cull->group_capacity * 2 : 8;
+        GpuCullGroup *info = (GpuCullGroup*)realloc(cull->group_info, sizeof(GpuCullGroup) * capacity);
+        if (info) cull->group_info = info;
+        WGPUBuffer *sources = (WGPUBuffer*)realloc(cull->group_sources, sizeof(WGPUBuffer) * capacity);
+        if (sources) cull->group_sources = sources;
+        if (!info || !sources) {
+            fprintf(stderr, "Out of memory adding a GPU cull group\n");
+            exit(1);
+        }
+        cull->group_capacity = capacity;
+    }
+    if (cull->draw_count + mesh->submesh_count > cull->draw_capacity) {
+        size_t capacity = cull->draw_capacity ? cull->draw_capacity : 16;
+        while (capacity < cull->draw_count + mesh->submesh_count) capacity *= 2;
+        uint32_t *args = (uint32_t*)realloc(cull->draw_args, GPU_CULL_DRAW_SIZE * capacity);
+        if (!args) {
+            fprintf(stderr, "Out of memory adding a GPU cull group\n");
+            exit(1);
+        }
+        cull->draw_args = args;
+        cull->draw_capacity = capacity;
+    }
+
+    size_t index = cull->group_count++;
+    GpuCullGroup *group = &cull->group_info[index];
+    memcpy(group->sphere, mesh->bounds.center, sizeof(mesh->bounds.center));
+    group->sphere[3] = mesh->bounds.radius;
+    group->first_draw = cull->draw_count;
+    group->draw_count = (uint32_t)mesh->submesh_count;
+    group->first_instance = cull->object_count;
+    group->pad0 = 0;
+    cull->group_sources[index] = instances;
+
+    for (size_t i = 0; i < mesh->submesh_count; i++) {
+        const Submesh *sm = &mesh->submeshes[i];
+        uint32_t *args = &cull->draw_args[GPU_CULL_DRAW_WORDS * cull->draw_count++];
+        args[0] = sm->index_count;
+        args[1] = 0;
+        args[2] = geo->first_index + sm->first_index;
+        args[3] = geo->base_vertex;  // int32 base vertex, never negative here
+        // the visible instances are bound at first_instance, which avoids
+        // the indirect-first-instance feature
+        args[4] = 0;
+    }
+    cull->object_count += count;
+    return index;
+}
+
+static WGPUBuffer _create_buffer(WGPUDevice device, WGPUBufferUsage usage, size_t size) {
+    WGPUBufferDescriptor desc = {
+        .nextInChain = NULL,
+        .usage = usage,
+        .size = size ? size : 4,
+        .mappedAtCreation = false
+    };
+    return wgpuDeviceCreateBuffer(device, &desc);
+}
+
+static void _release_buffers(GpuCull *cull) {
+    WGPUBuffer *buffers[] = {&cull->objects, &cull->object_groups, &cull->groups,
+                             &cull->draw_templates, &cull->draws, &cull->visible};
+    for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++) {
+        if (*buffers[i]) wgpuBufferRelease(*buffers[i]);
+        *buffers[i] = NULL;
+    }
+    if (cull->bg) wgpuBindGroupRelease(cull->bg);
+    cull->bg = NULL;
+}
+
+// Needs the buffers from gpu_cull_build and a Hi-Z view.
+static void _create_bind_group(GpuCull *cull, WGPUDevice device) {
+    if (cull->bg) wgpuBindGroupRelease(cull->bg);
+    cull->bg = NULL;
+    if (!cull->objects || !cull->hiz_view) return;
+
+    WGPUBindGroupEntry bg_entries[GPU_CULL_ENTRY_COUNT] = {
+        {
+            .binding = 0,
+            .buffer = cull->uniforms,
+            .offset = 0,
+            .size = sizeof(GpuCullUniforms)
+        },
+        {
+            .binding = 1,
+            .buffer = cull->objects,
+            .offset = 0,
+            .size = WGPU_WHOLE_SIZE
+        },
+        {
+            .binding = 2,
+            .buffer = cull->object_groups,
+            .offset = 0,
+            .size = WGPU_WHOLE_SIZE
+        },
+        {
+            .binding = 3,
+            .buffer = cull->groups,
+            .offset = 0,
+            .size = WGPU_WHOLE_SIZE
+        },
+        {
+            .binding = 4,
+            .buffer = cull->draws,
+            .offset = 0,
+            .size = WGPU_WHOLE_SIZE
+        },
+        {
+            .binding = 5,
+            .buffer = cull->visible,
+            .offset = 0,
+            .size = WGPU_WHOLE_SIZE
+        },
+        {
+            .binding = 6,
+            .textureView = cull->hiz_view,
+        }
+    };
+
+    WGPUBindGroupDescriptor bg_desc = {
+        .nextInChain = NULL,
+        .layout = cull->bgl,
+        .entryCount = GPU_CULL_ENTRY_COUNT,
+        .entries = bg_entries
+    };
+    cull->bg = wgpuDeviceCreateBindGroup(device, &bg_desc);
+}
+
+void gpu_cull_build(GpuCull *cull, WGPUDevice device, UploadRing *ring) {
+    _release_buffers(cull);
+
+    size_t object_bytes = (size_t)cull->object_count * sizeof(float) * 16;
+    size_t draw_bytes = (size_t)cull->draw_count * GPU_CULL_DRAW_SIZE;
+    cull->objects = _create_buffer(device, WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst, object_bytes);
+    cull->object_groups = _create_buffer(device, WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst,
+                                         cull->object_count * sizeof(uint32_t));
+    cull->groups = _create_buffer(device, WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst,
+                                  cull->group_count * sizeof(GpuCullGroup));
+    cull->draw_templates = _create_buffer(device, WGPUBufferUsage_CopySrc | WGPUBufferUsage_CopyDst, draw_bytes);
+    cull->draws = _create_buffer(device, WGPUBufferUsage_Indirect | WGPUBufferUsage_Storage | WGPUBufferUsage_CopyDst,
+                                 draw_bytes);
+    cull->visible = _create_buffer(device, WGPUBufferUsage_Vertex | WGPUBufferUsage_Storage, object_bytes);
+
+    uint32_t *object_groups = (uint32_t*)malloc(sizeof(uint32_t) * (cull->object_count ? cull->object_count : 1));
+    if (!object_groups) {
+        fprintf(stderr, "Out of memory building GPU cull buffers\n");
+        exit(1);
+    }
+    for (size_t g = 0; g < cull->group_count; g++) {
+        uint32_t end = g + 1 < cull->group_count ? cull->group_info[g + 1].first_instance : cull->object_count;
+        for (uint32_t i = cull->group_info[g].first_instance; i < end; i++) {
+            object_groups[i] = (uint32_t)g;
+        }
+    }
+    upload_ring_write(ring, cull->object_groups, 0, object_groups, cull->object_count * sizeof(uint32_t));
+    upload_ring_write(ring, cull->groups, 0, cull->group_info, cull->group_count * sizeof(GpuCullGroup));
+    upload_ring_write(ring, cull->draw_templates, 0, cull->draw_args, draw_bytes);
+    free(object_groups);
+
+    // the model matrices already live in the groups' instance buffers; the
+    // ring is flushed first in case those were only just staged
+    upload_ring_submit(ring);
+    WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(device, NULL);
+    for (size_t g = 0; g < cull->group_count; g++) {
+        uint32_t end = g + 1 < cull->group_count ? cull->group_info[g + 1].first_instance : cull->object_count;
+        uint64_t first = cull->group_info[g].first_instance;
+        wgpuCommandEncoderCopyBufferToBuffer(encoder, cull->group_sources[g], 0, cull->objects,
+                                             first * sizeof(float) * 16, (end - first) * sizeof(float) * 16);
+    }
+    WGPUCommandBuffer command_buffer = wgpuCommandEncoderFinish(encoder, NULL);
+    wgpuCommandEncoderRelease(encoder);
+    wgpuQueueSubmit(ring->queue, 1, &command_buffer);
+    wgpuCommandBufferRelease(command_buffer);
+
+    _create_bind_group(cull, device);
+}
+
+void gpu_cull_set_hiz(GpuCull *cull, WGPUDevice device, WGPUTextureView hiz_view) {
+    cull->hiz_view = hiz_view;
+    _create_bind_group(cull, device);
+}
+
+void gpu_cull_update(GpuCull *cull, UploadRing *ring, const float planes[6][4], const HiZ *hiz) {
+    GpuCullUniforms uniforms;
+    memset(&uniforms, 0, sizeof(uniforms));
+    memcpy(uniforms.planes, planes, sizeof(uniforms.planes));
+    uniforms.object_count = cull->object_count;
+    if (hiz && hiz->valid) {
+        memcpy(uniforms.view_projection, hiz->view_projection, sizeof(uniforms.view_projection));
+        uniforms.hiz_enabled = 1;
+        uniforms.hiz_mip_count = hiz->mip_count;
+        uniforms.hiz_size[0] = (int32_t)hiz->width;
+        uniforms.hiz_size[1] = (int32_t)hiz->height;
+    }
+    upload_ring_write(ring, cull->uniforms, 0, &uniforms, sizeof(GpuCullUniforms));
+}
+
+void gpu_cull_encode(GpuCull *cull, WGPUCommandEncoder encoder) {
+    if (!cull->bg || cull->object_count == 0) return;
+
+    wgpuCommandEncoderCopyBufferToBuffer(encoder, cull->draw_templates, 0, cull->draws, 0,
+                                         (uint64_t)cull->draw_count * GPU_CULL_DRAW_SIZE);
+
+    WGPUComputePassEncoder pass = wgpuCommandEncoderBeginComputePass(encoder, NULL);
+    wgpuComputePassEncoderSetPipeline(pass, cull->pipeline);
+    wgpuComputePassEncoderSetBindGroup(pass, 0, cull->bg, 0, NULL);
+    uint32_t workgroups = (cull->object_count + GPU_CULL_WORKGROUP_SIZE - 1) / GPU_CULL_WORKGROUP_SIZE;
+    wgpuComputePassEncoderDispatchWorkgroups(pass, workgroups, 1, 1);
+    wgpuComputePassEncoderEnd(pass);
+    wgpuComputePassEncoderRelease(pass);
+}
+
+void gpu_cull_release(GpuCull *cull) {
+    _release_buffers(cull);
+    if (cull->uniforms) wgpuBufferRelease(cull->uniforms);
+    if (cull->pipeline) wgpuComputePipelineRelease(cull->pipeline);
+    if (cull->bgl) wgpuBindGroupLayoutRelease(cull->bgl);
+    free(cull->group_info);
+    free(cull->group_sources);
+    free(cull->draw_args);
+    memset(cull, 0, sizeof(GpuCull));
+}
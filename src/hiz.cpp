@@ -0,0 +1,206 @@
+#include "hiz.h"
+#include <stdio.h>
+#include <string.h>
+
+void hiz_init(HiZ *hiz, WGPUDevice device, WGPUShaderModule module) {
+    memset(hiz, 0, sizeof(HiZ));
+
+    WGPUBindGroupLayoutEntry bgl_entries[HIZ_ENTRY_COUNT] = {
+        {
+            .binding = 0,
+            .visibility = WGPUShaderStage_Compute,
+            .texture = {
+                .sampleType = WGPUTextureSampleType_UnfilterableFloat,
+                .viewDimension = WGPUTextureViewDimension_2D,
+            }
+        },
+        {
+            .binding = 1,
+            .visibility = WGPUShaderStage_Compute,
+            .storageTexture = {
+                .access = WGPUStorageTextureAccess_WriteOnly,
+                .format = WGPUTextureFormat_R32Float,
+                .viewDimension = WGPUTextureViewDimension_2D,
+            }
+        },
+        {
+            .binding = 2,
+            .visibility = WGPUShaderStage_Compute,
+            .buffer.type = WGPUBufferBindingType_Uniform,
+        }
+    };
+
+    WGPUBindGroupLayoutDescriptor bgl_desc = {
+        .nextInChain = NULL,
+        .entryCount = HIZ_ENTRY_COUNT,
+        .entries = bgl_entries
+    };
+    hiz->bgl = wgpuDeviceCreateBindGroupLayout(device, &bgl_desc);
+
+    WGPUPipelineLayoutDescriptor pipeline_layout_desc = {
+        .nextInChain = NULL,
+        .bindGroupLayoutCount = 1,
+        .bindGroupLayouts = &hiz->bgl
+    };
+    WGPUPipelineLayout pipeline_layout = wgpuDeviceCreatePipelineLayout(device, &pipeline_layout_desc);
+
+    WGPUComputePipelineDescriptor pipeline_desc = {
+        .nextInChain = NULL,
+        .layout = pipeline_layout,
+        .compute.module = module,
+        .compute.entryPoint = {
+            .data = "main",
+            .length = WGPU_STRLEN
+        }
+    };
+    hiz->pipeline = wgpuDeviceCreateComputePipeline(device, &pipeline_desc);
+    wgpuPipelineLayoutRelease(pipeline_layout);
+
+    WGPUBufferDescriptor uniforms_desc = {
+        .nextInChain = NULL,
+        .usage = WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst,
+        .size = HIZ_MAX_LEVELS * HIZ_LEVEL_UNIFORM_SIZE,
+        .mappedAtCreation = false
+    };
+    hiz->uniforms = wgpuDeviceCreateBuffer(device, &uniforms_desc);
+}
+
+static void _release_levels(HiZ *hiz) {
+    for (uint32_t i = 0; i < hiz->mip_count; i++) {
+        wgpuBindGroupRelease(hiz->level_bgs[i]);
+        wgpuTextureViewRelease(hiz->level_views[i]);
+        hiz->level_bgs[i] = NULL;
+        hiz->level_views[i] = NULL;
+    }
+    if (hiz->view) wgpuTextureViewRelease(hiz->view);
+    if (hiz->depth_view) wgpuTextureViewRelease(hiz->depth_view);
+    if (hiz->texture) wgpuTextureRelease(hiz->texture);
+    hiz->view = NULL;
+    hiz->depth_view = NULL;
+    hiz->texture = NULL;
+    hiz->mip_count = 0;
+    hiz->valid = false;
+}
+
+static uint32_t _mip_size(uint32_t size, uint32_t level) {
+    uint32_t s = size >> level;
+    return s ? s : 1;
+}
+
+void hiz_resize(HiZ *hiz, WGPUDevice device, UploadRing *ring, WGPUTexture depth_texture,
+                uint32_t width, uint32_t height) {
+    _release_levels(hiz);
+    hiz->width = width;
+    hiz->height = height;
+
+    uint32_t mip_count = 1;
+    while (mip_count < HIZ_MAX_LEVELS && ((width | height) >> mip_count) != 0) mip_count++;
+
+    WGPUTextureDescriptor texture_desc = {
+        .nextInChain = NULL,
+        .usage = WGPUTextureUsage_StorageBinding | WGPUTextureUsage_TextureBinding,
+        .dimension = WGPUTextureDimension_2D,
+        .size = { width, height, 1 },
+        .format = WGPUTextureFormat_R32Float,
+        .mipLevelCount = mip_count,
+        .sampleCount = 1,
+        .viewFormatCount = 0,
+        .viewFormats = NULL
+    };
+    hiz->texture = wgpuDeviceCreateTexture(device, &texture_desc);
+    hiz->view = wgpuTextureCreateView(hiz->texture, NULL);
+
+    WGPUTextureViewDescriptor depth_view_desc = {
+        .nextInChain = NULL,
+        .format = WGPUTextureFormat_Undefined,
+        .dimension = WGPUTextureViewDimension_2D,
+        .baseMipLevel = 0,
+        .mipLevelCount = 1,
+        .baseArrayLayer = 0,
+        .arrayLayerCount = 1,
+        .aspect = WGPUTextureAspect_DepthOnly,
+        .usage = WGPUTextureUsage_TextureBinding
+    };
+    hiz->depth_view = wgpuTextureCreateView(depth_texture, &depth_view_desc);
+
+    uint8_t level_uniforms[HIZ_MAX_LEVELS * HIZ_LEVEL_UNIFORM_SIZE];
+    memset(level_uniforms, 0, sizeof(level_uniforms));
+
+    for (uint32_t level = 0; level < mip_count; level++) {
+        WGPUTextureViewDescriptor level_view_desc = {
+            .nextInChain = NULL,
+            .format = WGPUTextureFormat_R32Float,
+            .dimension = WGPUTextureViewDimension_2D,
+            .baseMipLevel = level,
+            .mipLevelCount = 1,
+            .baseArrayLayer = 0,
+            .arrayLayerCount = 1,
+            .aspect = WGPUTextureAspect_All,
+            .usage = WGPUTextureUsage_StorageBinding | WGPUTextureUsage_TextureBinding
+        };
+        hiz->level_views[level] = wgpuTextureCreateView(hiz->texture, &level_view_desc);
+
+        HiZLevelUniforms *u = (HiZLevelUniforms*)&level_uniforms[level * HIZ_LEVEL_UNIFORM_SIZE];
+        uint32_t src_level = level ? level - 1 : 0;
+        u->src_size[0] = (int32_t)_mip_size(width, src_level);
+        u->src_size[1] = (int32_t)_mip_size(height, src_level);
+        u->dst_size[0] = (int32_t)_mip_size(width, level);
+        u->dst_size[1] = (int32_t)_mip_size(height, level);
+
+        WGPUBindGroupEntry bg_entries[HIZ_ENTRY_COUNT] = {
+            {
+                .binding = 0,
+                .textureView = level ? hiz->level_views[level - 1] : hiz->depth_view,
+            },
+            {
+                .binding = 1,
+                .textureView = hiz->level_views[level],
+            },
+            {
+                .binding = 2,
+                .buffer = hiz->uniforms,
+                .offset = level * HIZ_LEVEL_UNIFORM_SIZE,
+                .size = sizeof(HiZLevelUniforms)
+            }
+        };
+
+        WGPUBindGroupDescriptor bg_desc = {
+            .nextInChain = NULL,
+            .layout = hiz->bgl,
+            .entryCount = HIZ_ENTRY_COUNT,
+            .entries = bg_entries
+        };
+        hiz->level_bgs[level] = wgpuDeviceCreateBindGroup(device, &bg_desc);
+    }
+    hiz->mip_count = mip_count;
+
+    upload_ring_write(ring, hiz->uniforms, 0, level_uniforms, mip_count * HIZ_LEVEL_UNIFORM_SIZE);
+}
+
+void hiz_encode(HiZ *hiz, WGPUCommandEncoder encoder, const float view_projection[4][4]) {
+    if (hiz->mip_count == 0) return;
+    memcpy(hiz->view_projection, view_projection, sizeof(hiz->view_projection));
+
+    // dispatches in one pass are ordered, each level sees the one before it
+    WGPUComputePassEncoder pass = wgpuCommandEncoderBeginComputePass(encoder, NULL);
+    wgpuComputePassEncoderSetPipeline(pass, hiz->pipeline);
+    for (uint32_t level = 0; level < hiz->mip_count; level++) {
+        uint32_t w = _mip_size(hiz->width, level);
+        uint32_t h = _mip_size(hiz->height, level);
+        wgpuComputePassEncoderSetBindGroup(pass, 0, hiz->level_bgs[level], 0, NULL);
+        wgpuComputePassEncoderDispatchWorkgroups(pass,
+                (w + HIZ_WORKGROUP_SIZE - 1) / HIZ_WORKGROUP_SIZE,
+                (h + HIZ_WORKGROUP_SIZE - 1) / HIZ_WORKGROUP_SIZE, 1);
+    }
+    wgpuComputePassEncoderEnd(pass);
+    wgpuComputePassEncoderRelease(pass);
+    hiz->valid = true;
+}
+
+void hiz_release(HiZ *hiz) {
+    _release_levels(hiz);
+    if (hiz->uniforms) wgpuBufferRelease(hiz->uniforms);
+    if (hiz->pipeline) wgpuComputePipelineRelease(hiz->pipeline);
+    if (hiz->bgl) wgpuBindGroupLayoutRelease(hiz->bgl);
+    memset(hiz, 0, sizeof(HiZ));
+}
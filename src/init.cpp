@@ -2,8 +2,6 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <webgpu.h>
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
 #include <imgui_impl_sdl3.h>
 #include <imgui_impl_wgpu.h>
 #include "constants.h"
@@ -63,164 +61,84 @@ static void _on_device_request_ended(
     }
 }
 
-static void _generate_mipmaps(WGPUDevice device, WGPUShaderModule module, WGPUSampler sampler, WGPUTexture texture, int mip_level_count) {
-    const int tex_width = wgpuTextureGetWidth(texture);
-    const int tex_height = wgpuTextureGetHeight(texture);
+static void _get_mip_level_count(const int texture_width, const int texture_height, int *mip_level_count) {
+    float max = fmaxf((float)texture_width, (float)texture_height);
+    *mip_level_count = (int)floorf(log2f(max)) + 1;
+}
 
-    WGPUBindGroupLayoutEntry bgl_entries[BG_COMP_ENTRY_COUNT] = {
+// Binding 1 is the per-object slot, read at a dynamic offset into
+// object_uniforms. Rebuilt whenever that buffer is replaced.
+WGPUBindGroup create_bind_group(State *s, WGPUBuffer object_uniforms) {
+    WGPUBindGroupEntry bg_entries[BG_ENTRY_COUNT] = {
         {
             .binding = 0,
-            .visibility = WGPUShaderStage_Compute,
-            .sampler.type = WGPUSamplerBindingType_Filtering
+            .buffer = s->ubo_frame,
+            .offset = 0,
+            .size = sizeof(UBOData_Frame)
         },
         {
             .binding = 1,
-            .visibility = WGPUShaderStage_Compute,
-            .texture = {
-                .sampleType = WGPUTextureSampleType_Float,
-                .viewDimension = WGPUTextureViewDimension_2D,
-            }
+            .buffer = object_uniforms,
+            .offset = 0,
+            .size = UBO_OBJECT_SLOT_SIZE
         },
         {
             .binding = 2,
-            .visibility = WGPUShaderStage_Compute,
-            .storageTexture = {
-                .access = WGPUStorageTextureAccess_WriteOnly,
-                .viewDimension = WGPUTextureViewDimension_2D,
-                .format = WGPUTextureFormat_RGBA8Unorm,
-            }
-        },
-        {
-            .binding = 3,
-            .visibility = WGPUShaderStage_Compute,
-            .buffer.type = WGPUBufferBindingType_Uniform,
+            .sampler = s->sampler
         }
     };
 
-    WGPUBindGroupLayoutDescriptor bgl_desc = {
-        .entryCount = BG_COMP_ENTRY_COUNT,
-        .entries = bgl_entries
+    WGPUBindGroupDescriptor bg = {
+        .nextInChain = NULL,
+        .layout = s->bgl,
+        .entryCount = BG_ENTRY_COUNT,
+        .entries = bg_entries
     };
+    return wgpuDeviceCreateBindGroup(s->device, &bg);
+}
 
-    WGPUBindGroupLayout bgl = wgpuDeviceCreateBindGroupLayout(device, &bgl_desc);
+// Sizes the swapchain and the depth buffer that goes with it.
+void configure_surface(State *s, uint32_t width, uint32_t height) {
+    if (width == 0 || height == 0) return;
+    s->width = width;
+    s->height = height;
 
-    WGPUPipelineLayoutDescriptor comp_pipeline_layout_desc = {
+    WGPUSurfaceConfiguration surface_config = {
         .nextInChain = NULL,
-        .bindGroupLayoutCount = 1,
-        .bindGroupLayouts = &bgl
-    };
-    WGPUPipelineLayout comp_pipeline_layout = wgpuDeviceCreatePipelineLayout(device, &comp_pipeline_layout_desc);
-
-    WGPUComputePipelineDescriptor comp_pipeline_desc = {
-        .compute.module = module,
-        .compute.entryPoint = {
-            .data = "main",
-            .length = WGPU_STRLEN
-        },
-        .layout = comp_pipeline_layout
+        .device = s->device,
+        .format = s->surface_format,
+        .usage = WGPUTextureUsage_RenderAttachment,
+        .width = width,
+        .height = height,
+        .viewFormatCount = 0,
+        .viewFormats = NULL,
+        .alphaMode = WGPUCompositeAlphaMode_Auto,
+        .presentMode = WGPUPresentMode_Fifo
     };
+    wgpuSurfaceConfigure(s->surface, &surface_config);
 
-    WGPUComputePipeline comp_pipeline = wgpuDeviceCreateComputePipeline(device, &comp_pipeline_desc);
-
-    WGPUQueue queue = wgpuDeviceGetQueue(device);
-
-    typedef struct UniformSrcDim{
-        int texview_src_width;
-        int texview_src_height;
-    } UniformSrcDim;
+    if (s->depth_view) wgpuTextureViewRelease(s->depth_view);
+    if (s->depth_texture) wgpuTextureRelease(s->depth_texture);
 
-    WGPUBufferDescriptor buffer_uniforms_desc = {
-        .usage = WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst,
-        .size = sizeof(UniformSrcDim),
-        .mappedAtCreation = false
+    WGPUTextureDescriptor depth_desc = {
+        .nextInChain = NULL,
+        .usage = WGPUTextureUsage_RenderAttachment | WGPUTextureUsage_TextureBinding,
+        .dimension = WGPUTextureDimension_2D,
+        .size = { width, height, 1 },
+        .format = DEPTH_FORMAT,
+        .mipLevelCount = 1,
+        .sampleCount = 1,
+        .viewFormatCount = 0,
+        .viewFormats = NULL
     };
+    s->depth_texture = wgpuDeviceCreateTexture(s->device, &depth_desc);
+    s->depth_view = wgpuTextureCreateView(s->depth_texture, NULL);
 
-    WGPUBuffer buffer_uniforms = wgpuDeviceCreateBuffer(device, &buffer_uniforms_desc);
-
-    for (int mip = 0; mip < mip_level_count - 1; mip++) {
-        WGPUTextureViewDescriptor texview_src_desc = {
-            .dimension = WGPUTextureViewDimension_2D,
-            .baseMipLevel = (uint32_t)mip,
-            .mipLevelCount = 1,
-            .baseArrayLayer = 0,
-            .arrayLayerCount = 1,
-            .aspect = WGPUTextureAspect_All
-        };
-        WGPUTextureView texview_src = wgpuTextureCreateView(texture, &texview_src_desc);
-
-        WGPUTextureViewDescriptor texview_dst_desc = texview_src_desc;
-        texview_dst_desc.baseMipLevel = mip + 1;
-        WGPUTextureView texview_dst = wgpuTextureCreateView(texture, &texview_dst_desc);
-
-        UniformSrcDim src_dim = {
-            .texview_src_width = tex_width >> (mip),
-            .texview_src_height = tex_height >> (mip)
-        };
-
-        wgpuQueueWriteBuffer(queue, buffer_uniforms, 0, &src_dim, sizeof(UniformSrcDim));
-
-        WGPUBindGroupEntry bg_entries[BG_COMP_ENTRY_COUNT] = {
-            {
-                .binding = 0,
-                .sampler = sampler,
-            },
-            {
-                .binding = 1,
-                .textureView = texview_src,
-            },
-            {
-                .binding = 2,
-                .textureView = texview_dst,
-            },
-            {
-                .binding = 3,
-                .buffer = buffer_uniforms,
-                .offset = 0,
-                .size = sizeof(UniformSrcDim)
-            }
-        };
-
-        WGPUBindGroupDescriptor bg_desc = {
-            .nextInChain = NULL,
-            .layout = bgl,
-            .entryCount = BG_COMP_ENTRY_COUNT,
-            .entries = bg_entries
-        };
-
-        WGPUBindGroup bg = wgpuDeviceCreateBindGroup(device, &bg_desc);
-
-        WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(device, NULL);
-        WGPUComputePassEncoder pass = wgpuCommandEncoderBeginComputePass(encoder, NULL);
-
-        wgpuComputePassEncoderSetPipeline(pass, comp_pipeline);
-        wgpuComputePassEncoderSetBindGroup(pass, 0, bg, 0, NULL);
-
-        int texview_dst_width = tex_width >> (mip+1);
-        int texview_dst_height = tex_height >> (mip+1);
-
-        wgpuComputePassEncoderDispatchWorkgroups(pass, texview_dst_width, texview_dst_height, 1);
-
-        wgpuComputePassEncoderEnd(pass);
-
-        WGPUCommandBuffer command_buffer = wgpuCommandEncoderFinish(encoder, NULL);
-        wgpuCommandEncoderRelease(encoder);
-
-        wgpuQueueSubmit(queue, 1, &command_buffer);
-        wgpuCommandBufferRelease(command_buffer);
-        wgpuTextureViewRelease(texview_src);
-        wgpuTextureViewRelease(texview_dst);
+    // the pyramid reads the depth buffer, it follows it on resize
+    if (s->hiz.pipeline) {
+        hiz_resize(&s->hiz, s->device, &s->uploads, s->depth_texture, width, height);
+        gpu_cull_set_hiz(&s->gpu_cull, s->device, s->hiz.view);
     }
-
-    wgpuPipelineLayoutRelease(comp_pipeline_layout);
-    wgpuBufferRelease(buffer_uniforms);
-    wgpuBindGroupLayoutRelease(bgl);
-    wgpuComputePipelineRelease(comp_pipeline);
-    wgpuQueueRelease(queue);
-}
-
-static void _get_mip_level_count(const int texture_width, const int texture_height, int *mip_level_count) {
-    float max = fmaxf((float)texture_width, (float)texture_height);
-    *mip_level_count = (int)floorf(log2f(max)) + 1;
 }
 
 // 1. Instance, adapter, device, queue
@@ -232,13 +150,15 @@ static void _get_mip_level_count(const int texture_width, const int texture_heig
 // 7. Bind groups
 // 8. Pipeline
 void initialize(State *s) {
+    const bool quantized = (MODEL_LOAD_FLAGS & MODEL_LOAD_QUANTIZE) != 0;
+
     // ========================================
     // === INSTANCE, ADAPTER, DEVICE, QUEUE ===
     // ========================================
 
     SDL_Init(SDL_INIT_VIDEO);
     //TODO: fullscreen
-    s->window = SDL_CreateWindow("a", WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_METAL);
+    s->window = SDL_CreateWindow("a", WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_METAL | SDL_WINDOW_RESIZABLE);
     s->metal_view = SDL_Metal_CreateView(s->window);
     void* metal_layer = SDL_Metal_GetLayer(s->metal_view);
 
@@ -287,8 +207,14 @@ void initialize(State *s) {
         .request_ended = false
     };
 
+    // cooked textures are uploaded as BC blocks when the adapter samples them
+    bool block_compression = u_adapter_has_feature(s->adapter, WGPUFeatureName_TextureCompressionBC);
+    WGPUFeatureName required_features[] = { WGPUFeatureName_TextureCompressionBC };
+
     WGPUDeviceDescriptor device_desc = {
         .nextInChain = NULL,
+        .requiredFeatureCount = block_compression ? 1u : 0u,
+        .requiredFeatures = required_features,
         .defaultQueue.nextInChain = NULL,
         .deviceLostCallbackInfo = {} // TODO: device lost callback
     };
@@ -307,22 +233,17 @@ void initialize(State *s) {
 
     s->queue = wgpuDeviceGetQueue(s->device);
 
+    // decoding runs on worker threads while the surface, shaders and
+    // pipelines are created below; the main loop uploads what is done
+    texture_loader_init(&s->textures, 0, block_compression);
+    s->texture_asphalt = texture_loader_request(&s->textures, PATH_TEXTURE_ASPHALT, true);
+    s->texture_explosion = texture_loader_request(&s->textures, PATH_TEXTURE_EXPLOSION, true);
+    s->texture_uvtest = texture_loader_request(&s->textures, PATH_TEXTURE_UVTEST, true);
+
     // ===============
     // === SURFACE ===
     // ===============
 
-    WGPUSurfaceConfiguration surface_config = {
-        .nextInChain = NULL,
-        .width = WINDOW_WIDTH,
-        .height = WINDOW_HEIGHT,
-        .viewFormatCount = 0,
-        .viewFormats = NULL,
-        .usage = WGPUTextureUsage_RenderAttachment,
-        .device = s->device,
-        .presentMode = WGPUPresentMode_Fifo,
-        .alphaMode = WGPUCompositeAlphaMode_Auto
-    };
-
     WGPUSurfaceCapabilities surface_capabilities = {};
     wgpuSurfaceGetCapabilities(s->surface, s->adapter, &surface_capabilities);
     WGPUTextureFormat surface_format = WGPUTextureFormat_Undefined;
@@ -331,16 +252,21 @@ void initialize(State *s) {
     }
     wgpuSurfaceCapabilitiesFreeMembers(surface_capabilities);
 
-    surface_config.format = surface_format;
-    wgpuSurfaceConfigure(s->surface, &surface_config);
+    s->surface_format = surface_format;
+
+    int pixel_width = WINDOW_WIDTH;
+    int pixel_height = WINDOW_HEIGHT;
+    SDL_GetWindowSizeInPixels(s->window, &pixel_width, &pixel_height);
+    configure_surface(s, (uint32_t)pixel_width, (uint32_t)pixel_height);
 
     // ===============
     // === SHADERS ===
     // ===============
 
     int vertex_shader_words = 0;
-    uint32_t *vertex_shader_source = NULL;;
-    u_load_spirv(PATH_SHADER_VERTEX, &vertex_shader_source, &vertex_shader_words);
+    const uint32_t *vertex_shader_source = NULL;
+    FileView vertex_shader_file;
+    u_load_spirv(quantized ? PATH_SHADER_VERTEX_QUANTIZED : PATH_SHADER_VERTEX, &vertex_shader_file, &vertex_shader_source, &vertex_shader_words);
     WGPUShaderSourceSPIRV vertex_shader = {
         .chain.next = NULL,
         .chain.sType = WGPUSType_ShaderSourceSPIRV,
@@ -351,11 +277,28 @@ void initialize(State *s) {
         .nextInChain = &vertex_shader.chain
     };
     WGPUShaderModule vertex_shader_module = wgpuDeviceCreateShaderModule(s->device, &vertex_shader_desc);
-    free(vertex_shader_source);
+    file_view_close(&vertex_shader_file);
+
+    int vertex_instanced_shader_words = 0;
+    const uint32_t *vertex_instanced_shader_source = NULL;
+    FileView vertex_instanced_shader_file;
+    u_load_spirv(quantized ? PATH_SHADER_VERTEX_QUANTIZED_INSTANCED : PATH_SHADER_VERTEX_INSTANCED, &vertex_instanced_shader_file, &vertex_instanced_shader_source, &vertex_instanced_shader_words);
+    WGPUShaderSourceSPIRV vertex_instanced_shader = {
+        .chain.next = NULL,
+        .chain.sType = WGPUSType_ShaderSourceSPIRV,
+        .codeSize = (uint32_t)vertex_instanced_shader_words,
+        .code = vertex_instanced_shader_source,
+    };
+    WGPUShaderModuleDescriptor vertex_instanced_shader_desc = {
+        .nextInChain = &vertex_instanced_shader.chain
+    };
+    WGPUShaderModule vertex_instanced_shader_module = wgpuDeviceCreateShaderModule(s->device, &vertex_instanced_shader_desc);
+    file_view_close(&vertex_instanced_shader_file);
 
     int fragment_shader_words = 0;
-    uint32_t *fragment_shader_source = NULL;
-    u_load_spirv(PATH_SHADER_FRAGMENT, &fragment_shader_source, &fragment_shader_words);
+    const uint32_t *fragment_shader_source = NULL;
+    FileView fragment_shader_file;
+    u_load_spirv(PATH_SHADER_FRAGMENT, &fragment_shader_file, &fragment_shader_source, &fragment_shader_words);
     WGPUShaderSourceSPIRV fragment_shader = {
         .chain.next = NULL,
         .chain.sType = WGPUSType_ShaderSourceSPIRV,
@@ -366,22 +309,39 @@ void initialize(State *s) {
         .nextInChain = &fragment_shader.chain
     };
     WGPUShaderModule fragment_shader_module = wgpuDeviceCreateShaderModule(s->device, &fragment_shader_desc);
-    free(fragment_shader_source);
+    file_view_close(&fragment_shader_file);
+
+    int cull_shader_words = 0;
+    const uint32_t *cull_shader_source = NULL;
+    FileView cull_shader_file;
+    u_load_spirv(PATH_SHADER_CULL, &cull_shader_file, &cull_shader_source, &cull_shader_words);
+    WGPUShaderSourceSPIRV cull_shader = {
+        .chain.next = NULL,
+        .chain.sType = WGPUSType_ShaderSourceSPIRV,
+        .codeSize = (uint32_t)cull_shader_words,
+        .code = cull_shader_source
+    };
+    WGPUShaderModuleDescriptor cull_shader_desc = {
+        .nextInChain = &cull_shader.chain
+    };
+    WGPUShaderModule cull_shader_module = wgpuDeviceCreateShaderModule(s->device, &cull_shader_desc);
+    file_view_close(&cull_shader_file);
 
-    int compute_shader_words = 0;
-    uint32_t *compute_shader_source = NULL;
-    u_load_spirv(PATH_SHADER_COMPUTE, &compute_shader_source, &compute_shader_words);
-    WGPUShaderSourceSPIRV compute_shader = {
+    int hiz_shader_words = 0;
+    const uint32_t *hiz_shader_source = NULL;
+    FileView hiz_shader_file;
+    u_load_spirv(PATH_SHADER_HIZ, &hiz_shader_file, &hiz_shader_source, &hiz_shader_words);
+    WGPUShaderSourceSPIRV hiz_shader = {
         .chain.next = NULL,
         .chain.sType = WGPUSType_ShaderSourceSPIRV,
-        .codeSize = (uint32_t)compute_shader_words,
-        .code = compute_shader_source
+        .codeSize = (uint32_t)hiz_shader_words,
+        .code = hiz_shader_source
     };
-    WGPUShaderModuleDescriptor compute_shader_desc = {
-        .nextInChain = &compute_shader.chain
+    WGPUShaderModuleDescriptor hiz_shader_desc = {
+        .nextInChain = &hiz_shader.chain
     };
-    WGPUShaderModule compute_shader_module = wgpuDeviceCreateShaderModule(s->device, &compute_shader_desc);
-    free(compute_shader_source);
+    WGPUShaderModule hiz_shader_module = wgpuDeviceCreateShaderModule(s->device, &hiz_shader_desc);
+    file_view_close(&hiz_shader_file);
 
     // ===============
     // === LAYOUTS ===
@@ -412,12 +372,12 @@ void initialize(State *s) {
         .entryCount = BG_ENTRY_COUNT,
         .entries = bgl_entries
     };
-    WGPUBindGroupLayout bgl  = wgpuDeviceCreateBindGroupLayout(s->device, &bgl_desc);
+    s->bgl = wgpuDeviceCreateBindGroupLayout(s->device, &bgl_desc);
 
     WGPUPipelineLayoutDescriptor pipeline_layout_desc = {
         .nextInChain = NULL,
         .bindGroupLayoutCount = 1,
-        .bindGroupLayouts = &(bgl)
+        .bindGroupLayouts = &(s->bgl)
     };
     WGPUPipelineLayout pipeline_layout = wgpuDeviceCreatePipelineLayout(s->device, &pipeline_layout_desc);
 
@@ -425,64 +385,16 @@ void initialize(State *s) {
     // === BUFFERS ===
     // ===============
 
-    model_load(PATH_MODEL_CAR, &s->mesh_car);
-    model_load(PATH_MODEL_CITY, &s->mesh_city);
-
-    WGPUBufferDescriptor vbo_car_desc = {
-        .nextInChain = NULL,
-        .usage = WGPUBufferUsage_Vertex | WGPUBufferUsage_CopyDst,
-        .size = s->mesh_car.vertex_count * VBO_STRIDE,
-        .mappedAtCreation = false
-    };
-    s->vbo_car = wgpuDeviceCreateBuffer(s->device, &vbo_car_desc);
-
-    wgpuQueueWriteBuffer(s->queue,
-            s->vbo_car,
-            0,
-            s->mesh_car.vertices,
-            s->mesh_car.vertex_count * VBO_STRIDE);
-
-    WGPUBufferDescriptor vbo_city_desc = {
-        .nextInChain = NULL,
-        .usage = WGPUBufferUsage_Vertex | WGPUBufferUsage_CopyDst,
-        .size = s->mesh_city.vertex_count * VBO_STRIDE,
-        .mappedAtCreation = false
-    };
-    s->vbo_city = wgpuDeviceCreateBuffer(s->device, &vbo_city_desc);
-
-    wgpuQueueWriteBuffer(s->queue,
-            s->vbo_city,
-            0,
-            s->mesh_city.vertices,
-            s->mesh_city.vertex_count * VBO_STRIDE);
+    model_load(PATH_MODEL_CAR, &s->mesh_car, MODEL_LOAD_FLAGS);
+    model_load(PATH_MODEL_CITY, &s->mesh_city, MODEL_LOAD_FLAGS);
 
-    WGPUBufferDescriptor ibo_car_desc = {
-        .nextInChain = NULL,
-        .usage = WGPUBufferUsage_Index | WGPUBufferUsage_CopyDst,
-        .size = s->mesh_car.index_count * sizeof(int),
-        .mappedAtCreation = false
-    };
-    s->ibo_car = wgpuDeviceCreateBuffer(s->device, &ibo_car_desc);
+    upload_ring_init(&s->uploads, s->instance, s->device, s->queue);
+    mipmap_generator_init(&s->mipmaps, s->device);
 
-    wgpuQueueWriteBuffer(s->queue,
-            s->ibo_car,
-            0,
-            s->mesh_car.indices,
-            s->mesh_car.index_count * sizeof(int));
-
-    WGPUBufferDescriptor ibo_city_desc = {
-        .nextInChain = NULL,
-        .usage = WGPUBufferUsage_Index | WGPUBufferUsage_CopyDst,
-        .size = s->mesh_city.index_count * sizeof(int),
-        .mappedAtCreation = false
-    };
-    s->ibo_city = wgpuDeviceCreateBuffer(s->device, &ibo_city_desc);
-
-    wgpuQueueWriteBuffer(s->queue,
-            s->ibo_city,
-            0,
-            s->mesh_city.indices,
-            s->mesh_city.index_count * sizeof(int));
+    geometry_pool_init(&s->geometry, s->device, quantized ? VBO_STRIDE_QUANTIZED : VBO_STRIDE);
+    geometry_pool_add(&s->geometry, &s->uploads, &s->mesh_car, &s->geo_car);
+    geometry_pool_add(&s->geometry, &s->uploads, &s->mesh_city, &s->geo_city);
+    upload_ring_end_frame(&s->uploads);
 
     WGPUBufferDescriptor ubo_frame_desc = {
         .nextInChain = NULL,
@@ -492,13 +404,7 @@ void initialize(State *s) {
     };
     s->ubo_frame = wgpuDeviceCreateBuffer(s->device, &ubo_frame_desc);
 
-    WGPUBufferDescriptor ubo_object_desc = {
-        .nextInChain = NULL,
-        .usage = WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst,
-        .size = UBO_OBJECT_SIZE,
-        .mappedAtCreation = false
-    };
-    s->ubo_object = wgpuDeviceCreateBuffer(s->device, &ubo_object_desc);
+    uniform_arena_init(&s->object_uniforms, s->device, UBO_OBJECT_SLOT_SIZE);
 
     // ================
     // === TEXTURES ===
@@ -517,38 +423,14 @@ void initialize(State *s) {
         .maxAnisotropy = 16
     };
 
-    WGPUSampler sampler = wgpuDeviceCreateSampler(s->device, &sampler_desc);
+    s->sampler = wgpuDeviceCreateSampler(s->device, &sampler_desc);
 
     // ===================
     // === BIND GROUPS ===
     // ===================
 
-    WGPUBindGroupEntry bg_entries[BG_ENTRY_COUNT] = {
-        {
-            .binding = 0,
-            .buffer = s->ubo_frame,
-            .offset = 0,
-            .size = sizeof(UBOData_Frame)
-        },
-        {
-            .binding = 1,
-            .buffer = s->ubo_object,
-            .offset = 0,
-            .size = UBO_OBJECT_SLOT_SIZE
-        },
-        {
-            .binding = 2,
-            .sampler = sampler
-        }
-    };
-
-    WGPUBindGroupDescriptor bg = {
-        .nextInChain = NULL,
-        .layout = bgl,
-        .entryCount = BG_ENTRY_COUNT,
-        .entries = bg_entries
-    };
-    s->bg = wgpuDeviceCreateBindGroup(s->device, &bg);
+    s->bg = create_bind_group(s, s->object_uniforms.buffer);
+    s->bg_generation = s->object_uniforms.generation;
 
     // ================
     // === PIPELINE ===
@@ -572,11 +454,48 @@ void initialize(State *s) {
         }
     };
 
+    WGPUVertexAttribute vertex_attributes_quantized[VERTEX_ATTRIBUTE_COUNT] = {
+        {
+            .format = WGPUVertexFormat_Unorm16x4,
+            .offset = 0,
+            .shaderLocation = 0,
+        },
+        {
+            .format = WGPUVertexFormat_Snorm16x2,
+            .offset = 4 * sizeof(uint16_t),
+            .shaderLocation = 1
+        },
+        {
+            .format = WGPUVertexFormat_Float16x2,
+            .offset = 6 * sizeof(uint16_t),
+            .shaderLocation = 2
+        }
+    };
+
     WGPUVertexBufferLayout vbo_car_layout = {
         .stepMode = WGPUVertexStepMode_Vertex,
-        .arrayStride = VBO_STRIDE,
+        .arrayStride = quantized ? VBO_STRIDE_QUANTIZED : VBO_STRIDE,
         .attributeCount = VERTEX_ATTRIBUTE_COUNT,
-        .attributes = vertex_attributes
+        .attributes = quantized ? vertex_attributes_quantized : vertex_attributes
+    };
+
+    WGPUVertexAttribute instance_attributes[INSTANCE_ATTRIBUTE_COUNT];
+    for (int i = 0; i < INSTANCE_ATTRIBUTE_COUNT; i++) {
+        instance_attributes[i] = (WGPUVertexAttribute){
+            .format = WGPUVertexFormat_Float32x4,
+            .offset = i * 4 * sizeof(float),
+            .shaderLocation = (uint32_t)(VERTEX_ATTRIBUTE_COUNT + i)
+        };
+    }
+
+    WGPUVertexBufferLayout vbo_instanced_layouts[2] = {
+        vbo_car_layout,
+        {
+            .stepMode = WGPUVertexStepMode_Instance,
+            .arrayStride = INSTANCE_STRIDE,
+            .attributeCount = INSTANCE_ATTRIBUTE_COUNT,
+            .attributes = instance_attributes
+        }
     };
 
     WGPUBlendState blend_state = {
@@ -606,6 +525,28 @@ void initialize(State *s) {
         .targets = &color_target,
     };
 
+    WGPUStencilFaceState stencil_face = {
+        .compare = WGPUCompareFunction_Always,
+        .failOp = WGPUStencilOperation_Keep,
+        .depthFailOp = WGPUStencilOperation_Keep,
+        .passOp = WGPUStencilOperation_Keep
+    };
+
+    // LessEqual lets the color pass pass after a prepass wrote the same depth
+    WGPUDepthStencilState depth_stencil_state = {
+        .nextInChain = NULL,
+        .format = DEPTH_FORMAT,
+        .depthWriteEnabled = WGPUOptionalBool_True,
+        .depthCompare = WGPUCompareFunction_LessEqual,
+        .stencilFront = stencil_face,
+        .stencilBack = stencil_face,
+        .stencilReadMask = 0,
+        .stencilWriteMask = 0,
+        .depthBias = 0,
+        .depthBiasSlopeScale = 0.0f,
+        .depthBiasClamp = 0.0f
+    };
+
     WGPURenderPipelineDescriptor pipeline_desc = {
         .nextInChain = NULL,
 
@@ -627,23 +568,44 @@ void initialize(State *s) {
         .fragment = &fragment_state,
 
         .layout = pipeline_layout,
-        .depthStencil = NULL,
+        .depthStencil = &depth_stencil_state,
         .multisample.count = 1,
         .multisample.mask = ~0u,
         .multisample.alphaToCoverageEnabled = false,
     };
     s->pipeline = wgpuDeviceCreateRenderPipeline(s->device, &pipeline_desc);
+
+    pipeline_desc.vertex.bufferCount = 2;
+    pipeline_desc.vertex.buffers = vbo_instanced_layouts;
+    pipeline_desc.vertex.module = vertex_instanced_shader_module;
+    s->pipeline_instanced = wgpuDeviceCreateRenderPipeline(s->device, &pipeline_desc);
+
+    pipeline_desc.fragment = NULL;
+    s->pipeline_depth_instanced = wgpuDeviceCreateRenderPipeline(s->device, &pipeline_desc);
+
+    pipeline_desc.vertex.bufferCount = 1;
+    pipeline_desc.vertex.buffers = &vbo_car_layout;
+    pipeline_desc.vertex.module = vertex_shader_module;
+    s->pipeline_depth = wgpuDeviceCreateRenderPipeline(s->device, &pipeline_desc);
     wgpuPipelineLayoutRelease(pipeline_layout);
 
+    gpu_cull_init(&s->gpu_cull, s->device, cull_shader_module);
+    hiz_init(&s->hiz, s->device, hiz_shader_module);
+    hiz_resize(&s->hiz, s->device, &s->uploads, s->depth_texture, s->width, s->height);
+    gpu_cull_set_hiz(&s->gpu_cull, s->device, s->hiz.view);
+
     ImGui::CreateContext();
     ImGui_ImplSDL3_InitForMetal(s->window);
     ImGui_ImplWGPU_InitInfo imgui_init = {};
     imgui_init.Device = s->device;
     imgui_init.NumFramesInFlight = 3;
     imgui_init.RenderTargetFormat = surface_format;
-    imgui_init.DepthStencilFormat = WGPUTextureFormat_Undefined;
+    imgui_init.DepthStencilFormat = DEPTH_FORMAT;
     ImGui_ImplWGPU_Init(&imgui_init);
 
     wgpuShaderModuleRelease(vertex_shader_module);
+    wgpuShaderModuleRelease(vertex_instanced_shader_module);
+    wgpuShaderModuleRelease(cull_shader_module);
+    wgpuShaderModuleRelease(hiz_shader_module);
     wgpuShaderModuleRelease(fragment_shader_module);
 }
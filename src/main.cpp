@@ -10,34 +10,235 @@
 #include "init.hpp"
 #include "state.h"
 
+enum BenchMode {
+    BENCH_OFF,
+    BENCH_PER_OBJECT,
+    BENCH_INSTANCED
+};
+
 typedef struct Options {
     float camera_pan;
+    int bench_mode;
+    bool depth_prepass;
+    bool gpu_culling;
+    bool occlusion_culling;
     int mag_filter;
     int min_filter;
     int mipmap_filter;
     int max_anisotropy;
 } Options;
 
-void _render_imgui(Options *o) {
+void _render_imgui(Options *o, const State *s) {
     ImGui_ImplSDL3_NewFrame();
     ImGui_ImplWGPU_NewFrame();
     ImGui::NewFrame();
 
+    ImGui::Begin("Stats");
+    ImGui::Text("%u draw calls, encoded in %.2f ms", s->stats.draw_calls, s->stats.encode_ms);
+    ImGui::Text("%u draw calls replayed from the static bundle", s->static_draw_calls);
+    ImGui::Text("%u objects visible, %u culled", s->stats.cull.visible, s->stats.cull.culled);
+    ImGui::Text("Uploaded %.1f KB last frame", s->uploads.stats.bytes_last_frame / 1024.0);
+    ImGui::Text("Upload submits %llu, stalls %llu",
+            (unsigned long long)s->uploads.stats.submits,
+            (unsigned long long)s->uploads.stats.stalls);
+    ImGui::Text("Textures %u of %u ready, %u failed, decoded in %.1f ms",
+            s->textures.stats.ready, s->textures.stats.requested,
+            s->textures.stats.failed, s->textures.stats.decode_ms);
+    ImGui::Text("Texture uploads %.1f KB, %s", s->textures.stats.bytes / 1024.0,
+            s->textures.block_compression ? "BC blocks" : "BC decoded to RGBA8");
+    ImGui::Text("%d cars benchmark", BENCH_CAR_COUNT);
+    ImGui::RadioButton("Off", &o->bench_mode, BENCH_OFF);
+    ImGui::SameLine();
+    ImGui::RadioButton("Per object", &o->bench_mode, BENCH_PER_OBJECT);
+    ImGui::SameLine();
+    ImGui::RadioButton("Instanced", &o->bench_mode, BENCH_INSTANCED);
+    ImGui::Checkbox("Depth prepass", &o->depth_prepass);
+    ImGui::Checkbox("Cull batches on the GPU", &o->gpu_culling);
+    ImGui::BeginDisabled(!o->gpu_culling);
+    ImGui::Checkbox("Occlusion cull against last frame's Hi-Z", &o->occlusion_culling);
+    ImGui::EndDisabled();
+    ImGui::End();
+
     ImGui::Render();
 }
 
-void _render(State *s) {
+// One draw per material range; submeshes are sorted by material, so the
+// ranges that share a material are adjacent.
+void _draw_submeshes(State *s, WGPURenderPassEncoder render_pass, const Mesh *mesh, const GeometryHandle *geo, uint32_t instance_count) {
+    for (size_t i = 0; i < mesh->submesh_count; i++) {
+        const Submesh *sm = &mesh->submeshes[i];
+        wgpuRenderPassEncoderDrawIndexed(render_pass, sm->index_count, instance_count,
+                geo->first_index + sm->first_index, (int32_t)geo->base_vertex, 0);
+    }
+    s->stats.draw_calls += (uint32_t)mesh->submesh_count;
+}
+
+// View space depth of each object's origin, from the w row of view_projection.
+static int _compare_view_depth(const void *a, const void *b) {
+    float da = ((const SceneObject*)a)->view_depth;
+    float db = ((const SceneObject*)b)->view_depth;
+    return (da > db) - (da < db);
+}
+
+// Opaque draws nearest first, so the depth test rejects what is behind
+// before it is shaded.
+void _sort_front_to_back(SceneObject *objects, size_t count, mat4 view_projection) {
+    for (size_t i = 0; i < count; i++) {
+        float *origin = objects[i].ubo.model[3];
+        objects[i].view_depth = view_projection[0][3] * origin[0]
+                              + view_projection[1][3] * origin[1]
+                              + view_projection[2][3] * origin[2]
+                              + view_projection[3][3];
+    }
+    qsort(objects, count, sizeof(SceneObject), _compare_view_depth);
+}
+
+static WGPURenderBundle _record_bundle(State *s, WGPURenderPipeline pipeline, bool depth_only) {
+    WGPURenderBundleEncoderDescriptor bundle_encoder_desc = {
+        .nextInChain = NULL,
+        .colorFormatCount = depth_only ? 0u : 1u,
+        .colorFormats = depth_only ? NULL : &s->surface_format,
+        .depthStencilFormat = DEPTH_FORMAT,
+        .sampleCount = 1,
+        .depthReadOnly = false,
+        .stencilReadOnly = false
+    };
+    WGPURenderBundleEncoder bundle_encoder = wgpuDeviceCreateRenderBundleEncoder(s->device, &bundle_encoder_desc);
+
+    wgpuRenderBundleEncoderSetPipeline(bundle_encoder, pipeline);
+    wgpuRenderBundleEncoderSetVertexBuffer(bundle_encoder, 0, s->geometry.vbo, 0, WGPU_WHOLE_SIZE);
+    wgpuRenderBundleEncoderSetIndexBuffer(bundle_encoder, s->geometry.ibo, WGPUIndexFormat_Uint32, 0, WGPU_WHOLE_SIZE);
+
+    for (size_t i = 0; i < s->static_object_count; i++) {
+        const SceneObject *object = &s->objects[i];
+        if (!object->visible) continue;
+        unsigned int offset = (unsigned int)(i * UBO_OBJECT_SLOT_SIZE);
+        wgpuRenderBundleEncoderSetBindGroup(bundle_encoder, 0, s->bg_static, 1, &offset);
+
+        const GeometryHandle *geo = object->geo;
+        for (size_t j = 0; j < object->mesh->submesh_count; j++) {
+            const Submesh *sm = &object->mesh->submeshes[j];
+            wgpuRenderBundleEncoderDrawIndexed(bundle_encoder, sm->index_count, 1,
+                    geo->first_index + sm->first_index, (int32_t)geo->base_vertex, 0);
+        }
+    }
+
+    WGPURenderBundle bundle = wgpuRenderBundleEncoderFinish(bundle_encoder, NULL);
+    wgpuRenderBundleEncoderRelease(bundle_encoder);
+    return bundle;
+}
+
+// Records every static object into a bundle once; replaying it costs the
+// frame one call however many draws it holds. Done again only when the
+// static set, its visibility or the geometry buffers change. The static
+// objects are sorted front to back for the camera at that time.
+void _record_static_bundle(State *s, mat4 view_projection) {
+    if (s->static_bundle) wgpuRenderBundleRelease(s->static_bundle);
+    if (s->static_depth_bundle) wgpuRenderBundleRelease(s->static_depth_bundle);
+    if (s->bg_static) wgpuBindGroupRelease(s->bg_static);
+    if (s->ubo_static) wgpuBufferRelease(s->ubo_static);
+    s->static_bundle = NULL;
+    s->static_depth_bundle = NULL;
+    s->bg_static = NULL;
+    s->ubo_static = NULL;
+    s->static_draw_calls = 0;
+    s->static_geometry_generation = s->geometry.generation;
+    s->static_dirty = false;
+    if (s->static_object_count == 0) return;
+
+    _sort_front_to_back(s->objects, s->static_object_count, view_projection);
+
+    WGPUBufferDescriptor ubo_static_desc = {
+        .nextInChain = NULL,
+        .usage = WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst,
+        .size = s->static_object_count * UBO_OBJECT_SLOT_SIZE,
+        .mappedAtCreation = false
+    };
+    s->ubo_static = wgpuDeviceCreateBuffer(s->device, &ubo_static_desc);
+    s->bg_static = create_bind_group(s, s->ubo_static);
+
+    for (size_t i = 0; i < s->static_object_count; i++) {
+        const SceneObject *object = &s->objects[i];
+        upload_ring_write(&s->uploads, s->ubo_static, i * UBO_OBJECT_SLOT_SIZE, &object->ubo, sizeof(UBOData_Object));
+        if (object->visible) s->static_draw_calls += (uint32_t)object->mesh->submesh_count;
+    }
+
+    s->static_bundle = _record_bundle(s, s->pipeline, false);
+    s->static_depth_bundle = _record_bundle(s, s->pipeline_depth, true);
+}
+
+// Everything opaque: the static bundle, then the per-frame objects and batches.
+static void _draw_scene(State *s, WGPURenderPassEncoder render_pass, WGPURenderBundle bundle,
+                        WGPURenderPipeline pipeline, WGPURenderPipeline pipeline_instanced, bool gpu_culling) {
+    // executing a bundle resets the pass state, so it goes first
+    if (bundle) {
+        wgpuRenderPassEncoderExecuteBundles(render_pass, 1, &bundle);
+    }
+
+    wgpuRenderPassEncoderSetPipeline(render_pass, pipeline);
+
+    // every mesh lives in the shared geometry buffers, bound once per pass
+    wgpuRenderPassEncoderSetVertexBuffer(render_pass, 0, s->geometry.vbo, 0, WGPU_WHOLE_SIZE);
+    wgpuRenderPassEncoderSetIndexBuffer(render_pass, s->geometry.ibo, WGPUIndexFormat_Uint32, 0, WGPU_WHOLE_SIZE);
+
+    for (size_t i = s->static_object_count; i < s->object_count; i++) {
+        const SceneObject *object = &s->objects[i];
+        unsigned int offset = uniform_arena_offset(&s->object_uniforms, object->ubo_slot);
+        wgpuRenderPassEncoderSetBindGroup(render_pass, 0, s->bg, 1, &offset);
+        _draw_submeshes(s, render_pass, object->mesh, object->geo, 1);
+    }
+
+    wgpuRenderPassEncoderSetPipeline(render_pass, pipeline_instanced);
+    for (size_t i = 0; i < s->batch_count; i++) {
+        const InstanceBatch *batch = &s->batches[i];
+        if (batch->hidden) continue;
+        unsigned int offset = uniform_arena_offset(&s->object_uniforms, batch->ubo_slot);
+        wgpuRenderPassEncoderSetBindGroup(render_pass, 0, s->bg, 1, &offset);
+        if (!gpu_culling) {
+            wgpuRenderPassEncoderSetVertexBuffer(render_pass, 1, batch->instances, 0, WGPU_WHOLE_SIZE);
+            _draw_submeshes(s, render_pass, batch->mesh, batch->geo, batch->count);
+            continue;
+        }
+
+        // the instance count comes from the cull pass, the CPU never sees it
+        const GpuCullGroup *group = &s->gpu_cull.group_info[i];
+        wgpuRenderPassEncoderSetVertexBuffer(render_pass, 1, s->gpu_cull.visible,
+                (uint64_t)group->first_instance * INSTANCE_STRIDE, (uint64_t)batch->count * INSTANCE_STRIDE);
+        for (uint32_t d = 0; d < group->draw_count; d++) {
+            wgpuRenderPassEncoderDrawIndexedIndirect(render_pass, s->gpu_cull.draws,
+                    (uint64_t)(group->first_draw + d) * GPU_CULL_DRAW_SIZE);
+        }
+        s->stats.draw_calls += group->draw_count;
+    }
+}
+
+// With depth_prepass, a depth only pass lays down the nearest surface first
+// and the color pass shades each pixel once, at the cost of a second pass
+// over the geometry. With occlusion_culling, the finished depth buffer is
+// reduced into the Hi-Z pyramid that next frame's GPU cull tests against.
+void _render(State *s, bool depth_prepass, bool gpu_culling, bool occlusion_culling, mat4 view_projection) {
     WGPUSurfaceTexture surface_texture;
     wgpuSurfaceGetCurrentTexture(s->surface, &surface_texture);
+    if (surface_texture.status == WGPUSurfaceGetCurrentTextureStatus_Outdated) {
+        configure_surface(s, s->width, s->height);
+        return;
+    }
     if (surface_texture.status != WGPUSurfaceGetCurrentTextureStatus_SuccessOptimal) {
         return;
     }
 
+    uint64_t encode_start = SDL_GetPerformanceCounter();
+    s->stats.draw_calls = 0;
+
     WGPUCommandEncoderDescriptor encoder_desc = {
         .nextInChain = NULL,
     };
     WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(s->device, &encoder_desc);
 
+    if (gpu_culling) {
+        gpu_cull_encode(&s->gpu_cull, encoder);
+    }
+
     WGPUTextureViewDescriptor view_desc = {
         .nextInChain = NULL,
         .format = wgpuTextureGetFormat(surface_texture.texture),
@@ -51,6 +252,33 @@ void _render(State *s) {
     };
     WGPUTextureView texture_view = wgpuTextureCreateView(surface_texture.texture, &view_desc);
 
+    WGPURenderPassDepthStencilAttachment depth_attachment = {
+        .view = s->depth_view,
+        .depthLoadOp = WGPULoadOp_Clear,
+        .depthStoreOp = WGPUStoreOp_Store,
+        .depthClearValue = 1.0f,
+        .depthReadOnly = false,
+        .stencilLoadOp = WGPULoadOp_Undefined,
+        .stencilStoreOp = WGPUStoreOp_Undefined,
+        .stencilClearValue = 0,
+        .stencilReadOnly = false
+    };
+
+    if (depth_prepass) {
+        WGPURenderPassDescriptor depth_pass_desc = {
+            .nextInChain = NULL,
+            .colorAttachmentCount = 0,
+            .colorAttachments = NULL,
+            .depthStencilAttachment = &depth_attachment
+        };
+        WGPURenderPassEncoder depth_pass = wgpuCommandEncoderBeginRenderPass(encoder, &depth_pass_desc);
+        _draw_scene(s, depth_pass, s->static_depth_bundle, s->pipeline_depth, s->pipeline_depth_instanced, gpu_culling);
+        wgpuRenderPassEncoderEnd(depth_pass);
+        wgpuRenderPassEncoderRelease(depth_pass);
+
+        depth_attachment.depthLoadOp = WGPULoadOp_Load;
+    }
+
     WGPURenderPassColorAttachment render_pass_color_attachment = {
         .view = texture_view,
         .resolveTarget = NULL,
@@ -63,34 +291,14 @@ void _render(State *s) {
     WGPURenderPassDescriptor render_pass_desc = {
         .nextInChain = NULL,
         .colorAttachmentCount = 1,
-        .colorAttachments = &render_pass_color_attachment
+        .colorAttachments = &render_pass_color_attachment,
+        .depthStencilAttachment = &depth_attachment
     };
 
     // begin render pass
     WGPURenderPassEncoder render_pass = wgpuCommandEncoderBeginRenderPass(encoder, &render_pass_desc);
 
-    wgpuRenderPassEncoderSetPipeline(render_pass, s->pipeline);
-
-    wgpuRenderPassEncoderSetVertexBuffer(render_pass, 0, s->vbo_car, 0, WGPU_WHOLE_SIZE);
-    wgpuRenderPassEncoderSetIndexBuffer(render_pass,
-            s->ibo_car,
-            WGPUIndexFormat_Uint32,
-            0,
-            s->mesh_car.index_count * sizeof(int));
-    unsigned int offset = 0;
-    wgpuRenderPassEncoderSetBindGroup(render_pass, 0, s->bg, 1, &offset);
-    wgpuRenderPassEncoderDrawIndexed(render_pass, s->mesh_car.index_count, 1, 0, 0, 0);
-
-    wgpuRenderPassEncoderSetVertexBuffer(render_pass, 0, s->vbo_city, 0, WGPU_WHOLE_SIZE);
-    wgpuRenderPassEncoderSetIndexBuffer(render_pass,
-            s->ibo_city,
-            WGPUIndexFormat_Uint32,
-            0,
-            s->mesh_city.index_count * sizeof(int));
-    offset = UBO_OBJECT_SLOT_SIZE;
-
-    wgpuRenderPassEncoderSetBindGroup(render_pass, 0, s->bg, 1, &offset);
-    wgpuRenderPassEncoderDrawIndexed(render_pass, s->mesh_city.index_count, 1, 0, 0, 0);
+    _draw_scene(s, render_pass, s->static_bundle, s->pipeline, s->pipeline_instanced, gpu_culling);
 
     ImGui_ImplWGPU_RenderDrawData(ImGui::GetDrawData(), render_pass);
 
@@ -98,11 +306,18 @@ void _render(State *s) {
     wgpuRenderPassEncoderEnd(render_pass);
     wgpuRenderPassEncoderRelease(render_pass);
 
+    if (gpu_culling && occlusion_culling) {
+        hiz_encode(&s->hiz, encoder, view_projection);
+    } else {
+        s->hiz.valid = false;
+    }
+
     WGPUCommandBufferDescriptor command_buffer_desc = {
         .nextInChain = NULL
     };
     WGPUCommandBuffer command_buffer = wgpuCommandEncoderFinish(encoder, &command_buffer_desc);
     wgpuCommandEncoderRelease(encoder);
+    s->stats.encode_ms = (double)(SDL_GetPerformanceCounter() - encode_start) * 1000.0 / (double)SDL_GetPerformanceFrequency();
 
     wgpuQueueSubmit(s->queue, 1, &command_buffer);
     wgpuCommandBufferRelease(command_buffer);
@@ -112,22 +327,129 @@ void _render(State *s) {
     wgpuTextureViewRelease(texture_view);
 }
 
+SceneObject *_add_object(State *s, const Mesh *mesh, const GeometryHandle *geo, vec3 position) {
+    if (s->object_count == s->object_capacity) {
+        size_t capacity = s->object_capacity ? s->object_capacity * 2 : 16;
+        SceneObject *grown = (SceneObject*)realloc(s->objects, sizeof(SceneObject) * capacity);
+        if (!grown) {
+            fprintf(stderr, "Out of memory adding a scene object\n");
+            exit(1);
+        }
+        s->objects = grown;
+        s->object_capacity = capacity;
+    }
+
+    SceneObject *object = &s->objects[s->object_count++];
+    object->mesh = mesh;
+    object->geo = geo;
+    object->ubo_slot = 0;
+    object->visible = true;
+    glm_mat4_identity(object->ubo.model);
+    glm_translate(object->ubo.model, position);
+    glm_vec4(mesh->pos_min, 0.0f, object->ubo.position_min);
+    glm_vec4(mesh->pos_extent, 0.0f, object->ubo.position_extent);
+    return object;
+}
+
+// The instance buffer is written once; batches are for meshes that do not move.
+InstanceBatch *_add_batch(State *s, const Mesh *mesh, const GeometryHandle *geo, const mat4 *models, uint32_t count) {
+    if (s->batch_count == s->batch_capacity) {
+        size_t capacity = s->batch_capacity ? s->batch_capacity * 2 : 4;
+        InstanceBatch *grown = (InstanceBatch*)realloc(s->batches, sizeof(InstanceBatch) * capacity);
+        if (!grown) {
+            fprintf(stderr, "Out of memory adding an instance batch\n");
+            exit(1);
+        }
+        s->batches = grown;
+        s->batch_capacity = capacity;
+    }
+
+    WGPUBufferDescriptor instances_desc = {
+        .nextInChain = NULL,
+        .usage = WGPUBufferUsage_Vertex | WGPUBufferUsage_CopyDst | WGPUBufferUsage_CopySrc,
+        .size = (uint64_t)count * INSTANCE_STRIDE,
+        .mappedAtCreation = false
+    };
+
+    InstanceBatch *batch = &s->batches[s->batch_count++];
+    batch->mesh = mesh;
+    batch->geo = geo;
+    batch->instances = wgpuDeviceCreateBuffer(s->device, &instances_desc);
+    batch->count = count;
+    batch->ubo_slot = 0;
+    batch->hidden = false;
+    upload_ring_write(&s->uploads, batch->instances, 0, models, (size_t)count * INSTANCE_STRIDE);
+    return batch;
+}
+
+// Tests every object's bounding sphere against the frustum. Static objects
+// keep their place and flag, a change re-records the bundle; culled dynamic
+// objects are dropped from this frame's list.
+void _cull(State *s, const float planes[6][4]) {
+    cull_set_reset(&s->cull);
+    for (size_t i = 0; i < s->object_count; i++) {
+        const SceneObject *object = &s->objects[i];
+        cull_set_add(&s->cull, object->ubo.model, object->mesh->bounds.center, object->mesh->bounds.radius);
+    }
+    cull_test(&s->cull, planes, &s->stats.cull);
+
+    for (size_t i = 0; i < s->static_object_count; i++) {
+        bool visible = s->cull.visible[i] != 0;
+        if (s->objects[i].visible != visible) s->static_dirty = true;
+        s->objects[i].visible = visible;
+    }
+    size_t kept = s->static_object_count;
+    for (size_t i = s->static_object_count; i < s->object_count; i++) {
+        if (s->cull.visible[i]) s->objects[kept++] = s->objects[i];
+    }
+    s->object_count = kept;
+}
+
 void _terminate(State *s) {
     ImGui_ImplWGPU_Shutdown();
     ImGui_ImplSDL3_Shutdown();
     ImGui::DestroyContext();
 
+    // joins the decode threads before SDL goes away
+    texture_loader_release(&s->textures);
+
     SDL_Metal_DestroyView(s->metal_view);
     SDL_DestroyWindow(s->window);
     SDL_Quit();
 
     wgpuSurfaceRelease(s->surface);
-    wgpuBufferRelease(s->vbo_car);
+    geometry_pool_release(&s->geometry);
+    uniform_arena_release(&s->object_uniforms);
+    mipmap_generator_release(&s->mipmaps);
+    upload_ring_release(&s->uploads);
+    wgpuBufferRelease(s->ubo_frame);
     wgpuBindGroupRelease(s->bg);
+    if (s->static_bundle) wgpuRenderBundleRelease(s->static_bundle);
+    if (s->static_depth_bundle) wgpuRenderBundleRelease(s->static_depth_bundle);
+    if (s->bg_static) wgpuBindGroupRelease(s->bg_static);
+    if (s->ubo_static) wgpuBufferRelease(s->ubo_static);
+    wgpuBindGroupLayoutRelease(s->bgl);
+    wgpuSamplerRelease(s->sampler);
     wgpuAdapterRelease(s->adapter);
     wgpuDeviceRelease(s->device);
     wgpuInstanceRelease(s->instance);
     wgpuRenderPipelineRelease(s->pipeline);
+    wgpuRenderPipelineRelease(s->pipeline_instanced);
+    wgpuRenderPipelineRelease(s->pipeline_depth);
+    wgpuRenderPipelineRelease(s->pipeline_depth_instanced);
+    wgpuTextureViewRelease(s->depth_view);
+    wgpuTextureRelease(s->depth_texture);
+    for (size_t i = 0; i < s->batch_count; i++) {
+        wgpuBufferRelease(s->batches[i].instances);
+    }
+    free(s->batches);
+
+    model_free(&s->mesh_car);
+    model_free(&s->mesh_city);
+    free(s->objects);
+    cull_set_release(&s->cull);
+    gpu_cull_release(&s->gpu_cull);
+    hiz_release(&s->hiz);
 }
 
 int main() {
@@ -135,6 +457,10 @@ int main() {
 
     Options o = {
         .camera_pan = 0.0,
+        .bench_mode = BENCH_OFF,
+        .depth_prepass = false,
+        .gpu_culling = false,
+        .occlusion_culling = false,
         .mag_filter = WGPUFilterMode_Linear,
         .min_filter = WGPUFilterMode_Linear,
         .mipmap_filter = WGPUMipmapFilterMode_Linear,
@@ -153,22 +479,33 @@ int main() {
 
     mat4 projection = GLM_MAT4_IDENTITY_INIT;
     float fovy = 45.0;
-    float aspect_ratio = (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT;
     float near_plane = 0.01f;
     float far_plane = 300.0f;
-    glm_perspective(fovy, aspect_ratio, near_plane, far_plane, projection);
-
-    glm_mat4_mul(projection, view, ubo_data_frame.view_projection);
 
-    UBOData_Object ubo_data_car = {
-        .model = GLM_MAT4_IDENTITY_INIT
-    };
-    glm_translate(ubo_data_car.model, (vec3){0.0, 5.0, 0.0});
+    _add_object(&s, &s.mesh_car, &s.geo_car, (vec3){0.0, 5.0, 0.0});
+    _add_object(&s, &s.mesh_city, &s.geo_city, (vec3){0.0, 0.0, 0.0});
+    s.static_object_count = s.object_count;
+    s.static_dirty = true;
+
+    // a square grid of cars, drawn either as one object each or as one batch
+    const int bench_side = (int)ceilf(sqrtf((float)BENCH_CAR_COUNT));
+    vec3 *bench_positions = (vec3*)malloc(sizeof(vec3) * BENCH_CAR_COUNT);
+    mat4 *bench_models = (mat4*)malloc(sizeof(mat4) * BENCH_CAR_COUNT);
+    for (int i = 0; i < BENCH_CAR_COUNT; i++) {
+        float x = (float)(i % bench_side - bench_side / 2) * BENCH_CAR_SPACING;
+        float z = (float)(i / bench_side - bench_side / 2) * BENCH_CAR_SPACING;
+        glm_vec3_copy((vec3){x, 5.0f, z}, bench_positions[i]);
+        glm_translate_make(bench_models[i], bench_positions[i]);
+    }
+    const size_t bench_batch = s.batch_count;
+    _add_batch(&s, &s.mesh_car, &s.geo_car, bench_models, BENCH_CAR_COUNT);
+    free(bench_models);
 
-    UBOData_Object ubo_data_city = {
-        .model = GLM_MAT4_IDENTITY_INIT
-    };
-    glm_translate(ubo_data_city.model, (vec3){0.0, 0.0, 0.0});
+    for (size_t i = 0; i < s.batch_count; i++) {
+        const InstanceBatch *batch = &s.batches[i];
+        gpu_cull_add_group(&s.gpu_cull, batch->mesh, batch->geo, batch->instances, batch->count);
+    }
+    gpu_cull_build(&s.gpu_cull, s.device, &s.uploads);
 
     uint64_t freq = SDL_GetPerformanceFrequency();
     bool running = true;
@@ -177,22 +514,74 @@ int main() {
         SDL_Event e;
         while (SDL_PollEvent(&e)) {
             if (e.type == SDL_EVENT_QUIT) running = false;
+            if (e.type == SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED) {
+                configure_surface(&s, (uint32_t)e.window.data1, (uint32_t)e.window.data2);
+            }
             ImGui_ImplSDL3_ProcessEvent(&e);
         }
+        texture_loader_poll(&s.textures, &s.uploads, &s.mipmaps);
         // calculations
 
         ubo_data_frame.time = (float)(SDL_GetPerformanceCounter() / (float)freq);
 
-        wgpuQueueWriteBuffer(s.queue, s.ubo_frame, 0, &ubo_data_frame, sizeof(UBOData_Frame));
-        wgpuQueueWriteBuffer(s.queue, s.ubo_object, 0, &ubo_data_car, sizeof(UBOData_Object));
-        wgpuQueueWriteBuffer(s.queue, s.ubo_object, UBO_OBJECT_SLOT_SIZE, &ubo_data_city, sizeof(UBOData_Object));
+        float aspect_ratio = (float)s.width / (float)s.height;
+        glm_perspective(fovy, aspect_ratio, near_plane, far_plane, projection);
+        glm_mat4_mul(projection, view, ubo_data_frame.view_projection);
+
+        s.object_count = s.static_object_count;
+        if (o.bench_mode == BENCH_PER_OBJECT) {
+            for (int i = 0; i < BENCH_CAR_COUNT; i++) {
+                _add_object(&s, &s.mesh_car, &s.geo_car, bench_positions[i]);
+            }
+        }
+        s.batches[bench_batch].hidden = o.bench_mode != BENCH_INSTANCED;
+
+        float planes[6][4];
+        cull_frustum_planes(ubo_data_frame.view_projection, planes);
+        _cull(&s, planes);
+        if (o.gpu_culling) {
+            gpu_cull_update(&s.gpu_cull, &s.uploads, planes, o.occlusion_culling ? &s.hiz : NULL);
+        }
+
+        if (s.static_dirty || s.static_geometry_generation != s.geometry.generation) {
+            _record_static_bundle(&s, ubo_data_frame.view_projection);
+        }
+        _sort_front_to_back(&s.objects[s.static_object_count], s.object_count - s.static_object_count,
+                            ubo_data_frame.view_projection);
+
+        uniform_arena_begin_frame(&s.object_uniforms);
+        for (size_t i = s.static_object_count; i < s.object_count; i++) {
+            SceneObject *object = &s.objects[i];
+            object->ubo_slot = uniform_arena_push(&s.object_uniforms, &object->ubo, sizeof(UBOData_Object));
+        }
+        for (size_t i = 0; i < s.batch_count; i++) {
+            InstanceBatch *batch = &s.batches[i];
+            if (batch->hidden) continue;
+            UBOData_Object ubo = {
+                .model = GLM_MAT4_IDENTITY_INIT
+            };
+            glm_vec4(batch->mesh->pos_min, 0.0f, ubo.position_min);
+            glm_vec4(batch->mesh->pos_extent, 0.0f, ubo.position_extent);
+            batch->ubo_slot = uniform_arena_push(&s.object_uniforms, &ubo, sizeof(UBOData_Object));
+        }
+        uniform_arena_flush(&s.object_uniforms, s.device, &s.uploads);
+        if (s.bg_generation != s.object_uniforms.generation) {
+            wgpuBindGroupRelease(s.bg);
+            s.bg = create_bind_group(&s, s.object_uniforms.buffer);
+            s.bg_generation = s.object_uniforms.generation;
+        }
+
+        upload_ring_write(&s.uploads, s.ubo_frame, 0, &ubo_data_frame, sizeof(UBOData_Frame));
+        // the copies are submitted ahead of the frame that reads them
+        upload_ring_end_frame(&s.uploads);
 
         // render
 
-        _render_imgui(&o);
+        _render_imgui(&o, &s);
 
-        _render(&s);
+        _render(&s, o.depth_prepass, o.gpu_culling, o.occlusion_culling, ubo_data_frame.view_projection);
     }
 
+    free(bench_positions);
     _terminate(&s);
 }
@@ -0,0 +1,371 @@
+#include "mesh_opt.h"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// Tipsify: P. Sander, D. Nehab, J. Barczak, "Fast Triangle Reordering for
+// Vertex Locality and Reduced Overdraw", SIGGRAPH 2007.
+
+#define MESH_OPT_NONE 0xffffffffu
+
+typedef struct Adjacency {
+    unsigned int *offsets;    // vertex_count + 1
+    unsigned int *triangles;  // triangles using each vertex, index_count
+} Adjacency;
+
+typedef struct ClusterKey {
+    float key;
+    unsigned int cluster;
+    float center[3];  // area weighted centroid
+    float normal[3];  // area weighted, not normalized
+} ClusterKey;
+
+static int _adjacency_build(const unsigned int *indices, size_t index_count, size_t vertex_count,
+                            Adjacency *adj, unsigned int *live) {
+    adj->offsets = (unsigned int*)calloc(vertex_count + 1, sizeof(unsigned int));
+    adj->triangles = (unsigned int*)malloc(sizeof(unsigned int) * (index_count ? index_count : 1));
+    if (!adj->offsets || !adj->triangles) return -1;
+
+    memset(live, 0, sizeof(unsigned int) * vertex_count);
+    for (size_t i = 0; i < index_count; i++) {
+        live[indices[i]]++;
+    }
+    unsigned int sum = 0;
+    for (size_t v = 0; v < vertex_count; v++) {
+        adj->offsets[v] = sum;
+        sum += live[v];
+    }
+    adj->offsets[vertex_count] = sum;
+
+    // offsets[v] is used as the fill cursor, then shifted back
+    for (size_t i = 0; i < index_count; i++) {
+        adj->triangles[adj->offsets[indices[i]]++] = (unsigned int)(i / 3);
+    }
+    for (size_t v = vertex_count; v > 0; v--) {
+        adj->offsets[v] = adj->offsets[v - 1];
+    }
+    adj->offsets[0] = 0;
+    return 0;
+}
+
+static void _adjacency_free(Adjacency *adj) {
+    free(adj->offsets);
+    free(adj->triangles);
+}
+
+void mesh_opt_simulate_cache(const unsigned int *indices, size_t index_count, size_t vertex_count,
+                             int cache_size, MeshCacheStats *out_stats) {
+    out_stats->acmr = 0.0f;
+    out_stats->atvr = 0.0f;
+    if (index_count < 3 || vertex_count == 0) return;
+
+    // a vertex is cached while fewer than cache_size misses happened since its own
+    unsigned int *stamps = (unsigned int*)calloc(vertex_count, sizeof(unsigned int));
+    if (!stamps) return;
+    unsigned int time = (unsigned int)cache_size + 1;
+    size_t misses = 0;
+    for (size_t i = 0; i < index_count; i++) {
+        unsigned int v = indices[i];
+        if (time - stamps[v] > (unsigned int)cache_size) {
+            stamps[v] = time++;
+            misses++;
+        }
+    }
+    free(stamps);
+
+    out_stats->acmr = (float)misses / (float)(index_count / 3);
+    out_stats->atvr = (float)misses / (float)vertex_count;
+}
+
+// Next fanning vertex: the candidate that stays in cache and has the oldest
+// entry, so its remaining triangles are emitted before it is evicted.
+static unsigned int _next_candidate(const unsigned int *candidates, size_t candidate_count,
+                                    const unsigned int *live, const unsigned int *stamps,
+                                    unsigned int time, int cache_size) {
+    unsigned int best = MESH_OPT_NONE;
+    int best_priority = -1;
+    for (size_t i = 0; i < candidate_count; i++) {
+        unsigned int v = candidates[i];
+        if (live[v] == 0) continue;
+        int priority = 0;
+        if ((int)(time - stamps[v]) + 2 * (int)live[v] <= cache_size) {
+            priority = (int)(time - stamps[v]);
+        }
+        if (priority > best_priority) {
+            best_priority = priority;
+            best = v;
+        }
+    }
+    return best;
+}
+
+static unsigned int _next_dead_end(const unsigned int *dead_ends, size_t *dead_end_count,
+                                   const unsigned int *live, size_t vertex_count, size_t *cursor) {
+    while (*dead_end_count > 0) {
+        unsigned int v = dead_ends[--(*dead_end_count)];
+        if (live[v] > 0) return v;
+    }
+    while (*cursor < vertex_count) {
+        if (live[*cursor] > 0) return (unsigned int)*cursor;
+        (*cursor)++;
+    }
+    return MESH_OPT_NONE;
+}
+
+// Writes the reordered triangles to out and the first triangle of every hard
+// cluster (a restart after a dead end) to clusters. Returns the cluster count.
+static size_t _tipsify(const unsigned int *indices, size_t index_count, size_t vertex_count,
+                       const Adjacency *adj, unsigned int *live, unsigned int *stamps,
+                       unsigned int *dead_ends, unsigned char *emitted,
+                       unsigned int *out, unsigned int *clusters, int cache_size) {
+    size_t triangle_count = index_count / 3;
+    size_t out_count = 0;
+    size_t cluster_count = 0;
+    size_t dead_end_count = 0;
+    size_t cursor = 0;
+    unsigned int time = (unsigned int)cache_size + 1;
+
+    memset(stamps, 0, sizeof(unsigned int) * vertex_count);
+    memset(emitted, 0, triangle_count);
+
+    unsigned int fan = _next_dead_end(dead_ends, &dead_end_count, live, vertex_count, &cursor);
+    while (fan != MESH_OPT_NONE) {
+        // the fan's triangles only touch their own vertices, which are the
+        // next candidates; dead_ends holds them after the loop
+        size_t candidates_begin = dead_end_count;
+        for (unsigned int a = adj->offsets[fan]; a < adj->offsets[fan + 1]; a++) {
+            unsigned int t = adj->triangles[a];
+            if (emitted[t]) continue;
+            emitted[t] = 1;
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[3 * t + k];
+                out[out_count++] = v;
+                dead_ends[dead_end_count++] = v;
+                live[v]--;
+                if (time - stamps[v] > (unsigned int)cache_size) {
+                    stamps[v] = time++;
+                }
+            }
+        }
+
+        fan = _next_candidate(dead_ends + candidates_begin, dead_end_count - candidates_begin,
+                              live, stamps, time, cache_size);
+        if (fan == MESH_OPT_NONE) {
+            fan = _next_dead_end(dead_ends, &dead_end_count, live, vertex_count, &cursor);
+            if (fan != MESH_OPT_NONE && out_count / 3 < triangle_count) {
+                clusters[cluster_count++] = (unsigned int)(out_count / 3);
+            }
+        }
+    }
+    return cluster_count;
+}
+
+// Splits each hard cluster wherever the running ACMR gets within threshold of
+// the whole cluster's, so the overdraw sort has finer pieces to move around
+// while the vertex cache efficiency stays close to Tipsify's.
+static size_t _soft_boundaries(const unsigned int *indices, size_t index_count, size_t vertex_count,
+                               const unsigned int *clusters, size_t cluster_count,
+                               unsigned int *stamps, unsigned int *out_clusters, int cache_size) {
+    size_t triangle_count = index_count / 3;
+    unsigned int time = (unsigned int)cache_size + 1;
+    size_t out_count = 0;
+
+    memset(stamps, 0, sizeof(unsigned int) * vertex_count);
+
+    for (size_t c = 0; c < cluster_count; c++) {
+        size_t begin = clusters[c];
+        size_t end = c + 1 < cluster_count ? clusters[c + 1] : triangle_count;
+
+        size_t cluster_misses = 0;
+        for (size_t i = 3 * begin; i < 3 * end; i++) {
+            if (time - stamps[indices[i]] > (unsigned int)cache_size) {
+                stamps[indices[i]] = time++;
+                cluster_misses++;
+            }
+        }
+        float limit = MESH_OPT_OVERDRAW_THRESHOLD * (float)cluster_misses / (float)(end - begin);
+        time += (unsigned int)cache_size + 1;  // flush
+
+        out_clusters[out_count++] = (unsigned int)begin;
+        size_t misses = 0;
+        size_t faces = 0;
+        for (size_t t = begin; t < end; t++) {
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[3 * t + k];
+                if (time - stamps[v] > (unsigned int)cache_size) {
+                    stamps[v] = time++;
+                    misses++;
+                }
+            }
+            faces++;
+            if (t + 1 < end && (float)misses / (float)faces <= limit) {
+                out_clusters[out_count++] = (unsigned int)(t + 1);
+                time += (unsigned int)cache_size + 1;
+                misses = 0;
+                faces = 0;
+            }
+        }
+    }
+    return out_count;
+}
+
+static const float *_position(const float *positions, size_t vertex_stride, unsigned int v) {
+    return (const float*)((const char*)positions + (size_t)v * vertex_stride);
+}
+
+static int _compare_cluster_key(const void *a, const void *b) {
+    const ClusterKey *ka = (const ClusterKey*)a;
+    const ClusterKey *kb = (const ClusterKey*)b;
+    if (ka->key != kb->key) return ka->key > kb->key ? -1 : 1;
+    return ka->cluster < kb->cluster ? -1 : (ka->cluster > kb->cluster ? 1 : 0);
+}
+
+// Sorts clusters by how far they face away from the mesh centroid; those
+// that face outward are the likeliest occluders and draw first.
+static void _sort_clusters(const unsigned int *indices, size_t triangle_count,
+                           const float *positions, size_t vertex_stride,
+                           const unsigned int *clusters, size_t cluster_count, ClusterKey *keys) {
+    double mesh_area = 0.0;
+    double mesh_center[3] = {0.0, 0.0, 0.0};
+
+    for (size_t c = 0; c < cluster_count; c++) {
+        size_t begin = clusters[c];
+        size_t end = c + 1 < cluster_count ? clusters[c + 1] : triangle_count;
+        double area = 0.0;
+        double center[3] = {0.0, 0.0, 0.0};
+        double normal[3] = {0.0, 0.0, 0.0};
+
+        for (size_t t = begin; t < end; t++) {
+            const float *p0 = _position(positions, vertex_stride, indices[3 * t + 0]);
+            const float *p1 = _position(positions, vertex_stride, indices[3 * t + 1]);
+            const float *p2 = _position(positions, vertex_stride, indices[3 * t + 2]);
+            double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            double n[3] = {
+                e1[1] * e2[2] - e1[2] * e2[1],
+                e1[2] * e2[0] - e1[0] * e2[2],
+                e1[0] * e2[1] - e1[1] * e2[0],
+            };
+            // |n| is twice the area, so n is already area weighted
+            double a = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int k = 0; k < 3; k++) {
+                center[k] += a * (p0[k] + p1[k] + p2[k]) / 3.0;
+                normal[k] += n[k];
+            }
+            area += a;
+        }
+
+        for (int k = 0; k < 3; k++) {
+            mesh_center[k] += center[k];
+            keys[c].center[k] = area > 0.0 ? (float)(center[k] / area) : 0.0f;
+            keys[c].normal[k] = (float)normal[k];
+        }
+        mesh_area += area;
+        keys[c].cluster = (unsigned int)c;
+    }
+
+    if (mesh_area > 0.0) {
+        for (int k = 0; k < 3; k++) mesh_center[k] /= mesh_area;
+    }
+
+    for (size_t c = 0; c < cluster_count; c++) {
+        const float *n = keys[c].normal;
+        float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        float dot = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            dot += (keys[c].center[k] - (float)mesh_center[k]) * n[k];
+        }
+        keys[c].key = len > 0.0f ? dot / len : 0.0f;
+    }
+
+    qsort(keys, cluster_count, sizeof(ClusterKey), _compare_cluster_key);
+}
+
+int mesh_opt_reorder_triangles(unsigned int *indices, size_t index_count,
+                               const float *positions, size_t vertex_count, size_t vertex_stride) {
+    size_t triangle_count = index_count / 3;
+    if (triangle_count == 0 || vertex_count == 0) return 0;
+
+    Adjacency adj = {NULL, NULL};
+    unsigned int *live = (unsigned int*)malloc(sizeof(unsigned int) * vertex_count);
+    unsigned int *stamps = (unsigned int*)malloc(sizeof(unsigned int) * vertex_count);
+    unsigned int *dead_ends = (unsigned int*)malloc(sizeof(unsigned int) * index_count);
+    unsigned char *emitted = (unsigned char*)malloc(triangle_count);
+    unsigned int *tipsified = (unsigned int*)malloc(sizeof(unsigned int) * index_count);
+    // the first cluster starts at 0, every restart adds one
+    unsigned int *hard = (unsigned int*)malloc(sizeof(unsigned int) * (triangle_count + 1));
+    unsigned int *soft = (unsigned int*)malloc(sizeof(unsigned int) * (triangle_count + 1));
+    ClusterKey *keys = (ClusterKey*)malloc(sizeof(ClusterKey) * (triangle_count + 1));
+
+    int ret = -1;
+    if (!live || !stamps || !dead_ends || !emitted || !tipsified || !hard || !soft || !keys) goto done;
+    if (_adjacency_build(indices, index_count, vertex_count, &adj, live) != 0) goto done;
+
+    {
+        hard[0] = 0;
+        size_t hard_count = 1 + _tipsify(indices, index_count, vertex_count, &adj, live, stamps,
+                                         dead_ends, emitted, tipsified, hard + 1, MESH_OPT_CACHE_SIZE);
+        size_t soft_count = _soft_boundaries(tipsified, index_count, vertex_count, hard, hard_count,
+                                             stamps, soft, MESH_OPT_CACHE_SIZE);
+        _sort_clusters(tipsified, triangle_count, positions, vertex_stride, soft, soft_count, keys);
+
+        size_t out = 0;
+        for (size_t c = 0; c < soft_count; c++) {
+            unsigned int cluster = keys[c].cluster;
+            size_t begin = soft[cluster];
+            size_t end = cluster + 1 < soft_count ? soft[cluster + 1] : triangle_count;
+            memcpy(indices + out, tipsified + 3 * begin, sizeof(unsigned int) * 3 * (end - begin));
+            out += 3 * (end - begin);
+        }
+    }
+    ret = 0;
+
+done:
+    _adjacency_free(&adj);
+    free(live);
+    free(stamps);
+    free(dead_ends);
+    free(emitted);
+    free(tipsified);
+    free(hard);
+    free(soft);
+    free(keys);
+    return ret;
+}
+
+int mesh_opt_reorder_vertices(unsigned int *indices, size_t index_count,
+                              void *vertices, size_t vertex_count, size_t vertex_stride) {
+    if (vertex_count == 0) return 0;
+
+    unsigned int *remap = (unsigned int*)malloc(sizeof(unsigned int) * vertex_count);
+    char *reordered = (char*)malloc(vertex_stride * vertex_count);
+    if (!remap || !reordered) {
+        free(remap);
+        free(reordered);
+        return -1;
+    }
+    memset(remap, 0xff, sizeof(unsigned int) * vertex_count);
+
+    unsigned int next = 0;
+    for (size_t i = 0; i < index_count; i++) {
+        unsigned int v = indices[i];
+        if (remap[v] == MESH_OPT_NONE) {
+            remap[v] = next++;
+        }
+        indices[i] = remap[v];
+    }
+    // unreferenced vertices keep their relative order at the end
+    for (size_t v = 0; v < vertex_count; v++) {
+        if (remap[v] == MESH_OPT_NONE) remap[v] = next++;
+    }
+
+    for (size_t v = 0; v < vertex_count; v++) {
+        memcpy(reordered + (size_t)remap[v] * vertex_stride, (const char*)vertices + v * vertex_stride, vertex_stride);
+    }
+    // vertices may live in a private file mapping, so copy back rather than swap
+    memcpy(vertices, reordered, vertex_stride * vertex_count);
+
+    free(remap);
+    free(reordered);
+    return 0;
+}
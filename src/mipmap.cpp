@@ -0,0 +1,484 @@
+#include "mipmap.h"
+#include <stdio.h>
+#include <string.h>
+#include "constants.h"
+#include "util.hpp"
+
+typedef struct MipmapFormat {
+    WGPUTextureFormat format;
+    const char *shader_path;  // compute.glsl built for the format, NULL to render
+} MipmapFormat;
+
+static const MipmapFormat _formats[] = {
+    { WGPUTextureFormat_RGBA8Unorm, PATH_SHADER_MIPMAP_RGBA8 },
+    { WGPUTextureFormat_RGBA16Float, PATH_SHADER_MIPMAP_RGBA16F },
+    { WGPUTextureFormat_RGBA8UnormSrgb, NULL },
+    { WGPUTextureFormat_R8Unorm, NULL },
+    { WGPUTextureFormat_RG8Unorm, NULL },
+};
+
+typedef struct MipmapDispatch {
+    const MipmapPipeline *pipeline;
+    size_t texture;
+    uint32_t base;
+    MipmapUniforms uniforms;
+} MipmapDispatch;
+
+void mipmap_generator_init(MipmapGenerator *gen, WGPUDevice device) {
+    memset(gen, 0, sizeof(MipmapGenerator));
+    gen->device = device;
+}
+
+static WGPUShaderModule _load_module(WGPUDevice device, const char *path) {
+    int shader_words = 0;
+    const uint32_t *shader_source = NULL;
+    FileView shader_file;
+    u_load_spirv(path, &shader_file, &shader_source, &shader_words);
+    if (!shader_source) return NULL;
+    WGPUShaderSourceSPIRV shader = {
+        .chain.next = NULL,
+        .chain.sType = WGPUSType_ShaderSourceSPIRV,
+        .codeSize = (uint32_t)shader_words,
+        .code = shader_source
+    };
+    WGPUShaderModuleDescriptor shader_desc = {
+        .nextInChain = &shader.chain
+    };
+    WGPUShaderModule module = wgpuDeviceCreateShaderModule(device, &shader_desc);
+    file_view_close(&shader_file);
+    return module;
+}
+
+static WGPUPipelineLayout _create_layout(WGPUDevice device, MipmapPipeline *p,
+                                         const WGPUBindGroupLayoutEntry *entries, size_t entry_count) {
+    WGPUBindGroupLayoutDescriptor bgl_desc = {
+        .nextInChain = NULL,
+        .entryCount = entry_count,
+        .entries = entries
+    };
+    p->bgl = wgpuDeviceCreateBindGroupLayout(device, &bgl_desc);
+
+    WGPUPipelineLayoutDescriptor pipeline_layout_desc = {
+        .nextInChain = NULL,
+        .bindGroupLayoutCount = 1,
+        .bindGroupLayouts = &p->bgl
+    };
+    return wgpuDeviceCreatePipelineLayout(device, &pipeline_layout_desc);
+}
+
+static const WGPUBindGroupLayoutEntry _source_entry = {
+    .binding = 0,
+    .visibility = WGPUShaderStage_Compute | WGPUShaderStage_Fragment,
+    .texture = {
+        .sampleType = WGPUTextureSampleType_UnfilterableFloat,
+        .viewDimension = WGPUTextureViewDimension_2D,
+    }
+};
+
+static WGPUBindGroupLayoutEntry _uniform_entry(uint32_t binding) {
+    WGPUBindGroupLayoutEntry entry = {
+        .binding = binding,
+        .visibility = WGPUShaderStage_Compute | WGPUShaderStage_Fragment,
+        .buffer = {
+            .type = WGPUBufferBindingType_Uniform,
+            .hasDynamicOffset = true,
+            .minBindingSize = sizeof(MipmapUniforms)
+        }
+    };
+    return entry;
+}
+
+static bool _create_compute(WGPUDevice device, MipmapPipeline *p, const char *shader_path) {
+    WGPUShaderModule module = _load_module(device, shader_path);
+    if (!module) return false;
+
+    WGPUBindGroupLayoutEntry bgl_entries[MIPMAP_ENTRY_COUNT];
+    bgl_entries[0] = _source_entry;
+    for (int i = 0; i < MIPMAP_LEVELS_PER_DISPATCH; i++) {
+        bgl_entries[1 + i] = {
+            .binding = (uint32_t)(1 + i),
+            .visibility = WGPUShaderStage_Compute,
+            .storageTexture = {
+                .access = WGPUStorageTextureAccess_WriteOnly,
+                .format = p->format,
+                .viewDimension = WGPUTextureViewDimension_2D,
+            }
+        };
+    }
+    bgl_entries[MIPMAP_ENTRY_COUNT - 1] = _uniform_entry(MIPMAP_ENTRY_COUNT - 1);
+    WGPUPipelineLayout pipeline_layout = _create_layout(device, p, bgl_entries, MIPMAP_ENTRY_COUNT);
+
+    WGPUComputePipelineDescriptor pipeline_desc = {
+        .nextInChain = NULL,
+        .layout = pipeline_layout,
+        .compute.module = module,
+        .compute.entryPoint = {
+            .data = "main",
+            .length = WGPU_STRLEN
+        }
+    };
+    p->pipeline = wgpuDeviceCreateComputePipeline(device, &pipeline_desc);
+    wgpuPipelineLayoutRelease(pipeline_layout);
+    wgpuShaderModuleRelease(module);
+
+    WGPUTextureDescriptor dummy_desc = {
+        .nextInChain = NULL,
+        .usage = WGPUTextureUsage_StorageBinding,
+        .dimension = WGPUTextureDimension_2D,
+        .size = { 1, 1, 1 },
+        .format = p->format,
+        .mipLevelCount = 1,
+        .sampleCount = 1,
+        .viewFormatCount = 0,
+        .viewFormats = NULL
+    };
+    p->dummy = wgpuDeviceCreateTexture(device, &dummy_desc);
+    p->dummy_view = wgpuTextureCreateView(p->dummy, NULL);
+    return true;
+}
+
+static bool _create_render(WGPUDevice device, MipmapPipeline *p) {
+    WGPUShaderModule vertex_module = _load_module(device, PATH_SHADER_DOWNSAMPLE_VERTEX);
+    WGPUShaderModule fragment_module = _load_module(device, PATH_SHADER_DOWNSAMPLE_FRAGMENT);
+    if (!vertex_module || !fragment_module) {
+        if (vertex_module) wgpuShaderModuleRelease(vertex_module);
+        if (fragment_module) wgpuShaderModuleRelease(fragment_module);
+        return false;
+    }
+
+    WGPUBindGroupLayoutEntry bgl_entries[MIPMAP_RENDER_ENTRY_COUNT] = {
+        _source_entry,
+        _uniform_entry(1)
+    };
+    WGPUPipelineLayout pipeline_layout = _create_layout(device, p, bgl_entries, MIPMAP_RENDER_ENTRY_COUNT);
+
+    WGPUColorTargetState color_target = {
+        .format = p->format,
+        .blend = NULL,
+        .writeMask = WGPUColorWriteMask_All
+    };
+
+    WGPUFragmentState fragment_state = {
+        .module = fragment_module,
+        .entryPoint = {
+            .data = "main",
+            .length = WGPU_STRLEN
+        },
+        .constantCount = 0,
+        .constants = NULL,
+        .targetCount = 1,
+        .targets = &color_target,
+    };
+
+    WGPURenderPipelineDescriptor pipeline_desc = {
+        .nextInChain = NULL,
+        .layout = pipeline_layout,
+
+        .vertex.module = vertex_module,
+        .vertex.entryPoint = {
+            .data = "main",
+            .length = WGPU_STRLEN
+        },
+        .vertex.constantCount = 0,
+        .vertex.constants = NULL,
+        .vertex.bufferCount = 0,
+        .vertex.buffers = NULL,
+
+        .primitive.topology = WGPUPrimitiveTopology_TriangleList,
+        .primitive.stripIndexFormat = WGPUIndexFormat_Undefined,
+        .primitive.frontFace = WGPUFrontFace_CCW,
+        .primitive.cullMode = WGPUCullMode_None,
+
+        .depthStencil = NULL,
+        .multisample.count = 1,
+        .multisample.mask = ~0u,
+        .multisample.alphaToCoverageEnabled = false,
+
+        .fragment = &fragment_state,
+    };
+    p->render_pipeline = wgpuDeviceCreateRenderPipeline(device, &pipeline_desc);
+    wgpuPipelineLayoutRelease(pipeline_layout);
+    wgpuShaderModuleRelease(vertex_module);
+    wgpuShaderModuleRelease(fragment_module);
+    return true;
+}
+
+static const MipmapPipeline *_create_pipeline(MipmapGenerator *gen, const MipmapFormat *format) {
+    if (gen->pipeline_count == MIPMAP_MAX_FORMATS) return NULL;
+
+    MipmapPipeline *p = &gen->pipelines[gen->pipeline_count];
+    memset(p, 0, sizeof(MipmapPipeline));
+    p->format = format->format;
+    bool created = format->shader_path ? _create_compute(gen->device, p, format->shader_path)
+                                       : _create_render(gen->device, p);
+    if (!created) return NULL;
+    gen->pipeline_count++;
+    return p;
+}
+
+// The cached pipeline for a format, NULL if it is not supported.
+static const MipmapPipeline *_pipeline(MipmapGenerator *gen, WGPUTextureFormat format) {
+    for (size_t i = 0; i < gen->pipeline_count; i++) {
+        if (gen->pipelines[i].format == format) return &gen->pipelines[i];
+    }
+    for (size_t i = 0; i < sizeof(_formats) / sizeof(_formats[0]); i++) {
+        if (_formats[i].format == format) return _create_pipeline(gen, &_formats[i]);
+    }
+    return NULL;
+}
+
+static uint32_t _mip_size(uint32_t size, uint32_t level) {
+    uint32_t s = size >> level;
+    return s ? s : 1;
+}
+
+// A level can feed the next one inside the same dispatch only if it halves
+// exactly, otherwise the next level's footprint crosses workgroup tiles.
+static bool _halves_exactly(uint32_t width, uint32_t height) {
+    return (width == 1 || width % 2 == 0) && (height == 1 || height % 2 == 0);
+}
+
+// Splits a chain into dispatches of up to max_levels levels.
+static size_t _plan(MipmapDispatch *out, const MipmapPipeline *pipeline, size_t texture,
+                    uint32_t width, uint32_t height, uint32_t mip_count, int32_t max_levels) {
+    size_t count = 0;
+    for (uint32_t mip = 0; mip < mip_count - 1; count++) {
+        MipmapDispatch *d = &out[count];
+        memset(d, 0, sizeof(MipmapDispatch));
+        d->pipeline = pipeline;
+        d->texture = texture;
+        d->base = mip;
+        MipmapUniforms *u = &d->uniforms;
+        u->src_size[0] = (int32_t)_mip_size(width, mip);
+        u->src_size[1] = (int32_t)_mip_size(height, mip);
+        do {
+            u->dst_size[u->level_count][0] = (int32_t)_mip_size(width, mip + 1);
+            u->dst_size[u->level_count][1] = (int32_t)_mip_size(height, mip + 1);
+            u->level_count++;
+            mip++;
+        } while (u->level_count < max_levels && mip < mip_count - 1
+                 && _halves_exactly(_mip_size(width, mip), _mip_size(height, mip)));
+    }
+    return count;
+}
+
+static WGPUBindGroup _create_bind_group(WGPUDevice device, WGPUBindGroupLayout bgl,
+                                        const WGPUBindGroupEntry *entries, size_t entry_count) {
+    WGPUBindGroupDescriptor bg_desc = {
+        .nextInChain = NULL,
+        .layout = bgl,
+        .entryCount = entry_count,
+        .entries = entries
+    };
+    return wgpuDeviceCreateBindGroup(device, &bg_desc);
+}
+
+static void _reserve_uniforms(MipmapGenerator *gen, uint32_t dispatch_count) {
+    if (dispatch_count <= gen->uniform_capacity) return;
+    uint32_t capacity = gen->uniform_capacity ? gen->uniform_capacity : 16;
+    while (capacity < dispatch_count) capacity *= 2;
+
+    if (gen->uniforms) wgpuBufferRelease(gen->uniforms);
+    WGPUBufferDescriptor uniforms_desc = {
+        .nextInChain = NULL,
+        .usage = WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst,
+        .size = (uint64_t)capacity * MIPMAP_UNIFORM_STRIDE,
+        .mappedAtCreation = false
+    };
+    gen->uniforms = wgpuDeviceCreateBuffer(gen->device, &uniforms_desc);
+    gen->uniform_capacity = capacity;
+}
+
+size_t mipmap_generate(MipmapGenerator *gen, UploadRing *ring, const WGPUTexture *textures, size_t count) {
+    if (count == 0) return 0;
+
+    MipmapDispatch *dispatches = (MipmapDispatch*)malloc(sizeof(MipmapDispatch) * count * (MIPMAP_MAX_LEVELS - 1));
+    WGPUTextureView *views = (WGPUTextureView*)calloc(count * MIPMAP_MAX_LEVELS, sizeof(WGPUTextureView));
+    if (!dispatches || !views) {
+        fprintf(stderr, "Out of memory generating mipmaps\n");
+        exit(1);
+    }
+
+    size_t dispatch_count = 0;
+    size_t generated = 0;
+    for (size_t t = 0; t < count; t++) {
+        uint32_t mip_count = wgpuTextureGetMipLevelCount(textures[t]);
+        if (mip_count < 2) continue;
+        if (mip_count > MIPMAP_MAX_LEVELS) mip_count = MIPMAP_MAX_LEVELS;
+
+        WGPUTextureFormat format = wgpuTextureGetFormat(textures[t]);
+        const MipmapPipeline *pipeline = _pipeline(gen, format);
+        if (!pipeline) {
+            fprintf(stderr, "No mipmap pipeline for texture format 0x%x\n", (unsigned)format);
+            continue;
+        }
+        WGPUTextureUsage usage = wgpuTextureGetUsage(textures[t]);
+        WGPUTextureUsage needed = WGPUTextureUsage_TextureBinding
+                                | (pipeline->pipeline ? WGPUTextureUsage_StorageBinding : WGPUTextureUsage_RenderAttachment);
+        if ((usage & needed) != needed) {
+            fprintf(stderr, "Texture lacks the usage to generate its mipmaps\n");
+            continue;
+        }
+
+        for (uint32_t mip = 0; mip < mip_count; mip++) {
+            WGPUTextureViewDescriptor view_desc = {
+                .nextInChain = NULL,
+                .format = format,
+                .dimension = WGPUTextureViewDimension_2D,
+                .baseMipLevel = mip,
+                .mipLevelCount = 1,
+                .baseArrayLayer = 0,
+                .arrayLayerCount = 1,
+                .aspect = WGPUTextureAspect_All,
+                .usage = needed
+            };
+            views[t * MIPMAP_MAX_LEVELS + mip] = wgpuTextureCreateView(textures[t], &view_desc);
+        }
+        dispatch_count += _plan(&dispatches[dispatch_count], pipeline, t,
+                                wgpuTextureGetWidth(textures[t]), wgpuTextureGetHeight(textures[t]), mip_count,
+                                pipeline->pipeline ? MIPMAP_LEVELS_PER_DISPATCH : 1);
+        generated++;
+    }
+
+    if (dispatch_count > 0) {
+        // every dispatch's uniforms go up in one write
+        _reserve_uniforms(gen, (uint32_t)dispatch_count);
+        uint8_t *staged = (uint8_t*)calloc(dispatch_count, MIPMAP_UNIFORM_STRIDE);
+        if (!staged) {
+            fprintf(stderr, "Out of memory generating mipmaps\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < dispatch_count; i++) {
+            memcpy(&staged[i * MIPMAP_UNIFORM_STRIDE], &dispatches[i].uniforms, sizeof(MipmapUniforms));
+        }
+        upload_ring_write(ring, gen->uniforms, 0, staged, dispatch_count * MIPMAP_UNIFORM_STRIDE);
+        upload_ring_submit(ring);
+        free(staged);
+
+        WGPUBindGroup *bgs = (WGPUBindGroup*)malloc(sizeof(WGPUBindGroup) * dispatch_count);
+        if (!bgs) {
+            fprintf(stderr, "Out of memory generating mipmaps\n");
+            exit(1);
+        }
+
+        WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(gen->device, NULL);
+
+        // every storage bound chain shares one compute pass
+        WGPUComputePassEncoder pass = NULL;
+        const MipmapPipeline *bound = NULL;
+        for (size_t i = 0; i < dispatch_count; i++) {
+            const MipmapDispatch *d = &dispatches[i];
+            if (!d->pipeline->pipeline) continue;
+            const WGPUTextureView *level_views = &views[d->texture * MIPMAP_MAX_LEVELS];
+
+            WGPUBindGroupEntry bg_entries[MIPMAP_ENTRY_COUNT] = {
+                {
+                    .binding = 0,
+                    .textureView = level_views[d->base],
+                }
+            };
+            for (int level = 0; level < MIPMAP_LEVELS_PER_DISPATCH; level++) {
+                bg_entries[1 + level] = {
+                    .binding = (uint32_t)(1 + level),
+                    .textureView = level < d->uniforms.level_count ? level_views[d->base + 1 + level]
+                                                                   : d->pipeline->dummy_view,
+                };
+            }
+            bg_entries[MIPMAP_ENTRY_COUNT - 1] = {
+                .binding = MIPMAP_ENTRY_COUNT - 1,
+                .buffer = gen->uniforms,
+                .offset = 0,
+                .size = sizeof(MipmapUniforms)
+            };
+            bgs[i] = _create_bind_group(gen->device, d->pipeline->bgl, bg_entries, MIPMAP_ENTRY_COUNT);
+
+            if (!pass) pass = wgpuCommandEncoderBeginComputePass(encoder, NULL);
+            if (bound != d->pipeline) {
+                wgpuComputePassEncoderSetPipeline(pass, d->pipeline->pipeline);
+                bound = d->pipeline;
+            }
+            uint32_t dynamic_offset = (uint32_t)i * MIPMAP_UNIFORM_STRIDE;
+            wgpuComputePassEncoderSetBindGroup(pass, 0, bgs[i], 1, &dynamic_offset);
+            wgpuComputePassEncoderDispatchWorkgroups(pass,
+                    ((uint32_t)d->uniforms.dst_size[0][0] + MIPMAP_WORKGROUP_SIZE - 1) / MIPMAP_WORKGROUP_SIZE,
+                    ((uint32_t)d->uniforms.dst_size[0][1] + MIPMAP_WORKGROUP_SIZE - 1) / MIPMAP_WORKGROUP_SIZE, 1);
+        }
+        if (pass) {
+            wgpuComputePassEncoderEnd(pass);
+            wgpuComputePassEncoderRelease(pass);
+        }
+
+        // the rest render a level per pass, in chain order
+        for (size_t i = 0; i < dispatch_count; i++) {
+            const MipmapDispatch *d = &dispatches[i];
+            if (d->pipeline->pipeline) continue;
+            const WGPUTextureView *level_views = &views[d->texture * MIPMAP_MAX_LEVELS];
+
+            WGPUBindGroupEntry bg_entries[MIPMAP_RENDER_ENTRY_COUNT] = {
+                {
+                    .binding = 0,
+                    .textureView = level_views[d->base],
+                },
+                {
+                    .binding = 1,
+                    .buffer = gen->uniforms,
+                    .offset = 0,
+                    .size = sizeof(MipmapUniforms)
+                }
+            };
+            bgs[i] = _create_bind_group(gen->device, d->pipeline->bgl, bg_entries, MIPMAP_RENDER_ENTRY_COUNT);
+
+            WGPURenderPassColorAttachment color_attachment = {
+                .view = level_views[d->base + 1],
+                .depthSlice = WGPU_DEPTH_SLICE_UNDEFINED,
+                .resolveTarget = NULL,
+                .loadOp = WGPULoadOp_Clear,
+                .storeOp = WGPUStoreOp_Store,
+                .clearValue = WGPUColor{ 0.0, 0.0, 0.0, 0.0 }
+            };
+            WGPURenderPassDescriptor render_pass_desc = {
+                .nextInChain = NULL,
+                .colorAttachmentCount = 1,
+                .colorAttachments = &color_attachment,
+                .depthStencilAttachment = NULL
+            };
+            WGPURenderPassEncoder render_pass = wgpuCommandEncoderBeginRenderPass(encoder, &render_pass_desc);
+            wgpuRenderPassEncoderSetPipeline(render_pass, d->pipeline->render_pipeline);
+            uint32_t dynamic_offset = (uint32_t)i * MIPMAP_UNIFORM_STRIDE;
+            wgpuRenderPassEncoderSetBindGroup(render_pass, 0, bgs[i], 1, &dynamic_offset);
+            wgpuRenderPassEncoderDraw(render_pass, 3, 1, 0, 0);
+            wgpuRenderPassEncoderEnd(render_pass);
+            wgpuRenderPassEncoderRelease(render_pass);
+        }
+
+        WGPUCommandBuffer command_buffer = wgpuCommandEncoderFinish(encoder, NULL);
+        wgpuCommandEncoderRelease(encoder);
+        wgpuQueueSubmit(ring->queue, 1, &command_buffer);
+        wgpuCommandBufferRelease(command_buffer);
+
+        for (size_t i = 0; i < dispatch_count; i++) {
+            wgpuBindGroupRelease(bgs[i]);
+        }
+        free(bgs);
+    }
+
+    for (size_t i = 0; i < count * MIPMAP_MAX_LEVELS; i++) {
+        if (views[i]) wgpuTextureViewRelease(views[i]);
+    }
+    free(views);
+    free(dispatches);
+    return generated;
+}
+
+void mipmap_generator_release(MipmapGenerator *gen) {
+    for (size_t i = 0; i < gen->pipeline_count; i++) {
+        MipmapPipeline *p = &gen->pipelines[i];
+        if (p->dummy_view) wgpuTextureViewRelease(p->dummy_view);
+        if (p->dummy) wgpuTextureRelease(p->dummy);
+        if (p->pipeline) wgpuComputePipelineRelease(p->pipeline);
+        if (p->render_pipeline) wgpuRenderPipelineRelease(p->render_pipeline);
+        wgpuBindGroupLayoutRelease(p->bgl);
+    }
+    if (gen->uniforms) wgpuBufferRelease(gen->uniforms);
+    memset(gen, 0, sizeof(MipmapGenerator));
+}
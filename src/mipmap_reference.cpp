@@ -0,0 +1,53 @@
+#include "mipmap.h"
+#include <math.h>
+
+// Kept apart from the GPU generator so tools can link it without a device.
+
+// Same footprint as downsample.glsl: two texels per axis for an even size,
+// three with box weights for an odd one.
+static uint32_t _footprint(uint32_t x, uint32_t src_size, uint32_t dst_size, float weights[3]) {
+    if (src_size == 1) {
+        weights[0] = 1.0f;
+        return 1;
+    }
+    if (src_size % 2 == 0) {
+        weights[0] = 0.5f;
+        weights[1] = 0.5f;
+        return 2;
+    }
+    float n = (float)dst_size;
+    weights[0] = (n - (float)x) / (2.0f * n + 1.0f);
+    weights[1] = n / (2.0f * n + 1.0f);
+    weights[2] = ((float)x + 1.0f) / (2.0f * n + 1.0f);
+    return 3;
+}
+
+void mipmap_downsample_reference(const float *src, uint32_t width, uint32_t height,
+                                 uint32_t channels, float *dst) {
+    uint32_t dst_width = width > 1 ? width / 2 : 1;
+    uint32_t dst_height = height > 1 ? height / 2 : 1;
+    for (uint32_t y = 0; y < dst_height; y++) {
+        float wy[3];
+        uint32_t ny = _footprint(y, height, dst_height, wy);
+        for (uint32_t x = 0; x < dst_width; x++) {
+            float wx[3];
+            uint32_t nx = _footprint(x, width, dst_width, wx);
+            float *out = &dst[((size_t)y * dst_width + x) * channels];
+            for (uint32_t c = 0; c < channels; c++) out[c] = 0.0f;
+            for (uint32_t j = 0; j < ny; j++) {
+                for (uint32_t i = 0; i < nx; i++) {
+                    const float *in = &src[((size_t)(2 * y + j) * width + 2 * x + i) * channels];
+                    for (uint32_t c = 0; c < channels; c++) out[c] += wx[i] * wy[j] * in[c];
+                }
+            }
+        }
+    }
+}
+
+float mipmap_srgb_to_linear(float c) {
+    return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float mipmap_linear_to_srgb(float c) {
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+}
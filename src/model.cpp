@@ -1,110 +1,625 @@
 #include "model.h"
+#include "file_view.h"
+#include "mesh_opt.h"
+#include "vertex_quant.h"
+#include <math.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #define TINYOBJ_LOADER_C_IMPLEMENTATION
 #include "tinyobj_loader_c.h"
 
+#define MODEL_EMPTY_SLOT 0xffffffffu
+#define MODEL_VERTEX_FLOATS 8
+#define MODEL_MAX_READ_FILES 4
+#define MODEL_MAX_MTL_FILES (MODEL_MAX_READ_FILES - 1)
+#define MODEL_CACHE_PATH_MAX 256
+
+// A .mtl the mesh was built from, as the obj names it. size is -1 if it did
+// not exist, so the cache also goes stale when it shows up.
+typedef struct MeshCacheSource {
+    char path[MODEL_CACHE_PATH_MAX];
+    int64_t size;
+    int64_t mtime_ns;
+    uint64_t hash;
+} MeshCacheSource;
+
+// On-disk layout of a mesh cache: this header, then vertex_count interleaved
+// vertices at vertex_offset, index_count uint32 indices at index_offset and
+// submesh_count Submesh at submesh_offset.
+typedef struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertex_stride;
+    uint32_t flags;  // MODEL_LOAD_* flags the mesh was built with
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+    uint64_t source_hash;
+    uint64_t cold_load_ns;
+    uint64_t vertex_count;
+    uint64_t index_count;
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    float pos_min[3];
+    float pos_extent[3];
+    Bounds bounds;
+    uint64_t submesh_count;
+    uint64_t submesh_offset;
+    uint64_t mtl_count;
+    MeshCacheSource mtl[MODEL_MAX_MTL_FILES];
+} MeshCacheHeader;
+
+static const char MODEL_CACHE_MAGIC[4] = {'M', 'S', 'H', 'C'};
+
+// Every .mtl tinyobj asked for while parsing, opened or not.
+typedef struct MtlSources {
+    MeshCacheSource files[MODEL_MAX_MTL_FILES];
+    uint64_t count;
+    int untracked;  // more files or longer paths than fit, not cached
+} MtlSources;
+
+// Files tinyobj reads (the obj and its mtl) stay mapped until the parse is done.
+typedef struct ReadContext {
+    FileView views[MODEL_MAX_READ_FILES];
+    int view_count;
+    MtlSources* mtl;
+} ReadContext;
+
 static void _callback_read_file_all(void* ctx, const char* filename, int is_mtl,
                           const char* obj_filename, char** buf, size_t* len) {
-    (void)ctx;
-    (void)is_mtl;
     (void)obj_filename;
     *buf = NULL;
     *len = 0;
-    FILE* f = fopen(filename, "rb");
-    if (!f) return;
-    fseek(f, 0, SEEK_END);
-    long L = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    char* data = (char*)malloc((size_t)L + 1);
-    size_t r = fread(data, 1, (size_t)L, f);
-    fclose(f);
-    data[r] = '\0';
-    *buf = data;
-    *len = r + 1;  // include NUL
+    ReadContext* read_ctx = (ReadContext*)ctx;
+    if (is_mtl) {
+        MtlSources* mtl = read_ctx->mtl;
+        if (mtl->count < MODEL_MAX_MTL_FILES && strlen(filename) < MODEL_CACHE_PATH_MAX) {
+            strcpy(mtl->files[mtl->count++].path, filename);
+        } else {
+            mtl->untracked = 1;
+        }
+    }
+    if (read_ctx->view_count == MODEL_MAX_READ_FILES) return;
+    FileView* view = &read_ctx->views[read_ctx->view_count];
+    if (file_view_open(filename, view) != 0) return;
+    read_ctx->view_count++;
+    // tinyobj never writes through buf
+    *buf = (char*)view->data;
+    *len = view->size + 1;  // include NUL
 }
 
-// chatgpt function
-int model_load(const char *obj_path, Mesh *out_mesh) {
-    if (!out_mesh) return -1;
+static void _read_context_release(ReadContext* ctx) {
+    for (int i = 0; i < ctx->view_count; i++) {
+        file_view_close(&ctx->views[i]);
+    }
+    ctx->view_count = 0;
+}
+
+static size_t _hash_vertex_index(tinyobj_vertex_index_t vi) {
+    size_t h = (size_t)(unsigned int)vi.v_idx * 73856093u;
+    h ^= (size_t)(unsigned int)vi.vn_idx * 19349663u;
+    h ^= (size_t)(unsigned int)vi.vt_idx * 83492791u;
+    return h ^ (h >> 16);
+}
+
+static int _vertex_index_equal(tinyobj_vertex_index_t a, tinyobj_vertex_index_t b) {
+    return a.v_idx == b.v_idx && a.vn_idx == b.vn_idx && a.vt_idx == b.vt_idx;
+}
 
+static void _write_vertex(const tinyobj_attrib_t* attrib, tinyobj_vertex_index_t vi, float* out) {
+    float px = 0, py = 0, pz = 0;
+    if (vi.v_idx >= 0 && vi.v_idx < (int)attrib->num_vertices) {
+        px = attrib->vertices[3 * vi.v_idx + 0];
+        py = attrib->vertices[3 * vi.v_idx + 1];
+        pz = attrib->vertices[3 * vi.v_idx + 2];
+    }
+
+    float nx = 0, ny = 0, nz = 1;
+    if (vi.vn_idx >= 0 && vi.vn_idx < (int)attrib->num_normals) {
+        nx = attrib->normals[3 * vi.vn_idx + 0];
+        ny = attrib->normals[3 * vi.vn_idx + 1];
+        nz = attrib->normals[3 * vi.vn_idx + 2];
+    }
+
+    float u = 0, v = 0;
+    if (vi.vt_idx >= 0 && vi.vt_idx < (int)attrib->num_texcoords) {
+        u = attrib->texcoords[2 * vi.vt_idx + 0];
+        v = attrib->texcoords[2 * vi.vt_idx + 1];
+    }
+
+    out[0] = px;
+    out[1] = py;
+    out[2] = pz;
+    out[3] = nx;
+    out[4] = ny;
+    out[5] = nz;
+    out[6] = u;
+    out[7] = v;
+}
+
+static uint64_t _now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// FNV-1a over the whole source file
+static int _hash_file(const char* path, uint64_t* out_hash) {
+    FileView view;
+    if (file_view_open(path, &view) != 0) return -1;
+    uint64_t h = 14695981039346656037ull;
+    const unsigned char* p = (const unsigned char*)view.data;
+    for (size_t i = 0; i < view.size; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    file_view_close(&view);
+    *out_hash = h;
+    return 0;
+}
+
+// Whole seconds would miss an edit made in the same second the cache was
+// written, when the size happens not to change.
+static int64_t _mtime_ns(const struct stat* st) {
+#if defined(__APPLE__)
+    return (int64_t)st->st_mtimespec.tv_sec * 1000000000 + st->st_mtimespec.tv_nsec;
+#else
+    return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#endif
+}
+
+// Records the size, mtime and hash of src->path as it is now.
+static void _source_fill(MeshCacheSource* src) {
+    struct stat st;
+    src->size = -1;
+    src->mtime_ns = 0;
+    src->hash = 0;
+    if (stat(src->path, &st) != 0 || _hash_file(src->path, &src->hash) != 0) return;
+    src->size = (int64_t)st.st_size;
+    src->mtime_ns = _mtime_ns(&st);
+}
+
+// Same rule as the obj: size first, the hash only when the mtime moved.
+static int _source_unchanged(const MeshCacheSource* src) {
+    struct stat st;
+    if (stat(src->path, &st) != 0) return src->size < 0;
+    if (src->size != (int64_t)st.st_size) return 0;
+    if (src->mtime_ns == _mtime_ns(&st)) return 1;
+    uint64_t hash = 0;
+    return _hash_file(src->path, &hash) == 0 && hash == src->hash;
+}
+
+static void _cache_path(const char* obj_path, char* out, size_t out_size) {
+    snprintf(out, out_size, "%s" MODEL_CACHE_EXTENSION, obj_path);
+}
+
+static size_t _vertex_stride(unsigned int flags) {
+    return (flags & MODEL_LOAD_QUANTIZE) ? sizeof(QuantizedVertex) : sizeof(float) * MODEL_VERTEX_FLOATS;
+}
+
+static int _cache_header_valid(const MeshCacheHeader* h, size_t file_size) {
+    if (memcmp(h->magic, MODEL_CACHE_MAGIC, sizeof(MODEL_CACHE_MAGIC)) != 0) return 0;
+    if (h->version != MODEL_CACHE_VERSION) return 0;
+    if (h->vertex_stride != _vertex_stride(h->flags)) return 0;
+    if (h->vertex_offset % sizeof(float) != 0 || h->index_offset % sizeof(unsigned int) != 0) return 0;
+    if (h->vertex_offset < sizeof(MeshCacheHeader) || h->vertex_offset > file_size) return 0;
+    if (h->vertex_count > (file_size - h->vertex_offset) / h->vertex_stride) return 0;
+    if (h->index_offset < h->vertex_offset + h->vertex_count * h->vertex_stride || h->index_offset > file_size) return 0;
+    if (h->index_count > (file_size - h->index_offset) / sizeof(unsigned int)) return 0;
+    if (h->submesh_offset % sizeof(unsigned int) != 0) return 0;
+    if (h->submesh_offset < h->index_offset + h->index_count * sizeof(unsigned int) || h->submesh_offset > file_size) return 0;
+    if (h->submesh_count > (file_size - h->submesh_offset) / sizeof(Submesh)) return 0;
+    if (h->mtl_count > MODEL_MAX_MTL_FILES) return 0;
+    for (uint64_t i = 0; i < h->mtl_count; i++) {
+        if (!memchr(h->mtl[i].path, '\0', MODEL_CACHE_PATH_MAX)) return 0;
+    }
+    return 1;
+}
+
+// Maps the cache for obj_path and points out_mesh into it. The cache is keyed
+// on the size and mtime of the source and of every .mtl it read; if only an
+// mtime moved (e.g. a fresh checkout) the content hash decides.
+static int _cache_load(const char* obj_path, const struct stat* src_st, unsigned int flags,
+                       Mesh* out_mesh, uint64_t* out_cold_ns) {
+    char path[4096];
+    _cache_path(obj_path, path, sizeof(path));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(MeshCacheHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t map_size = (size_t)st.st_size;
+    // private writable mapping so later passes can modify the mesh in place
+    void* map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    const MeshCacheHeader* h = (const MeshCacheHeader*)map;
+    int valid = _cache_header_valid(h, map_size) && h->source_size == (uint64_t)src_st->st_size &&
+                h->flags == flags;
+    if (valid && h->source_mtime_ns != _mtime_ns(src_st)) {
+        uint64_t hash = 0;
+        valid = _hash_file(obj_path, &hash) == 0 && hash == h->source_hash;
+    }
+    for (uint64_t i = 0; valid && i < h->mtl_count; i++) {
+        valid = _source_unchanged(&h->mtl[i]);
+    }
+    if (!valid) {
+        munmap(map, map_size);
+        return -1;
+    }
+
+    out_mesh->vertices = (char*)map + h->vertex_offset;
+    out_mesh->vertex_stride = h->vertex_stride;
+    memcpy(out_mesh->pos_min, h->pos_min, sizeof(h->pos_min));
+    memcpy(out_mesh->pos_extent, h->pos_extent, sizeof(h->pos_extent));
+    out_mesh->bounds = h->bounds;
+    out_mesh->indices = (unsigned int*)((char*)map + h->index_offset);
+    out_mesh->vertex_count = (size_t)h->vertex_count;
+    out_mesh->index_count = (size_t)h->index_count;
+    out_mesh->submeshes = (Submesh*)((char*)map + h->submesh_offset);
+    out_mesh->submesh_count = (size_t)h->submesh_count;
+    out_mesh->cache_map = map;
+    out_mesh->cache_map_size = map_size;
+    *out_cold_ns = h->cold_load_ns;
+    return 0;
+}
+
+// Writes to a temporary file and renames it over the cache so a crashed or
+// concurrent run never leaves a torn cache behind.
+static int _cache_store(const char* obj_path, const struct stat* src_st, unsigned int flags,
+                        const MtlSources* mtl, const Mesh* mesh, uint64_t cold_ns) {
+    if (mtl->untracked) return -1;
+    MeshCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MODEL_CACHE_MAGIC, sizeof(MODEL_CACHE_MAGIC));
+    h.version = MODEL_CACHE_VERSION;
+    h.vertex_stride = (uint32_t)mesh->vertex_stride;
+    h.flags = flags;
+    h.source_size = (uint64_t)src_st->st_size;
+    h.source_mtime_ns = _mtime_ns(src_st);
+    h.cold_load_ns = cold_ns;
+    h.vertex_count = mesh->vertex_count;
+    h.index_count = mesh->index_count;
+    h.vertex_offset = sizeof(MeshCacheHeader);
+    h.index_offset = h.vertex_offset + h.vertex_count * h.vertex_stride;
+    h.submesh_count = mesh->submesh_count;
+    h.submesh_offset = h.index_offset + h.index_count * sizeof(unsigned int);
+    memcpy(h.pos_min, mesh->pos_min, sizeof(h.pos_min));
+    memcpy(h.pos_extent, mesh->pos_extent, sizeof(h.pos_extent));
+    h.bounds = mesh->bounds;
+    if (_hash_file(obj_path, &h.source_hash) != 0) return -1;
+    h.mtl_count = mtl->count;
+    for (uint64_t i = 0; i < mtl->count; i++) {
+        h.mtl[i] = mtl->files[i];
+        _source_fill(&h.mtl[i]);
+    }
+
+    char path[4096];
+    char tmp_path[4096 + 8];
+    _cache_path(obj_path, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f) return -1;
+    size_t vertex_bytes = mesh->vertex_count * h.vertex_stride;
+    size_t index_bytes = mesh->index_count * sizeof(unsigned int);
+    size_t submesh_bytes = mesh->submesh_count * sizeof(Submesh);
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+             fwrite(mesh->vertices, 1, vertex_bytes, f) == vertex_bytes &&
+             fwrite(mesh->indices, 1, index_bytes, f) == index_bytes &&
+             fwrite(mesh->submeshes, 1, submesh_bytes, f) == submesh_bytes;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+// Bucket of a face's material, 0 for none (or an id the mtl did not define).
+static size_t _material_slot(int material_id, size_t num_materials) {
+    return (material_id >= 0 && (size_t)material_id < num_materials) ? (size_t)material_id + 1 : 0;
+}
+
+static int _model_parse(const char *obj_path, Mesh *out_mesh, MtlSources *out_mtl) {
     tinyobj_attrib_t attrib = {0};
     tinyobj_shape_t* shapes = NULL;
     size_t num_shapes = 0;
     tinyobj_material_t* materials = NULL;
     size_t num_materials = 0;
+    ReadContext read_ctx = {};
+    read_ctx.mtl = out_mtl;
+    // attrib and the dedup scratch below are released together
+    tinyobj_arena_t arena;
+    tinyobj_arena_init(&arena, 0);
 
-    int ret = tinyobj_parse_obj(
+    int ret = tinyobj_parse_obj_arena(
         &attrib, &shapes, &num_shapes,
         &materials, &num_materials,
-        obj_path, _callback_read_file_all, NULL,
-        TINYOBJ_FLAG_TRIANGULATE
+        obj_path, _callback_read_file_all, &read_ctx,
+        TINYOBJ_FLAG_TRIANGULATE | TINYOBJ_FLAG_PARALLEL, &arena
     );
 
-    if (ret != TINYOBJ_SUCCESS)
+    // attrib, shapes and materials hold copies, the source text is no longer needed
+    _read_context_release(&read_ctx);
+
+    if (ret != TINYOBJ_SUCCESS) {
+        tinyobj_arena_free(&arena);
         return ret;
+    }
 
     size_t corner_count = attrib.num_faces;  // total number of vertex references
-    float* verts = (float*)malloc(sizeof(float) * 8 * corner_count);
-    unsigned int* inds = (unsigned int*)malloc(sizeof(unsigned int) * corner_count);
 
-    if (!verts || !inds) {
+    // Triangles are bucketed by material as they are indexed; after the prefix
+    // sum tri_cursor[slot] is the first triangle of that material slot.
+    size_t tri_count = 0;
+    size_t material_slots = num_materials + 1;
+    size_t* tri_cursor = (size_t*)tinyobj_arena_alloc(&arena, sizeof(size_t) * (material_slots + 1));
+    if (!tri_cursor) {
+        tinyobj_arena_free(&arena);
+        tinyobj_shapes_free(shapes, num_shapes);
+        tinyobj_materials_free(materials, num_materials);
+        return -2;
+    }
+    memset(tri_cursor, 0, sizeof(size_t) * (material_slots + 1));
+    for (size_t f = 0; f < attrib.num_face_num_verts; f++) {
+        if (attrib.face_num_verts[f] != 3) continue;
+        tri_cursor[_material_slot(attrib.material_ids[f], num_materials) + 1]++;
+        tri_count++;
+    }
+    for (size_t m = 1; m <= material_slots; m++) {
+        tri_cursor[m] += tri_cursor[m - 1];
+    }
+
+    size_t submesh_count = 0;
+    for (size_t m = 0; m < material_slots; m++) {
+        if (tri_cursor[m + 1] > tri_cursor[m]) submesh_count++;
+    }
+    Submesh* submeshes = (Submesh*)malloc(sizeof(Submesh) * (submesh_count ? submesh_count : 1));
+    submesh_count = 0;
+    for (size_t m = 0; submeshes && m < material_slots; m++) {
+        if (tri_cursor[m + 1] == tri_cursor[m]) continue;
+        Submesh* sm = &submeshes[submesh_count++];
+        sm->first_index = (unsigned int)(3 * tri_cursor[m]);
+        sm->index_count = (unsigned int)(3 * (tri_cursor[m + 1] - tri_cursor[m]));
+        sm->material_id = (int)m - 1;
+        sm->pad0 = 0;
+    }
+
+    // open addressing table from (v, vn, vt) triple to output vertex, kept at most half full
+    size_t table_size = 16;
+    while (table_size < corner_count * 2) table_size <<= 1;
+
+    float* verts = (float*)malloc(sizeof(float) * MODEL_VERTEX_FLOATS * corner_count);
+    unsigned int* inds = (unsigned int*)malloc(sizeof(unsigned int) * 3 * tri_count);
+    unsigned int* table = (unsigned int*)tinyobj_arena_alloc(&arena, sizeof(unsigned int) * table_size);
+    tinyobj_vertex_index_t* keys = (tinyobj_vertex_index_t*)tinyobj_arena_alloc(&arena, sizeof(tinyobj_vertex_index_t) * corner_count);
+
+    if (!verts || !inds || !table || !keys || !submeshes) {
         free(verts);
         free(inds);
-        tinyobj_attrib_free(&attrib);
+        free(submeshes);
+        tinyobj_arena_free(&arena);
         tinyobj_shapes_free(shapes, num_shapes);
         tinyobj_materials_free(materials, num_materials);
         return -2;
     }
+    memset(table, 0xff, sizeof(unsigned int) * table_size);
 
-    size_t w = 0;
-    for (size_t i = 0; i < corner_count; i++) {
-        tinyobj_vertex_index_t vi = attrib.faces[i];
-
-        float px = 0, py = 0, pz = 0;
-        if (vi.v_idx >= 0 && vi.v_idx < (int)attrib.num_vertices) {
-            px = attrib.vertices[3 * vi.v_idx + 0];
-            py = attrib.vertices[3 * vi.v_idx + 1];
-            pz = attrib.vertices[3 * vi.v_idx + 2];
+    size_t vertex_count = 0;
+    size_t corner = 0;
+    for (size_t f = 0; f < attrib.num_face_num_verts; f++) {
+        size_t face_corners = (size_t)attrib.face_num_verts[f];
+        // triangulated, anything else is a point or line and not drawn
+        if (face_corners != 3) {
+            corner += face_corners;
+            continue;
         }
+        size_t out = 3 * tri_cursor[_material_slot(attrib.material_ids[f], num_materials)]++;
 
-        float nx = 0, ny = 0, nz = 1;
-        if (vi.vn_idx >= 0 && vi.vn_idx < (int)attrib.num_normals) {
-            nx = attrib.normals[3 * vi.vn_idx + 0];
-            ny = attrib.normals[3 * vi.vn_idx + 1];
-            nz = attrib.normals[3 * vi.vn_idx + 2];
-        }
+        for (size_t k = 0; k < 3; k++) {
+            tinyobj_vertex_index_t vi = attrib.faces[corner++];
 
-        float u = 0, v = 0;
-        if (vi.vt_idx >= 0 && vi.vt_idx < (int)attrib.num_texcoords) {
-            u = attrib.texcoords[2 * vi.vt_idx + 0];
-            v = attrib.texcoords[2 * vi.vt_idx + 1];
-        }
+            size_t slot = _hash_vertex_index(vi) & (table_size - 1);
+            while (table[slot] != MODEL_EMPTY_SLOT && !_vertex_index_equal(keys[table[slot]], vi)) {
+                slot = (slot + 1) & (table_size - 1);
+            }
 
-        verts[w + 0] = px;
-        verts[w + 1] = py;
-        verts[w + 2] = pz;
-        verts[w + 3] = nx;
-        verts[w + 4] = ny;
-        verts[w + 5] = nz;
-        verts[w + 6] = u;
-        verts[w + 7] = v;
-        w += 8;
+            if (table[slot] == MODEL_EMPTY_SLOT) {
+                table[slot] = (unsigned int)vertex_count;
+                keys[vertex_count] = vi;
+                _write_vertex(&attrib, vi, &verts[MODEL_VERTEX_FLOATS * vertex_count]);
+                vertex_count++;
+            }
 
-        inds[i] = (unsigned int)i;
+            inds[out + k] = table[slot];
+        }
+    }
+
+    // shrink to the unique vertices
+    if (vertex_count > 0) {
+        float* shrunk = (float*)realloc(verts, sizeof(float) * MODEL_VERTEX_FLOATS * vertex_count);
+        if (shrunk) verts = shrunk;
     }
 
+    printf("Loaded %s: %zu corners -> %zu vertices (%.2fx reduction), %zu materials\n",
+           obj_path, corner_count, vertex_count,
+           vertex_count ? (double)corner_count / (double)vertex_count : 0.0, submesh_count);
+
     // Fill mesh
     out_mesh->vertices = verts;
     out_mesh->indices = inds;
-    out_mesh->vertex_count = corner_count;
-    out_mesh->index_count = corner_count;
+    out_mesh->vertex_count = vertex_count;
+    out_mesh->index_count = 3 * tri_count;
+    out_mesh->submeshes = submeshes;
+    out_mesh->submesh_count = submesh_count;
 
     // Cleanup tinyobj
-    tinyobj_attrib_free(&attrib);
+    tinyobj_arena_free(&arena);
     tinyobj_shapes_free(shapes, num_shapes);
     tinyobj_materials_free(materials, num_materials);
 
     return 0;
 }
 
+// Bounds of the vertices indices refers to, all vertices when indices is NULL.
+// Runs on the float vertices, before quantization.
+static void _bounds(const float* vertices, size_t vertex_count, const unsigned int* indices,
+                    size_t index_count, Bounds* out) {
+    size_t count = indices ? index_count : vertex_count;
+    if (count == 0) {
+        memset(out, 0, sizeof(Bounds));
+        return;
+    }
+
+    for (int k = 0; k < 3; k++) {
+        out->aabb_min[k] = INFINITY;
+        out->aabb_max[k] = -INFINITY;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const float* p = &vertices[MODEL_VERTEX_FLOATS * (indices ? indices[i] : i)];
+        for (int k = 0; k < 3; k++) {
+            out->aabb_min[k] = fminf(out->aabb_min[k], p[k]);
+            out->aabb_max[k] = fmaxf(out->aabb_max[k], p[k]);
+        }
+    }
+
+    float radius_sq = 0.0f;
+    for (int k = 0; k < 3; k++) {
+        out->center[k] = 0.5f * (out->aabb_min[k] + out->aabb_max[k]);
+    }
+    for (size_t i = 0; i < count; i++) {
+        const float* p = &vertices[MODEL_VERTEX_FLOATS * (indices ? indices[i] : i)];
+        float dx = p[0] - out->center[0];
+        float dy = p[1] - out->center[1];
+        float dz = p[2] - out->center[2];
+        radius_sq = fmaxf(radius_sq, dx * dx + dy * dy + dz * dz);
+    }
+    out->radius = sqrtf(radius_sq);
+}
+
+static void _model_bounds(Mesh *mesh) {
+    const float* vertices = (const float*)mesh->vertices;
+    _bounds(vertices, mesh->vertex_count, NULL, 0, &mesh->bounds);
+    for (size_t i = 0; i < mesh->submesh_count; i++) {
+        Submesh* sm = &mesh->submeshes[i];
+        _bounds(vertices, mesh->vertex_count, mesh->indices + sm->first_index, sm->index_count, &sm->bounds);
+    }
+}
+
+// Reorders triangles for the post-transform cache and overdraw, then the
+// vertices for fetch order, and reports the simulated cache before and after.
+static int _model_optimize(const char *obj_path, Mesh *mesh) {
+    MeshCacheStats before, after;
+    mesh_opt_simulate_cache(mesh->indices, mesh->index_count, mesh->vertex_count,
+                            MESH_OPT_CACHE_SIZE, &before);
+
+    // triangles stay within their submesh so the material ranges survive
+    for (size_t i = 0; i < mesh->submesh_count; i++) {
+        const Submesh* sm = &mesh->submeshes[i];
+        if (mesh_opt_reorder_triangles(mesh->indices + sm->first_index, sm->index_count,
+                                       (const float*)mesh->vertices, mesh->vertex_count,
+                                       sizeof(float) * MODEL_VERTEX_FLOATS) != 0) {
+            return -1;
+        }
+    }
+    if (mesh_opt_reorder_vertices(mesh->indices, mesh->index_count, mesh->vertices,
+                                  mesh->vertex_count, sizeof(float) * MODEL_VERTEX_FLOATS) != 0) {
+        return -1;
+    }
+
+    mesh_opt_simulate_cache(mesh->indices, mesh->index_count, mesh->vertex_count,
+                            MESH_OPT_CACHE_SIZE, &after);
+    printf("Optimized %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (%d entry FIFO)\n",
+           obj_path, before.acmr, after.acmr, before.atvr, after.atvr, MESH_OPT_CACHE_SIZE);
+    return 0;
+}
+
+// Replaces the float vertices with QuantizedVertex and reports the largest
+// round trip error.
+static int _model_quantize(const char *obj_path, Mesh *mesh) {
+    QuantizedVertex* quantized = (QuantizedVertex*)malloc(sizeof(QuantizedVertex) * (mesh->vertex_count ? mesh->vertex_count : 1));
+    if (!quantized) return -1;
+
+    VertexQuantError error;
+    vertex_quantize((const float*)mesh->vertices, mesh->vertex_count, quantized,
+                    mesh->pos_min, mesh->pos_extent, &error);
+    free(mesh->vertices);
+    mesh->vertices = quantized;
+    mesh->vertex_stride = sizeof(QuantizedVertex);
+
+    printf("Quantized %s: %zu -> %zu bytes per vertex, max error position %.3g, normal %.3f deg, uv %.3g\n",
+           obj_path, sizeof(float) * MODEL_VERTEX_FLOATS, sizeof(QuantizedVertex),
+           error.position, error.normal_deg, error.uv);
+    return 0;
+}
+
+// chatgpt function
+int model_load(const char *obj_path, Mesh *out_mesh, unsigned int flags) {
+    if (!out_mesh) return -1;
+    memset(out_mesh, 0, sizeof(Mesh));
+    // float positions decode as themselves
+    out_mesh->vertex_stride = sizeof(float) * MODEL_VERTEX_FLOATS;
+    for (int k = 0; k < 3; k++) {
+        out_mesh->pos_extent[k] = 1.0f;
+    }
+
+    struct stat src_st;
+    if (stat(obj_path, &src_st) != 0) {
+        fprintf(stderr, "Failed to stat %s\n", obj_path);
+        return TINYOBJ_ERROR_FILE_OPERATION;
+    }
+
+    uint64_t start = _now_ns();
+    uint64_t cold_ns = 0;
+    if (_cache_load(obj_path, &src_st, flags, out_mesh, &cold_ns) == 0) {
+        uint64_t cached_ns = _now_ns() - start;
+        printf("Loaded %s from cache in %.2f ms (cold load %.2f ms, %.1fx faster)\n",
+               obj_path, cached_ns / 1e6, cold_ns / 1e6,
+               cached_ns ? (double)cold_ns / (double)cached_ns : 0.0);
+        return 0;
+    }
+
+    MtlSources mtl = {};
+    int ret = _model_parse(obj_path, out_mesh, &mtl);
+    if (ret != 0) return ret;
+    if ((flags & MODEL_LOAD_OPTIMIZE) && _model_optimize(obj_path, out_mesh) != 0) {
+        fprintf(stderr, "Failed to optimize %s, keeping file order\n", obj_path);
+        flags &= ~MODEL_LOAD_OPTIMIZE;
+    }
+    _model_bounds(out_mesh);
+    if ((flags & MODEL_LOAD_QUANTIZE) && _model_quantize(obj_path, out_mesh) != 0) {
+        model_free(out_mesh);
+        return -2;
+    }
+    cold_ns = _now_ns() - start;
+    printf("Parsed %s in %.2f ms\n", obj_path, cold_ns / 1e6);
+
+    if (_cache_store(obj_path, &src_st, flags, &mtl, out_mesh, cold_ns) != 0) {
+        fprintf(stderr, "Failed to write mesh cache for %s\n", obj_path);
+    }
+    return 0;
+}
+
+void model_free(Mesh *mesh) {
+    if (!mesh) return;
+    if (mesh->cache_map) {
+        munmap(mesh->cache_map, mesh->cache_map_size);
+    } else {
+        free(mesh->vertices);
+        free(mesh->indices);
+        free(mesh->submeshes);
+    }
+    memset(mesh, 0, sizeof(Mesh));
+}
@@ -0,0 +1,466 @@
+#include "texture_codec.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static const int _bc7_weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+uint32_t texture_block_size(BlockFormat format) {
+    switch (format) {
+        case BLOCK_FORMAT_BC1: return 8;
+        case BLOCK_FORMAT_BC3: return 16;
+        case BLOCK_FORMAT_BC7: return 16;
+    }
+    return 0;
+}
+
+size_t texture_level_size(BlockFormat format, uint32_t width, uint32_t height) {
+    size_t blocks_x = (width + TEXTURE_BLOCK_DIM - 1) / TEXTURE_BLOCK_DIM;
+    size_t blocks_y = (height + TEXTURE_BLOCK_DIM - 1) / TEXTURE_BLOCK_DIM;
+    return blocks_x * blocks_y * texture_block_size(format);
+}
+
+// Partial blocks at the right and bottom edges repeat the last texel.
+static void _fetch_block(const uint8_t *rgba, uint32_t width, uint32_t height,
+                         uint32_t bx, uint32_t by, uint8_t block[16][4]) {
+    for (uint32_t y = 0; y < 4; y++) {
+        uint32_t sy = by * 4 + y < height ? by * 4 + y : height - 1;
+        for (uint32_t x = 0; x < 4; x++) {
+            uint32_t sx = bx * 4 + x < width ? bx * 4 + x : width - 1;
+            memcpy(block[y * 4 + x], &rgba[((size_t)sy * width + sx) * 4], 4);
+        }
+    }
+}
+
+static void _store_block(uint8_t *rgba, uint32_t width, uint32_t height,
+                         uint32_t bx, uint32_t by, const uint8_t block[16][4]) {
+    for (uint32_t y = 0; y < 4 && by * 4 + y < height; y++) {
+        for (uint32_t x = 0; x < 4 && bx * 4 + x < width; x++) {
+            memcpy(&rgba[((size_t)(by * 4 + y) * width + bx * 4 + x) * 4], block[y * 4 + x], 4);
+        }
+    }
+}
+
+// Endpoints at the extremes of the block projected on its principal axis,
+// found by power iteration on the covariance of the first channels.
+static void _principal_endpoints(const uint8_t block[16][4], int channels, float lo[4], float hi[4]) {
+    float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < channels; c++) mean[c] += block[i][c] / 16.0f;
+    }
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; i++) {
+        for (int a = 0; a < channels; a++) {
+            for (int b = 0; b < channels; b++) {
+                cov[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+            }
+        }
+    }
+
+    float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    for (int iter = 0; iter < 8; iter++) {
+        float v[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        float scale = 0.0f;
+        for (int a = 0; a < channels; a++) {
+            for (int b = 0; b < channels; b++) v[a] += cov[a][b] * axis[b];
+            if (fabsf(v[a]) > scale) scale = fabsf(v[a]);
+        }
+        // a flat block keeps the diagonal, both endpoints land on the mean
+        if (scale < 1e-6f) break;
+        for (int a = 0; a < channels; a++) axis[a] = v[a] / scale;
+    }
+    float length = 0.0f;
+    for (int c = 0; c < channels; c++) length += axis[c] * axis[c];
+    length = sqrtf(length);
+    for (int c = 0; c < channels; c++) axis[c] /= length;
+
+    float t_min = INFINITY, t_max = -INFINITY;
+    for (int i = 0; i < 16; i++) {
+        float t = 0.0f;
+        for (int c = 0; c < channels; c++) t += (block[i][c] - mean[c]) * axis[c];
+        if (t < t_min) t_min = t;
+        if (t > t_max) t_max = t;
+    }
+    for (int c = 0; c < channels; c++) {
+        lo[c] = fminf(fmaxf(mean[c] + axis[c] * t_min, 0.0f), 255.0f);
+        hi[c] = fminf(fmaxf(mean[c] + axis[c] * t_max, 0.0f), 255.0f);
+    }
+}
+
+static int _nearest(const int palette[][4], int palette_size, const uint8_t texel[4], int channels) {
+    int best = 0, best_error = 0x7fffffff;
+    for (int i = 0; i < palette_size; i++) {
+        int error = 0;
+        for (int c = 0; c < channels; c++) {
+            int d = palette[i][c] - texel[c];
+            error += d * d;
+        }
+        if (error < best_error) {
+            best = i;
+            best_error = error;
+        }
+    }
+    return best;
+}
+
+static uint16_t _pack565(const float c[3]) {
+    uint16_t r = (uint16_t)lroundf(c[0] * 31.0f / 255.0f);
+    uint16_t g = (uint16_t)lroundf(c[1] * 63.0f / 255.0f);
+    uint16_t b = (uint16_t)lroundf(c[2] * 31.0f / 255.0f);
+    return (uint16_t)(r << 11 | g << 5 | b);
+}
+
+static void _unpack565(uint16_t v, int out[4]) {
+    int r = v >> 11, g = (v >> 5) & 0x3f, b = v & 0x1f;
+    out[0] = r << 3 | r >> 2;
+    out[1] = g << 2 | g >> 4;
+    out[2] = b << 3 | b >> 2;
+    out[3] = 255;
+}
+
+// four_color is false only for BC1 blocks with c0 <= c1, where the last
+// entry is transparent black.
+static void _color_palette(uint16_t c0, uint16_t c1, bool four_color, int palette[4][4]) {
+    _unpack565(c0, palette[0]);
+    _unpack565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        if (four_color) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = four_color ? 255 : 0;
+}
+
+// Always the four color mode, so the block reads the same in BC1 and BC3.
+static void _encode_color(const uint8_t block[16][4], uint8_t out[8]) {
+    float lo[4], hi[4];
+    _principal_endpoints(block, 3, lo, hi);
+    uint16_t c0 = _pack565(hi), c1 = _pack565(lo);
+    if (c0 < c1) {
+        uint16_t t = c0;
+        c0 = c1;
+        c1 = t;
+    }
+
+    // equal endpoints leave every index at 0, which is c0 in either mode
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        int palette[4][4];
+        _color_palette(c0, c1, true, palette);
+        for (int i = 0; i < 16; i++) indices |= (uint32_t)_nearest(palette, 4, block[i], 3) << (2 * i);
+    }
+
+    out[0] = (uint8_t)c0;
+    out[1] = (uint8_t)(c0 >> 8);
+    out[2] = (uint8_t)c1;
+    out[3] = (uint8_t)(c1 >> 8);
+    for (int i = 0; i < 4; i++) out[4 + i] = (uint8_t)(indices >> (8 * i));
+}
+
+static void _decode_color(const uint8_t in[8], bool bc1, uint8_t block[16][4]) {
+    uint16_t c0 = (uint16_t)(in[0] | in[1] << 8);
+    uint16_t c1 = (uint16_t)(in[2] | in[3] << 8);
+    uint32_t indices = (uint32_t)in[4] | (uint32_t)in[5] << 8 | (uint32_t)in[6] << 16 | (uint32_t)in[7] << 24;
+    int palette[4][4];
+    _color_palette(c0, c1, !bc1 || c0 > c1, palette);
+    for (int i = 0; i < 16; i++) {
+        const int *p = palette[(indices >> (2 * i)) & 3];
+        for (int c = 0; c < 4; c++) block[i][c] = (uint8_t)p[c];
+    }
+}
+
+static void _alpha_palette(int a0, int a1, int palette[8][4]) {
+    palette[0][0] = a0;
+    palette[1][0] = a1;
+    if (a0 > a1) {
+        for (int i = 2; i < 8; i++) palette[i][0] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+    } else {
+        for (int i = 2; i < 6; i++) palette[i][0] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+        palette[6][0] = 0;
+        palette[7][0] = 255;
+    }
+}
+
+// BC4 on the alpha channel, in the eight value mode.
+static void _encode_alpha(const uint8_t block[16][4], uint8_t out[8]) {
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; i++) {
+        if (block[i][3] > a0) a0 = block[i][3];
+        if (block[i][3] < a1) a1 = block[i][3];
+    }
+
+    uint64_t indices = 0;
+    if (a0 > a1) {
+        int palette[8][4];
+        _alpha_palette(a0, a1, palette);
+        for (int i = 0; i < 16; i++) {
+            uint8_t alpha[4] = { block[i][3], 0, 0, 0 };
+            indices |= (uint64_t)_nearest(palette, 8, alpha, 1) << (3 * i);
+        }
+    }
+
+    out[0] = (uint8_t)a0;
+    out[1] = (uint8_t)a1;
+    for (int i = 0; i < 6; i++) out[2 + i] = (uint8_t)(indices >> (8 * i));
+}
+
+static void _decode_alpha(const uint8_t in[8], uint8_t block[16][4]) {
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; i++) indices |= (uint64_t)in[2 + i] << (8 * i);
+    int palette[8][4];
+    _alpha_palette(in[0], in[1], palette);
+    for (int i = 0; i < 16; i++) block[i][3] = (uint8_t)palette[(indices >> (3 * i)) & 7][0];
+}
+
+static void _put_bits(uint8_t out[16], int *pos, uint32_t value, int count) {
+    for (int i = 0; i < count; i++, (*pos)++) {
+        if ((value >> i) & 1) out[*pos / 8] |= (uint8_t)(1 << (*pos % 8));
+    }
+}
+
+static uint32_t _get_bits(const uint8_t in[16], int *pos, int count) {
+    uint32_t value = 0;
+    for (int i = 0; i < count; i++, (*pos)++) {
+        value |= (uint32_t)((in[*pos / 8] >> (*pos % 8)) & 1) << i;
+    }
+    return value;
+}
+
+// 7 bits per channel plus a p-bit shared by the endpoint, whichever p-bit
+// lands closer.
+static void _quantize_bc7(const float e[4], uint8_t q[4], uint8_t *p) {
+    float best_error = INFINITY;
+    for (int pbit = 0; pbit < 2; pbit++) {
+        uint8_t candidate[4];
+        float error = 0.0f;
+        for (int c = 0; c < 4; c++) {
+            long v = lroundf((e[c] - pbit) / 2.0f);
+            candidate[c] = (uint8_t)(v < 0 ? 0 : v > 127 ? 127 : v);
+            float d = e[c] - (float)(candidate[c] * 2 + pbit);
+            error += d * d;
+        }
+        if (error < best_error) {
+            best_error = error;
+            memcpy(q, candidate, 4);
+            *p = (uint8_t)pbit;
+        }
+    }
+}
+
+static void _bc7_palette(const uint8_t q[2][4], const uint8_t p[2], int palette[16][4]) {
+    for (int c = 0; c < 4; c++) {
+        int e0 = q[0][c] << 1 | p[0];
+        int e1 = q[1][c] << 1 | p[1];
+        for (int i = 0; i < 16; i++) palette[i][c] = ((64 - _bc7_weights[i]) * e0 + _bc7_weights[i] * e1 + 32) >> 6;
+    }
+}
+
+// Mode 6: one subset, RGBA endpoints, 4 bit indices.
+static void _encode_bc7(const uint8_t block[16][4], uint8_t out[16]) {
+    float lo[4], hi[4];
+    _principal_endpoints(block, 4, lo, hi);
+    uint8_t q[2][4], p[2];
+    _quantize_bc7(lo, q[0], &p[0]);
+    _quantize_bc7(hi, q[1], &p[1]);
+
+    int palette[16][4];
+    _bc7_palette(q, p, palette);
+    int indices[16];
+    for (int i = 0; i < 16; i++) indices[i] = _nearest(palette, 16, block[i], 4);
+
+    // the first index is stored without its top bit
+    if (indices[0] & 8) {
+        uint8_t t[4];
+        memcpy(t, q[0], 4);
+        memcpy(q[0], q[1], 4);
+        memcpy(q[1], t, 4);
+        uint8_t tp = p[0];
+        p[0] = p[1];
+        p[1] = tp;
+        for (int i = 0; i < 16; i++) indices[i] = 15 - indices[i];
+    }
+
+    memset(out, 0, 16);
+    int pos = 0;
+    _put_bits(out, &pos, 1 << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        _put_bits(out, &pos, q[0][c], 7);
+        _put_bits(out, &pos, q[1][c], 7);
+    }
+    _put_bits(out, &pos, p[0], 1);
+    _put_bits(out, &pos, p[1], 1);
+    _put_bits(out, &pos, (uint32_t)indices[0], 3);
+    for (int i = 1; i < 16; i++) _put_bits(out, &pos, (uint32_t)indices[i], 4);
+}
+
+// Other modes never come out of the cooker and decode to magenta.
+static void _decode_bc7(const uint8_t in[16], uint8_t block[16][4]) {
+    int pos = 0;
+    if (_get_bits(in, &pos, 7) != 1 << 6) {
+        for (int i = 0; i < 16; i++) {
+            block[i][0] = 255;
+            block[i][1] = 0;
+            block[i][2] = 255;
+            block[i][3] = 255;
+        }
+        return;
+    }
+
+    uint8_t q[2][4], p[2];
+    for (int c = 0; c < 4; c++) {
+        q[0][c] = (uint8_t)_get_bits(in, &pos, 7);
+        q[1][c] = (uint8_t)_get_bits(in, &pos, 7);
+    }
+    p[0] = (uint8_t)_get_bits(in, &pos, 1);
+    p[1] = (uint8_t)_get_bits(in, &pos, 1);
+
+    int palette[16][4];
+    _bc7_palette(q, p, palette);
+    for (int i = 0; i < 16; i++) {
+        uint32_t index = _get_bits(in, &pos, i == 0 ? 3 : 4);
+        for (int c = 0; c < 4; c++) block[i][c] = (uint8_t)palette[index][c];
+    }
+}
+
+void texture_encode(BlockFormat format, const uint8_t *rgba, uint32_t width, uint32_t height, uint8_t *dst) {
+    uint32_t blocks_x = (width + TEXTURE_BLOCK_DIM - 1) / TEXTURE_BLOCK_DIM;
+    uint32_t blocks_y = (height + TEXTURE_BLOCK_DIM - 1) / TEXTURE_BLOCK_DIM;
+    uint32_t block_size = texture_block_size(format);
+    for (uint32_t by = 0; by < blocks_y; by++) {
+        for (uint32_t bx = 0; bx < blocks_x; bx++) {
+            uint8_t block[16][4];
+            _fetch_block(rgba, width, height, bx, by, block);
+            uint8_t *out = dst + ((size_t)by * blocks_x + bx) * block_size;
+            switch (format) {
+                case BLOCK_FORMAT_BC1:
+                    _encode_color(block, out);
+                    break;
+                case BLOCK_FORMAT_BC3:
+                    _encode_alpha(block, out);
+                    _encode_color(block, out + 8);
+                    break;
+                case BLOCK_FORMAT_BC7:
+                    _encode_bc7(block, out);
+                    break;
+            }
+        }
+    }
+}
+
+void texture_decode(BlockFormat format, const uint8_t *blocks, uint32_t width, uint32_t height, uint8_t *rgba) {
+    uint32_t blocks_x = (width + TEXTURE_BLOCK_DIM - 1) / TEXTURE_BLOCK_DIM;
+    uint32_t blocks_y = (height + TEXTURE_BLOCK_DIM - 1) / TEXTURE_BLOCK_DIM;
+    uint32_t block_size = texture_block_size(format);
+    for (uint32_t by = 0; by < blocks_y; by++) {
+        for (uint32_t bx = 0; bx < blocks_x; bx++) {
+            uint8_t block[16][4];
+            const uint8_t *in = blocks + ((size_t)by * blocks_x + bx) * block_size;
+            switch (format) {
+                case BLOCK_FORMAT_BC1:
+                    _decode_color(in, true, block);
+                    break;
+                case BLOCK_FORMAT_BC3:
+                    _decode_color(in + 8, false, block);
+                    _decode_alpha(in, block);
+                    break;
+                case BLOCK_FORMAT_BC7:
+                    _decode_bc7(in, block);
+                    break;
+            }
+            _store_block(rgba, width, height, bx, by, block);
+        }
+    }
+}
+
+static uint32_t _level_size(uint32_t size, uint32_t level) {
+    return size >> level ? size >> level : 1;
+}
+
+// floor(log2(max(width, height))) + 1, the levels down to 1x1
+static uint32_t _full_chain_length(uint32_t width, uint32_t height) {
+    uint32_t size = width > height ? width : height;
+    uint32_t length = 1;
+    while (size >>= 1) length++;
+    return length;
+}
+
+static size_t _align(size_t offset) {
+    return (offset + TEXTURE_FILE_ALIGNMENT - 1) / TEXTURE_FILE_ALIGNMENT * TEXTURE_FILE_ALIGNMENT;
+}
+
+int texture_file_parse(const void *data, size_t size, TextureFile *out_file) {
+    const TextureFileHeader *header = (const TextureFileHeader*)data;
+    if (size < sizeof(TextureFileHeader) || header->magic != TEXTURE_FILE_MAGIC) return -1;
+    BlockFormat format = (BlockFormat)header->format;
+    if (texture_block_size(format) == 0) return -1;
+    if (header->width == 0 || header->height == 0) return -1;
+    // WebGPU only creates BC textures whose level 0 is whole blocks
+    if (header->width % TEXTURE_BLOCK_DIM != 0 || header->height % TEXTURE_BLOCK_DIM != 0) return -1;
+    if (header->level_count == 0 || header->level_count > TEXTURE_FILE_MAX_LEVELS) return -1;
+    // past 1x1 the GPU texture would reject the extra levels
+    if (header->level_count > _full_chain_length(header->width, header->height)) return -1;
+    if (size < sizeof(TextureFileHeader) + header->level_count * sizeof(TextureFileLevel)) return -1;
+
+    const TextureFileLevel *levels = (const TextureFileLevel*)(header + 1);
+    for (uint32_t i = 0; i < header->level_count; i++) {
+        size_t expected = texture_level_size(format, _level_size(header->width, i), _level_size(header->height, i));
+        if (levels[i].size != expected) return -1;
+        if (levels[i].offset % TEXTURE_FILE_ALIGNMENT != 0) return -1;
+        if (levels[i].offset > size || levels[i].size > size - levels[i].offset) return -1;
+    }
+
+    out_file->header = header;
+    out_file->levels = levels;
+    out_file->data = (const uint8_t*)data;
+    return 0;
+}
+
+int texture_file_write(const char *path, BlockFormat format, uint32_t flags, uint32_t width, uint32_t height,
+                       const uint8_t *const *levels, uint32_t level_count) {
+    if (level_count == 0 || level_count > TEXTURE_FILE_MAX_LEVELS) return -1;
+    if (width % TEXTURE_BLOCK_DIM != 0 || height % TEXTURE_BLOCK_DIM != 0) return -1;
+    if (level_count > _full_chain_length(width, height)) return -1;
+
+    TextureFileHeader header = {
+        .magic = TEXTURE_FILE_MAGIC,
+        .format = (uint32_t)format,
+        .flags = flags,
+        .width = width,
+        .height = height,
+        .level_count = level_count
+    };
+    TextureFileLevel index[TEXTURE_FILE_MAX_LEVELS];
+    size_t offset = _align(sizeof(header) + level_count * sizeof(TextureFileLevel));
+    for (uint32_t i = 0; i < level_count; i++) {
+        index[i].offset = offset;
+        index[i].size = texture_level_size(format, _level_size(width, i), _level_size(height, i));
+        offset = _align(offset + index[i].size);
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Failed to open %s for writing\n", path);
+        return -1;
+    }
+    static const uint8_t zeros[TEXTURE_FILE_ALIGNMENT] = {};
+    size_t written = fwrite(&header, sizeof(header), 1, file);
+    written += fwrite(index, sizeof(TextureFileLevel), level_count, file);
+    size_t position = sizeof(header) + level_count * sizeof(TextureFileLevel);
+    for (uint32_t i = 0; i < level_count; i++) {
+        fwrite(zeros, 1, index[i].offset - position, file);
+        written += fwrite(levels[i], index[i].size, 1, file);
+        position = index[i].offset + index[i].size;
+    }
+    int failed = written != 1 + level_count + level_count;
+    failed |= fclose(file) != 0;
+    if (failed) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        return -1;
+    }
+    return 0;
+}
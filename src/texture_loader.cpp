@@ -0,0 +1,293 @@
+#include "texture_loader.h"
+#include <stdio.h>
+#include <string.h>
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+static double _elapsed_ms(uint64_t start) {
+    return (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+static uint32_t _mip_size(uint32_t size, uint32_t level) {
+    return size >> level ? size >> level : 1;
+}
+
+static WGPUTextureFormat _block_texture_format(BlockFormat format, bool srgb) {
+    switch (format) {
+        case BLOCK_FORMAT_BC1: return srgb ? WGPUTextureFormat_BC1RGBAUnormSrgb : WGPUTextureFormat_BC1RGBAUnorm;
+        case BLOCK_FORMAT_BC3: return srgb ? WGPUTextureFormat_BC3RGBAUnormSrgb : WGPUTextureFormat_BC3RGBAUnorm;
+        case BLOCK_FORMAT_BC7: return srgb ? WGPUTextureFormat_BC7RGBAUnormSrgb : WGPUTextureFormat_BC7RGBAUnorm;
+    }
+    return WGPUTextureFormat_Undefined;
+}
+
+// Takes over the mapping when the blocks are uploaded as they are.
+static int _load_cooked(const TextureFile *cooked, FileView *file, bool block_compression, TextureJob *job) {
+    const TextureFileHeader *header = cooked->header;
+    BlockFormat format = (BlockFormat)header->format;
+    bool srgb = (header->flags & TEXTURE_FILE_SRGB) != 0;
+    job->width = header->width;
+    job->height = header->height;
+    job->level_count = header->level_count;
+
+    if (block_compression) {
+        job->source = TEXTURE_SOURCE_BLOCKS;
+        job->format = _block_texture_format(format, srgb);
+        job->block_size = texture_block_size(format);
+        for (uint32_t i = 0; i < header->level_count; i++) job->levels[i] = cooked->data + cooked->levels[i].offset;
+        job->file = *file;
+        return 0;
+    }
+
+    size_t total = 0;
+    for (uint32_t i = 0; i < header->level_count; i++) {
+        total += (size_t)_mip_size(header->width, i) * _mip_size(header->height, i) * 4;
+    }
+    job->pixels = (uint8_t*)malloc(total);
+    if (!job->pixels) {
+        file_view_close(file);
+        return -1;
+    }
+    job->source = TEXTURE_SOURCE_DECODED;
+    job->format = srgb ? WGPUTextureFormat_RGBA8UnormSrgb : WGPUTextureFormat_RGBA8Unorm;
+    uint8_t *dst = job->pixels;
+    for (uint32_t i = 0; i < header->level_count; i++) {
+        uint32_t width = _mip_size(header->width, i), height = _mip_size(header->height, i);
+        texture_decode(format, cooked->data + cooked->levels[i].offset, width, height, dst);
+        job->levels[i] = dst;
+        dst += (size_t)width * height * 4;
+    }
+    file_view_close(file);
+    return 0;
+}
+
+// Fills in the fields a worker owns.
+static int _load(TextureJob *job, bool block_compression) {
+    FileView file;
+    if (file_view_open(job->path, &file) != 0) {
+        fprintf(stderr, "Failed to open texture %s\n", job->path);
+        return -1;
+    }
+
+    TextureFile cooked;
+    if (texture_file_parse(file.data, file.size, &cooked) == 0) {
+        return _load_cooked(&cooked, &file, block_compression, job);
+    }
+
+    int width = 0, height = 0, channels = 0;
+    job->pixels = stbi_load_from_memory((const stbi_uc*)file.data, (int)file.size, &width, &height, &channels, 4);
+    file_view_close(&file);
+    if (!job->pixels) {
+        fprintf(stderr, "Failed to load texture %s: %s\n", job->path, stbi_failure_reason());
+        return -1;
+    }
+    job->source = TEXTURE_SOURCE_IMAGE;
+    job->format = job->srgb ? WGPUTextureFormat_RGBA8UnormSrgb : WGPUTextureFormat_RGBA8Unorm;
+    job->width = (uint32_t)width;
+    job->height = (uint32_t)height;
+    job->level_count = 1;
+    job->levels[0] = job->pixels;
+    return 0;
+}
+
+static void _free_data(TextureJob *job) {
+    if (job->source == TEXTURE_SOURCE_IMAGE) stbi_image_free(job->pixels);
+    else free(job->pixels);
+    if (job->source == TEXTURE_SOURCE_BLOCKS) file_view_close(&job->file);
+    job->pixels = NULL;
+}
+
+static int _worker(void *data) {
+    TextureLoader *loader = (TextureLoader*)data;
+    SDL_LockMutex(loader->mutex);
+    for (;;) {
+        while (!loader->quit && loader->next_job == loader->job_count) {
+            SDL_WaitCondition(loader->wake, loader->mutex);
+        }
+        if (loader->quit) break;
+
+        // the render thread leaves a job alone until it is decoded, so
+        // the worker fills in a copy and writes it back whole
+        size_t index = loader->next_job++;
+        loader->jobs[index].status = TEXTURE_DECODING;
+        TextureJob job = loader->jobs[index];
+        bool block_compression = loader->block_compression;
+        SDL_UnlockMutex(loader->mutex);
+
+        uint64_t start = SDL_GetPerformanceCounter();
+        int result = _load(&job, block_compression);
+        job.decode_ms = _elapsed_ms(start);
+        job.status = result == 0 ? TEXTURE_DECODED : TEXTURE_FAILED;
+
+        SDL_LockMutex(loader->mutex);
+        loader->jobs[index] = job;
+        loader->stats.decode_ms += job.decode_ms;
+        if (result != 0) loader->stats.failed++;
+    }
+    SDL_UnlockMutex(loader->mutex);
+    return 0;
+}
+
+void texture_loader_init(TextureLoader *loader, int thread_count, bool block_compression) {
+    memset(loader, 0, sizeof(TextureLoader));
+    loader->block_compression = block_compression;
+    loader->mutex = SDL_CreateMutex();
+    loader->wake = SDL_CreateCondition();
+
+    // leave a core to the render thread
+    if (thread_count <= 0) thread_count = SDL_GetNumLogicalCPUCores() - 1;
+    if (thread_count < 1) thread_count = 1;
+    if (thread_count > TEXTURE_LOADER_MAX_THREADS) thread_count = TEXTURE_LOADER_MAX_THREADS;
+
+    for (int i = 0; i < thread_count; i++) {
+        SDL_Thread *thread = SDL_CreateThread(_worker, "texture decode", loader);
+        if (!thread) {
+            fprintf(stderr, "Failed to create a texture decode thread: %s\n", SDL_GetError());
+            break;
+        }
+        loader->threads[loader->thread_count++] = thread;
+    }
+}
+
+uint32_t texture_loader_request(TextureLoader *loader, const char *path, bool srgb) {
+    SDL_LockMutex(loader->mutex);
+    if (loader->job_count == loader->job_capacity) {
+        size_t capacity = loader->job_capacity ? loader->job_capacity * 2 : 16;
+        TextureJob *grown = (TextureJob*)realloc(loader->jobs, sizeof(TextureJob) * capacity);
+        if (!grown) {
+            SDL_UnlockMutex(loader->mutex);
+            fprintf(stderr, "Out of memory queueing texture %s\n", path);
+            abort();
+        }
+        loader->jobs = grown;
+        loader->job_capacity = capacity;
+    }
+    uint32_t handle = (uint32_t)loader->job_count++;
+    loader->jobs[handle] = (TextureJob){ .path = path, .srgb = srgb, .status = TEXTURE_QUEUED };
+    loader->stats.requested++;
+    SDL_SignalCondition(loader->wake);
+    SDL_UnlockMutex(loader->mutex);
+    return handle;
+}
+
+static uint32_t _mip_level_count(uint32_t width, uint32_t height) {
+    uint32_t size = width > height ? width : height;
+    uint32_t count = 1;
+    while (size > 1) {
+        size >>= 1;
+        count++;
+    }
+    return count;
+}
+
+// Images get their chain from the mipmap generator, which fills in
+// RGBA8Unorm through storage views and RGBA8UnormSrgb by rendering.
+static WGPUTexture _create_texture(WGPUDevice device, const TextureJob *job) {
+    WGPUTextureUsage usage = WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst;
+    uint32_t level_count = job->level_count;
+    if (job->source == TEXTURE_SOURCE_IMAGE) {
+        usage |= job->srgb ? WGPUTextureUsage_RenderAttachment : WGPUTextureUsage_StorageBinding;
+        level_count = _mip_level_count(job->width, job->height);
+    }
+    WGPUTextureDescriptor desc = {
+        .nextInChain = NULL,
+        .label = {
+            .data = job->path,
+            .length = WGPU_STRLEN
+        },
+        .usage = usage,
+        .dimension = WGPUTextureDimension_2D,
+        .size = { job->width, job->height, 1 },
+        .format = job->format,
+        .mipLevelCount = level_count,
+        .sampleCount = 1,
+        .viewFormatCount = 0,
+        .viewFormats = NULL
+    };
+    return wgpuDeviceCreateTexture(device, &desc);
+}
+
+static uint64_t _upload(UploadRing *ring, WGPUTexture texture, const TextureJob *job) {
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < job->level_count; i++) {
+        uint32_t width = _mip_size(job->width, i), height = _mip_size(job->height, i);
+        if (job->source == TEXTURE_SOURCE_BLOCKS) {
+            upload_ring_write_texture_blocks(ring, texture, i, job->levels[i], width, height, job->block_size);
+            uint64_t blocks_x = (width + UPLOAD_BLOCK_DIM - 1) / UPLOAD_BLOCK_DIM;
+            uint64_t blocks_y = (height + UPLOAD_BLOCK_DIM - 1) / UPLOAD_BLOCK_DIM;
+            bytes += blocks_x * blocks_y * job->block_size;
+        } else {
+            upload_ring_write_texture(ring, texture, i, job->levels[i], width, height, 4);
+            bytes += (uint64_t)width * height * 4;
+        }
+    }
+    return bytes;
+}
+
+size_t texture_loader_poll(TextureLoader *loader, UploadRing *ring, MipmapGenerator *mipmaps) {
+    // the data is taken out under the lock, everything touching the device
+    // happens after it is released
+    TextureJob taken[TEXTURE_LOADER_POLL_BATCH];
+    uint32_t handles[TEXTURE_LOADER_POLL_BATCH];
+    size_t count = 0;
+    if (!SDL_TryLockMutex(loader->mutex)) return 0;
+    for (size_t i = 0; i < loader->job_count && count < TEXTURE_LOADER_POLL_BATCH; i++) {
+        TextureJob *job = &loader->jobs[i];
+        if (job->status != TEXTURE_DECODED) continue;
+        taken[count] = *job;
+        handles[count] = (uint32_t)i;
+        count++;
+        job->pixels = NULL;
+        memset(&job->file, 0, sizeof(FileView));
+        job->status = TEXTURE_READY;
+    }
+    SDL_UnlockMutex(loader->mutex);
+    if (count == 0) return 0;
+
+    // jobs is only reallocated by texture_loader_request on this thread, and
+    // workers never touch texture, so it is written without the lock
+    WGPUTexture generate[TEXTURE_LOADER_POLL_BATCH];
+    size_t generate_count = 0;
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        WGPUTexture texture = _create_texture(ring->device, &taken[i]);
+        bytes += _upload(ring, texture, &taken[i]);
+        if (taken[i].source == TEXTURE_SOURCE_IMAGE) generate[generate_count++] = texture;
+        _free_data(&taken[i]);
+        loader->jobs[handles[i]].texture = texture;
+    }
+    // submits the level 0 copies ahead of the chains, cooked levels go out
+    // with the ring's next submit
+    if (generate_count > 0) mipmap_generate(mipmaps, ring, generate, generate_count);
+
+    SDL_LockMutex(loader->mutex);
+    loader->stats.ready += (uint32_t)count;
+    loader->stats.bytes += bytes;
+    SDL_UnlockMutex(loader->mutex);
+    return count;
+}
+
+WGPUTexture texture_loader_get(const TextureLoader *loader, uint32_t handle) {
+    if (handle >= loader->job_count) return NULL;
+    return loader->jobs[handle].texture;
+}
+
+void texture_loader_release(TextureLoader *loader) {
+    SDL_LockMutex(loader->mutex);
+    loader->quit = true;
+    SDL_BroadcastCondition(loader->wake);
+    SDL_UnlockMutex(loader->mutex);
+    for (int i = 0; i < loader->thread_count; i++) {
+        SDL_WaitThread(loader->threads[i], NULL);
+    }
+
+    for (size_t i = 0; i < loader->job_count; i++) {
+        TextureJob *job = &loader->jobs[i];
+        if (job->status == TEXTURE_DECODED) _free_data(job);
+        if (job->texture) wgpuTextureRelease(job->texture);
+    }
+    free(loader->jobs);
+    SDL_DestroyCondition(loader->wake);
+    SDL_DestroyMutex(loader->mutex);
+    memset(loader, 0, sizeof(TextureLoader));
+}
@@ -0,0 +1,76 @@
+#include "uniform_arena.h"
+#include <stdio.h>
+#include <string.h>
+
+static WGPUBuffer _create_buffer(WGPUDevice device, size_t size) {
+    WGPUBufferDescriptor desc = {
+        .nextInChain = NULL,
+        .usage = WGPUBufferUsage_Uniform | WGPUBufferUsage_CopyDst,
+        .size = size,
+        .mappedAtCreation = false
+    };
+    return wgpuDeviceCreateBuffer(device, &desc);
+}
+
+void uniform_arena_init(UniformArena *arena, WGPUDevice device, size_t slot_size) {
+    memset(arena, 0, sizeof(UniformArena));
+    arena->slot_size = slot_size;
+    arena->slot_capacity = UNIFORM_ARENA_INITIAL_SLOTS;
+    arena->staged_capacity = UNIFORM_ARENA_INITIAL_SLOTS;
+    arena->staged = (uint8_t*)malloc(slot_size * arena->staged_capacity);
+    arena->buffer = _create_buffer(device, slot_size * arena->slot_capacity * UPLOAD_RING_FRAMES);
+}
+
+void uniform_arena_begin_frame(UniformArena *arena) {
+    arena->region = (arena->region + 1) % UPLOAD_RING_FRAMES;
+    arena->slot_count = 0;
+}
+
+uint32_t uniform_arena_push(UniformArena *arena, const void *data, size_t size) {
+    if (size > arena->slot_size) {
+        fprintf(stderr, "Uniform of %zu bytes does not fit a %zu byte slot\n", size, arena->slot_size);
+        size = arena->slot_size;
+    }
+
+    // only the staged copy grows here, the buffer follows in flush
+    if (arena->slot_count == arena->staged_capacity) {
+        uint32_t capacity = arena->staged_capacity * 2;
+        uint8_t *grown = (uint8_t*)realloc(arena->staged, arena->slot_size * capacity);
+        if (!grown) {
+            fprintf(stderr, "Out of memory growing the uniform arena\n");
+            exit(1);
+        }
+        arena->staged = grown;
+        arena->staged_capacity = capacity;
+    }
+
+    uint8_t *slot = arena->staged + (size_t)arena->slot_count * arena->slot_size;
+    memcpy(slot, data, size);
+    memset(slot + size, 0, arena->slot_size - size);
+    return arena->slot_count++;
+}
+
+void uniform_arena_flush(UniformArena *arena, WGPUDevice device, UploadRing *ring) {
+    if (arena->slot_count > arena->slot_capacity) {
+        // every frame writes all of its slots, so nothing is copied over
+        while (arena->slot_capacity < arena->slot_count) arena->slot_capacity *= 2;
+        wgpuBufferRelease(arena->buffer);
+        arena->buffer = _create_buffer(device, arena->slot_size * arena->slot_capacity * UPLOAD_RING_FRAMES);
+        arena->generation++;
+        printf("Uniform arena grew to %u slots per frame\n", arena->slot_capacity);
+    }
+    if (arena->slot_count == 0) return;
+
+    upload_ring_write(ring, arena->buffer, uniform_arena_offset(arena, 0),
+                      arena->staged, (size_t)arena->slot_count * arena->slot_size);
+}
+
+uint32_t uniform_arena_offset(const UniformArena *arena, uint32_t slot) {
+    return (uint32_t)(((size_t)arena->region * arena->slot_capacity + slot) * arena->slot_size);
+}
+
+void uniform_arena_release(UniformArena *arena) {
+    wgpuBufferRelease(arena->buffer);
+    free(arena->staged);
+    memset(arena, 0, sizeof(UniformArena));
+}
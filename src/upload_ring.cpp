@@ -0,0 +1,242 @@
+#include "upload_ring.h"
+#include <stdio.h>
+#include <string.h>
+#include <wgpu.h>
+
+static void _on_staging_mapped(
+    WGPUMapAsyncStatus status,
+    WGPUStringView message,
+    void *userdata1,
+    void *userdata2)
+{
+    StagingState *state = (StagingState*)userdata1;
+    if (status != WGPUMapAsyncStatus_Success) {
+        fprintf(stderr, "Staging buffer map failed: %.*s\n", (int)message.length, message.data);
+        *state = STAGING_MAP_FAILED;
+        return;
+    }
+    *state = STAGING_MAPPED;
+}
+
+void upload_ring_init(UploadRing *ring, WGPUInstance instance, WGPUDevice device, WGPUQueue queue) {
+    memset(ring, 0, sizeof(UploadRing));
+    ring->instance = instance;
+    ring->device = device;
+    ring->queue = queue;
+
+    WGPUBufferDescriptor staging_desc = {
+        .nextInChain = NULL,
+        .usage = WGPUBufferUsage_MapWrite | WGPUBufferUsage_CopySrc,
+        .size = UPLOAD_RING_SIZE,
+        .mappedAtCreation = true
+    };
+    for (int i = 0; i < UPLOAD_RING_FRAMES; i++) {
+        ring->staging[i] = wgpuDeviceCreateBuffer(device, &staging_desc);
+        ring->state[i] = STAGING_MAPPED;
+    }
+}
+
+// Makes the current staging buffer writable, blocking until the GPU is done
+// copying out of it. A buffer that cannot be mapped again would lose every
+// later upload, so that exits.
+static void _acquire(UploadRing *ring) {
+    if (ring->mapping) return;
+
+    StagingState *state = &ring->state[ring->current];
+    if (*state == STAGING_IN_FLIGHT) {
+        wgpuInstanceProcessEvents(ring->instance);
+    }
+    if (*state == STAGING_IN_FLIGHT) {
+        ring->stats.stalls++;
+        while (*state == STAGING_IN_FLIGHT) {
+            wgpuDevicePoll(ring->device, true, NULL);
+        }
+    }
+    if (*state == STAGING_MAP_FAILED) {
+        fprintf(stderr, "Staging buffer %d could not be mapped for upload\n", ring->current);
+        exit(1);
+    }
+
+    ring->mapping = (uint8_t*)wgpuBufferGetMappedRange(ring->staging[ring->current], 0, UPLOAD_RING_SIZE);
+    ring->head = 0;
+}
+
+static void _push_copy(UploadRing *ring, WGPUBuffer dst, uint64_t dst_offset, uint64_t src_offset, uint64_t size) {
+    if (ring->copy_count == ring->copy_capacity) {
+        size_t capacity = ring->copy_capacity ? ring->copy_capacity * 2 : 64;
+        UploadCopy *grown = (UploadCopy*)realloc(ring->copies, sizeof(UploadCopy) * capacity);
+        if (!grown) {
+            fprintf(stderr, "Out of memory recording an upload\n");
+            exit(1);
+        }
+        ring->copies = grown;
+        ring->copy_capacity = capacity;
+    }
+    UploadCopy *copy = &ring->copies[ring->copy_count++];
+    copy->dst = dst;
+    copy->dst_offset = dst_offset;
+    copy->src_offset = src_offset;
+    copy->size = size;
+}
+
+void upload_ring_write(UploadRing *ring, WGPUBuffer dst, uint64_t dst_offset, const void *data, size_t size) {
+    if (size % UPLOAD_COPY_ALIGNMENT != 0 || dst_offset % UPLOAD_COPY_ALIGNMENT != 0) {
+        fprintf(stderr, "Unaligned upload of %zu bytes at %llu\n", size, (unsigned long long)dst_offset);
+        return;
+    }
+
+    const uint8_t *src = (const uint8_t*)data;
+    while (size > 0) {
+        _acquire(ring);
+        size_t space = UPLOAD_RING_SIZE - ring->head;
+        if (space == 0) {
+            upload_ring_submit(ring);
+            continue;
+        }
+        size_t chunk = size < space ? size : space;
+        memcpy(ring->mapping + ring->head, src, chunk);
+        _push_copy(ring, dst, dst_offset, ring->head, chunk);
+
+        ring->head += chunk;
+        ring->stats.bytes_this_frame += chunk;
+        src += chunk;
+        dst_offset += chunk;
+        size -= chunk;
+    }
+}
+
+static void _push_texture_copy(UploadRing *ring, const UploadTextureCopy *copy) {
+    if (ring->texture_copy_count == ring->texture_copy_capacity) {
+        size_t capacity = ring->texture_copy_capacity ? ring->texture_copy_capacity * 2 : 16;
+        UploadTextureCopy *grown = (UploadTextureCopy*)realloc(ring->texture_copies, sizeof(UploadTextureCopy) * capacity);
+        if (!grown) {
+            fprintf(stderr, "Out of memory recording a texture upload\n");
+            exit(1);
+        }
+        ring->texture_copies = grown;
+        ring->texture_copy_capacity = capacity;
+    }
+    ring->texture_copies[ring->texture_copy_count++] = *copy;
+}
+
+// Stages row_count rows of row_size bytes. Each row covers block_dim texel
+// rows of a copy width texels wide.
+static void _write_rows(UploadRing *ring, WGPUTexture dst, uint32_t mip_level, const uint8_t *src,
+                        uint32_t row_count, size_t row_size, uint32_t width, uint32_t block_dim) {
+    size_t pitch = (row_size + UPLOAD_ROW_ALIGNMENT - 1) / UPLOAD_ROW_ALIGNMENT * UPLOAD_ROW_ALIGNMENT;
+    if (pitch > UPLOAD_RING_SIZE) {
+        fprintf(stderr, "Texture rows of %zu bytes do not fit a staging buffer\n", row_size);
+        return;
+    }
+
+    uint32_t y = 0;
+    while (y < row_count) {
+        _acquire(ring);
+        size_t offset = (ring->head + UPLOAD_ROW_ALIGNMENT - 1) / UPLOAD_ROW_ALIGNMENT * UPLOAD_ROW_ALIGNMENT;
+        size_t fit = offset < UPLOAD_RING_SIZE ? (UPLOAD_RING_SIZE - offset) / pitch : 0;
+        if (fit == 0) {
+            upload_ring_submit(ring);
+            continue;
+        }
+        uint32_t rows = fit < row_count - y ? (uint32_t)fit : row_count - y;
+        for (uint32_t r = 0; r < rows; r++) {
+            memcpy(ring->mapping + offset + r * pitch, src + (size_t)(y + r) * row_size, row_size);
+        }
+
+        UploadTextureCopy copy = {
+            .dst = dst,
+            .mip_level = mip_level,
+            .y = y * block_dim,
+            .width = width,
+            .rows = rows * block_dim,
+            .bytes_per_row = (uint32_t)pitch,
+            .src_offset = offset
+        };
+        _push_texture_copy(ring, &copy);
+
+        ring->head = offset + rows * pitch;
+        ring->stats.bytes_this_frame += rows * row_size;
+        y += rows;
+    }
+}
+
+void upload_ring_write_texture(UploadRing *ring, WGPUTexture dst, uint32_t mip_level, const void *data,
+                               uint32_t width, uint32_t height, uint32_t texel_size) {
+    _write_rows(ring, dst, mip_level, (const uint8_t*)data, height, (size_t)width * texel_size, width, 1);
+}
+
+void upload_ring_write_texture_blocks(UploadRing *ring, WGPUTexture dst, uint32_t mip_level, const void *data,
+                                      uint32_t width, uint32_t height, uint32_t block_size) {
+    // copies of compressed levels cover the physical size, whole blocks
+    uint32_t blocks_x = (width + UPLOAD_BLOCK_DIM - 1) / UPLOAD_BLOCK_DIM;
+    uint32_t blocks_y = (height + UPLOAD_BLOCK_DIM - 1) / UPLOAD_BLOCK_DIM;
+    _write_rows(ring, dst, mip_level, (const uint8_t*)data, blocks_y, (size_t)blocks_x * block_size,
+                blocks_x * UPLOAD_BLOCK_DIM, UPLOAD_BLOCK_DIM);
+}
+
+void upload_ring_submit(UploadRing *ring) {
+    if (!ring->mapping) return;
+
+    WGPUBuffer staging = ring->staging[ring->current];
+    wgpuBufferUnmap(staging);
+    ring->mapping = NULL;
+
+    WGPUCommandEncoder encoder = wgpuDeviceCreateCommandEncoder(ring->device, NULL);
+    for (size_t i = 0; i < ring->copy_count; i++) {
+        const UploadCopy *copy = &ring->copies[i];
+        wgpuCommandEncoderCopyBufferToBuffer(encoder, staging, copy->src_offset,
+                                             copy->dst, copy->dst_offset, copy->size);
+    }
+    for (size_t i = 0; i < ring->texture_copy_count; i++) {
+        const UploadTextureCopy *copy = &ring->texture_copies[i];
+        WGPUTexelCopyBufferInfo source = {
+            .layout = {
+                .offset = copy->src_offset,
+                .bytesPerRow = copy->bytes_per_row,
+                .rowsPerImage = WGPU_COPY_STRIDE_UNDEFINED
+            },
+            .buffer = staging
+        };
+        WGPUTexelCopyTextureInfo destination = {
+            .texture = copy->dst,
+            .mipLevel = copy->mip_level,
+            .origin = { 0, copy->y, 0 },
+            .aspect = WGPUTextureAspect_All
+        };
+        WGPUExtent3D extent = { copy->width, copy->rows, 1 };
+        wgpuCommandEncoderCopyBufferToTexture(encoder, &source, &destination, &extent);
+    }
+    WGPUCommandBuffer command_buffer = wgpuCommandEncoderFinish(encoder, NULL);
+    wgpuCommandEncoderRelease(encoder);
+    wgpuQueueSubmit(ring->queue, 1, &command_buffer);
+    wgpuCommandBufferRelease(command_buffer);
+
+    ring->state[ring->current] = STAGING_IN_FLIGHT;
+    WGPUBufferMapCallbackInfo map_callback_info = {
+        .nextInChain = NULL,
+        .mode = WGPUCallbackMode_AllowProcessEvents,
+        .callback = _on_staging_mapped,
+        .userdata1 = &ring->state[ring->current]
+    };
+    wgpuBufferMapAsync(staging, WGPUMapMode_Write, 0, UPLOAD_RING_SIZE, map_callback_info);
+
+    ring->copy_count = 0;
+    ring->texture_copy_count = 0;
+    ring->current = (ring->current + 1) % UPLOAD_RING_FRAMES;
+    ring->stats.submits++;
+}
+
+void upload_ring_end_frame(UploadRing *ring) {
+    upload_ring_submit(ring);
+    ring->stats.bytes_last_frame = ring->stats.bytes_this_frame;
+    ring->stats.bytes_this_frame = 0;
+}
+
+void upload_ring_release(UploadRing *ring) {
+    for (int i = 0; i < UPLOAD_RING_FRAMES; i++) {
+        wgpuBufferRelease(ring->staging[i]);
+    }
+    free(ring->copies);
+    free(ring->texture_copies);
+    memset(ring, 0, sizeof(UploadRing));
+}
@@ -1,47 +1,23 @@
 #include "util.hpp"
 
-void u_load_spirv(const char* path, uint32_t** out_data, int* out_word_count) {
+void u_load_spirv(const char* path, FileView* out_view, const uint32_t** out_data, int* out_word_count) {
     *out_data = NULL;
     if (out_word_count) {
         *out_word_count = 0;
     }
-    FILE* f = fopen(path, "rb");
-    if (!f) {
+    if (file_view_open(path, out_view) != 0) {
         fprintf(stderr, "Failed to open %s\n", path);
         return;
     }
-    if (fseek(f, 0, SEEK_END) != 0) {
-        fprintf(stderr, "Failed to seek %s\n", path);
-        fclose(f);
-        return;
-    }
-    long size = ftell(f);
-    if (size < 0 || size % 4 != 0) {
+    if (out_view->size == 0 || out_view->size % 4 != 0) {
         fprintf(stderr, "Bad SPIR-V file size for %s\n", path);
-        fclose(f);
-        return;
-    }
-    if (fseek(f, 0, SEEK_SET) != 0) {
-        fprintf(stderr, "Failed to rewind %s\n", path);
-        fclose(f);
-        return;
-    }
-    uint32_t* data = (uint32_t*)malloc((size_t)size);
-    if (!data) {
-        fprintf(stderr, "Out of memory reading %s\n", path);
-        fclose(f);
-        return;
-    }
-    if (fread(data, 1, (size_t)size, f) != (size_t)size) {
-        fprintf(stderr, "Failed to read %s\n", path);
-        free(data);
-        fclose(f);
+        file_view_close(out_view);
         return;
     }
-    fclose(f);
-    *out_data = data;
+    // views are page or malloc aligned
+    *out_data = (const uint32_t*)out_view->data;
     if (out_word_count) {
-        *out_word_count = (size_t)size / 4;
+        *out_word_count = (int)(out_view->size / 4);
     }
 }
 
@@ -87,6 +63,17 @@ void u_print_adapter_info(WGPUAdapter adapter) {
     printf("========================\n");
 }
 
+bool u_adapter_has_feature(WGPUAdapter adapter, WGPUFeatureName feature) {
+    WGPUSupportedFeatures features = {};
+    wgpuAdapterGetFeatures(adapter, &features);
+    bool found = false;
+    for (size_t i = 0; i < features.featureCount; ++i) {
+        if (features.features[i] == feature) found = true;
+    }
+    wgpuSupportedFeaturesFreeMembers(features);
+    return found;
+}
+
 void u_print_device_info(WGPUDevice device) {
     // --- Device features
     WGPUSupportedFeatures dfeatures = (WGPUSupportedFeatures){};
@@ -0,0 +1,154 @@
+#include "vertex_quant.h"
+#include <math.h>
+#include <string.h>
+
+#define VERTEX_QUANT_SRC_FLOATS 8
+
+uint16_t vertex_float_to_half(float f) {
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000u;
+    uint32_t exp = (x >> 23) & 0xffu;
+    uint32_t mant = x & 0x7fffffu;
+
+    if (exp == 0xff) return (uint16_t)(sign | 0x7c00u | (mant ? 0x200u : 0u));  // inf, nan
+
+    int e = (int)exp - 127 + 15;
+    if (e >= 31) return (uint16_t)(sign | 0x7c00u);
+    if (e <= 0) {
+        // subnormal half, or zero
+        if (e < -10) return (uint16_t)sign;
+        mant |= 0x800000u;
+        int shift = 14 - e;
+        uint32_t half = mant >> shift;
+        uint32_t rem = mant & ((1u << shift) - 1);
+        uint32_t mid = 1u << (shift - 1);
+        if (rem > mid || (rem == mid && (half & 1))) half++;
+        return (uint16_t)(sign | half);
+    }
+
+    // round to nearest even, a carry out of the mantissa bumps the exponent
+    uint32_t half = ((uint32_t)e << 10) | (mant >> 13);
+    uint32_t rem = mant & 0x1fffu;
+    if (rem > 0x1000u || (rem == 0x1000u && (half & 1))) half++;
+    return (uint16_t)(sign | half);
+}
+
+float vertex_half_to_float(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000u) << 16;
+    uint32_t exp = (h >> 10) & 0x1fu;
+    uint32_t mant = h & 0x3ffu;
+    uint32_t x;
+
+    if (exp == 0) {
+        float f = ldexpf((float)mant, -24);
+        return sign ? -f : f;
+    }
+    if (exp == 31) {
+        x = sign | 0x7f800000u | (mant << 13);
+    } else {
+        x = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+    }
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+static int16_t _snorm16(float v) {
+    if (v > 1.0f) v = 1.0f;
+    if (v < -1.0f) v = -1.0f;
+    return (int16_t)lrintf(v * 32767.0f);
+}
+
+static float _sign_not_zero(float v) {
+    return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+// Cigolle et al., "A Survey of Efficient Representations for Independent Unit Vectors"
+static void _oct_encode(const float n[3], int16_t out[2]) {
+    float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+    if (l1 == 0.0f) {
+        out[0] = 0;
+        out[1] = 0;
+        return;
+    }
+    float x = n[0] / l1;
+    float y = n[1] / l1;
+    if (n[2] < 0.0f) {
+        float fx = (1.0f - fabsf(y)) * _sign_not_zero(x);
+        float fy = (1.0f - fabsf(x)) * _sign_not_zero(y);
+        x = fx;
+        y = fy;
+    }
+    out[0] = _snorm16(x);
+    out[1] = _snorm16(y);
+}
+
+// Inverse of _oct_encode, used only to measure the quantization error
+static void _oct_decode(const int16_t in[2], float n[3]) {
+    float x = fmaxf((float)in[0] / 32767.0f, -1.0f);
+    float y = fmaxf((float)in[1] / 32767.0f, -1.0f);
+    float z = 1.0f - fabsf(x) - fabsf(y);
+    float t = fmaxf(-z, 0.0f);
+    x += x >= 0.0f ? -t : t;
+    y += y >= 0.0f ? -t : t;
+    float len = sqrtf(x * x + y * y + z * z);
+    n[0] = x / len;
+    n[1] = y / len;
+    n[2] = z / len;
+}
+
+void vertex_quantize(const float *src, size_t count, QuantizedVertex *dst,
+                     float pos_min[3], float pos_extent[3], VertexQuantError *out_error) {
+    float pos_max[3];
+    for (int k = 0; k < 3; k++) {
+        pos_min[k] = count ? src[k] : 0.0f;
+        pos_max[k] = pos_min[k];
+    }
+    for (size_t i = 0; i < count; i++) {
+        const float *v = &src[VERTEX_QUANT_SRC_FLOATS * i];
+        for (int k = 0; k < 3; k++) {
+            pos_min[k] = fminf(pos_min[k], v[k]);
+            pos_max[k] = fmaxf(pos_max[k], v[k]);
+        }
+    }
+    for (int k = 0; k < 3; k++) {
+        pos_extent[k] = pos_max[k] - pos_min[k];
+    }
+
+    VertexQuantError error = {0.0f, 0.0f, 0.0f};
+    for (size_t i = 0; i < count; i++) {
+        const float *v = &src[VERTEX_QUANT_SRC_FLOATS * i];
+        QuantizedVertex *q = &dst[i];
+
+        for (int k = 0; k < 3; k++) {
+            float t = pos_extent[k] > 0.0f ? (v[k] - pos_min[k]) / pos_extent[k] : 0.0f;
+            q->pos[k] = (uint16_t)lrintf(fminf(fmaxf(t, 0.0f), 1.0f) * 65535.0f);
+            float decoded = pos_min[k] + (float)q->pos[k] / 65535.0f * pos_extent[k];
+            error.position = fmaxf(error.position, fabsf(decoded - v[k]));
+        }
+        q->pos[3] = 0;
+
+        _oct_encode(&v[3], q->norm);
+        float n_len = sqrtf(v[3] * v[3] + v[4] * v[4] + v[5] * v[5]);
+        if (n_len > 0.0f) {
+            float n[3];
+            _oct_decode(q->norm, n);
+            // atan2 of |cross| and dot stays accurate for tiny angles, unlike acos
+            float cx = n[1] * v[5] - n[2] * v[4];
+            float cy = n[2] * v[3] - n[0] * v[5];
+            float cz = n[0] * v[4] - n[1] * v[3];
+            float sin_a = sqrtf(cx * cx + cy * cy + cz * cz) / n_len;
+            float cos_a = (n[0] * v[3] + n[1] * v[4] + n[2] * v[5]) / n_len;
+            float deg = atan2f(sin_a, cos_a) * (180.0f / 3.14159265f);
+            error.normal_deg = fmaxf(error.normal_deg, deg);
+        }
+
+        for (int k = 0; k < 2; k++) {
+            q->uv[k] = vertex_float_to_half(v[6 + k]);
+            error.uv = fmaxf(error.uv, fabsf(vertex_half_to_float(q->uv[k]) - v[6 + k]));
+        }
+    }
+
+    if (out_error) *out_error = error;
+}
@@ -0,0 +1,17 @@
+// Device-free checks of the CPU code, run with ctest or ./build/tests.
+#include "test.h"
+
+int test_failures = 0;
+
+int main() {
+    test_cull();
+    test_tinyobj();
+    test_mipmap();
+    test_texture_codec();
+    if (test_failures) {
+        fprintf(stderr, "%d checks failed\n", test_failures);
+        return 1;
+    }
+    printf("All tests passed\n");
+    return 0;
+}
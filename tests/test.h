@@ -0,0 +1,21 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+// Counts failures instead of stopping, so one run reports every broken check.
+extern int test_failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        test_failures++; \
+    } \
+} while (0)
+
+void test_cull(void);
+void test_tinyobj(void);
+void test_mipmap(void);
+void test_texture_codec(void);
+
+#endif
@@ -0,0 +1,188 @@
+#include "test.h"
+#include <math.h>
+#include <string.h>
+// built into this file for _test_scalar and each SIMD width
+#include "../src/cull.cpp"
+
+static uint32_t _rand(uint32_t *state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+// Small integers and eighths keep every product and sum exact, so the SIMD
+// paths have to agree with the scalar one bit for bit, ties included.
+static float _rand_eighths(uint32_t *state, int range) {
+    return (float)((int)(_rand(state) % (uint32_t)(2 * range * 8 + 1)) - range * 8) / 8.0f;
+}
+
+static void _fill(CullSet *set, size_t count, uint32_t *state) {
+    cull_set_reset(set);
+    _reserve(set, count);
+    for (size_t i = 0; i < count; i++) {
+        set->x[i] = _rand_eighths(state, 16);
+        set->y[i] = _rand_eighths(state, 16);
+        set->z[i] = _rand_eighths(state, 16);
+        set->radius[i] = (float)(_rand(state) % 32) / 8.0f;
+    }
+    set->count = count;
+}
+
+typedef struct CullPath {
+    const char *name;
+    size_t (*test)(CullSet *set, const float planes[6][4], size_t begin);
+} CullPath;
+
+// cull_test and every SIMD loop this build and CPU can run.
+static size_t _simd_paths(CullPath paths[4]) {
+    size_t count = 0;
+    paths[count++] = (CullPath){ "cull_test", NULL };
+#if defined(CULL_SIMD_SSE)
+    paths[count++] = (CullPath){ "sse", _test_sse };
+#endif
+#if defined(CULL_SIMD_AVX)
+    if (__builtin_cpu_supports("avx")) paths[count++] = (CullPath){ "avx", _test_avx };
+#endif
+#if defined(CULL_SIMD_NEON)
+    paths[count++] = (CullPath){ "neon", _test_neon };
+#endif
+    return count;
+}
+
+static void _test_simd_matches_scalar(void) {
+    CullPath paths[4];
+    size_t path_count = _simd_paths(paths);
+    static const size_t counts[] = { 0, 1, 3, 4, 5, 7, 8, 9, 13, 15, 17, 31, 33, 63, 100, 1001 };
+    uint32_t state = 12345;
+    CullSet set = {};
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        for (int round = 0; round < 20; round++) {
+            float planes[6][4];
+            for (int p = 0; p < 6; p++) {
+                for (int k = 0; k < 3; k++) planes[p][k] = _rand_eighths(&state, 1);
+                planes[p][3] = _rand_eighths(&state, 8);
+            }
+            _fill(&set, counts[c], &state);
+            uint8_t *expected = (uint8_t*)malloc(set.count + 1);
+            size_t expected_visible = _test_scalar(&set, planes, 0);
+            if (set.count) memcpy(expected, set.visible, set.count);
+
+            for (size_t p = 0; p < path_count; p++) {
+                if (set.count) memset(set.visible, 0xff, set.count);
+                size_t visible;
+                if (paths[p].test) {
+                    visible = paths[p].test(&set, planes, 0);
+                } else {
+                    CullStats stats;
+                    cull_test(&set, planes, &stats);
+                    CHECK(stats.visible + stats.culled == set.count);
+                    visible = stats.visible;
+                }
+                if (visible != expected_visible || (set.count && memcmp(expected, set.visible, set.count) != 0)) {
+                    fprintf(stderr, "%s differs from scalar on %zu spheres\n", paths[p].name, set.count);
+                    test_failures++;
+                }
+            }
+            free(expected);
+        }
+    }
+    cull_set_release(&set);
+}
+
+// The box |x|, |y|, |z| <= 10 as six inward planes.
+static void _box_planes(float planes[6][4]) {
+    float box[6][4] = {
+        {  1,  0,  0, 10 }, { -1,  0,  0, 10 },
+        {  0,  1,  0, 10 }, {  0, -1,  0, 10 },
+        {  0,  0,  1, 10 }, {  0,  0, -1, 10 },
+    };
+    memcpy(planes, box, sizeof(box));
+}
+
+static void _test_straddling(void) {
+    float planes[6][4];
+    _box_planes(planes);
+    // centers past the x = 10 face by less, exactly, and more than the radius;
+    // 9 of them so the SIMD loops and the scalar tail both see each case
+    static const float offsets[] = { -1.0f, 0.5f, 1.0f, 1.5f };
+    static const uint8_t expected[] = { 1, 1, 1, 0 };
+    CullSet set = {};
+    for (int o = 0; o < 4; o++) {
+        cull_set_reset(&set);
+        for (int i = 0; i < 9; i++) {
+            float identity[4][4] = { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 10 + offsets[o], 0, 0, 1 } };
+            float center[3] = { 0, 0, 0 };
+            cull_set_add(&set, identity, center, 1.0f);
+        }
+        CullStats stats;
+        cull_test(&set, planes, &stats);
+        for (int i = 0; i < 9; i++) CHECK(set.visible[i] == expected[o]);
+        CHECK(stats.visible == (expected[o] ? 9u : 0u));
+    }
+    cull_set_release(&set);
+}
+
+static void _test_zero_length_plane(void) {
+    // rows x, y, z are the identity and row w is (1, 0, 0, 1), so the right
+    // plane w - x has no normal and has to be kept as is, not divided by 0
+    float view_projection[4][4] = {
+        { 1, 0, 0, 1 },
+        { 0, 1, 0, 0 },
+        { 0, 0, 1, 0 },
+        { 0, 0, 0, 1 },
+    };
+    float planes[6][4];
+    cull_frustum_planes(view_projection, planes);
+    for (int p = 0; p < 6; p++) {
+        for (int k = 0; k < 4; k++) CHECK(isfinite(planes[p][k]));
+    }
+    CHECK(planes[1][0] == 0.0f && planes[1][1] == 0.0f && planes[1][2] == 0.0f && planes[1][3] == 1.0f);
+    CHECK(planes[0][0] == 1.0f && planes[0][3] == 0.5f);
+
+    // no normal and d >= 0 keeps everything, d < 0 culls everything
+    CullSet set = {};
+    uint32_t state = 7;
+    _fill(&set, 11, &state);
+    float box[6][4];
+    _box_planes(box);
+    for (int p = 0; p < 6; p++) box[p][3] = 100.0f;  // wide enough for every sphere
+    box[2][0] = box[2][1] = box[2][2] = 0.0f;
+    CullStats stats;
+    cull_test(&set, box, &stats);
+    CHECK(stats.visible == 11);
+
+    box[2][3] = -100.0f;
+    cull_test(&set, box, &stats);
+    CHECK(stats.visible == 0);
+    cull_set_release(&set);
+}
+
+static void _test_non_uniform_scale(void) {
+    CullSet set = {};
+    float center[3] = { 1, 1, 1 };
+
+    // scale 1, 3, 0.5 then move by 10 along x
+    float scaled[4][4] = { { 1, 0, 0, 0 }, { 0, 3, 0, 0 }, { 0, 0, 0.5f, 0 }, { 10, 0, 0, 1 } };
+    size_t i = cull_set_add(&set, scaled, center, 2.0f);
+    CHECK(set.x[i] == 11.0f && set.y[i] == 3.0f && set.z[i] == 0.5f);
+    CHECK(set.radius[i] == 6.0f);
+
+    // the same scales rotated 90 degrees about z: the largest axis scale
+    // still sets the radius, wherever the axis ends up pointing
+    float rotated[4][4] = { { 0, 1, 0, 0 }, { -3, 0, 0, 0 }, { 0, 0, 0.5f, 0 }, { 0, 0, 0, 1 } };
+    i = cull_set_add(&set, rotated, center, 2.0f);
+    CHECK(set.x[i] == -3.0f && set.y[i] == 1.0f && set.z[i] == 0.5f);
+    CHECK(set.radius[i] == 6.0f);
+
+    // shrinking on every axis shrinks the sphere by the largest of them
+    float shrunk[4][4] = { { 0.25f, 0, 0, 0 }, { 0, 0.5f, 0, 0 }, { 0, 0, 0.125f, 0 }, { 0, 0, 0, 1 } };
+    i = cull_set_add(&set, shrunk, center, 2.0f);
+    CHECK(set.radius[i] == 1.0f);
+    cull_set_release(&set);
+}
+
+void test_cull(void) {
+    _test_simd_matches_scalar();
+    _test_straddling();
+    _test_zero_length_plane();
+    _test_non_uniform_scale();
+}
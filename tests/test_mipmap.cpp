@@ -0,0 +1,86 @@
+#include "test.h"
+#include <math.h>
+#include "mipmap.h"
+
+// The odd footprints weigh by thirds and fifths, which floats only round to.
+#define MIPMAP_EPSILON 1e-5f
+
+static void _check_downsample(const float *src, uint32_t width, uint32_t height, uint32_t channels,
+                              const float *expected, size_t expected_count) {
+    float dst[16];
+    mipmap_downsample_reference(src, width, height, channels, dst);
+    for (size_t i = 0; i < expected_count; i++) {
+        if (fabsf(dst[i] - expected[i]) > MIPMAP_EPSILON) {
+            fprintf(stderr, "%ux%u texel %zu: %g, expected %g\n", width, height, i, dst[i], expected[i]);
+            test_failures++;
+        }
+    }
+}
+
+static void _test_downsample(void) {
+    // even: plain 2x2 boxes
+    const float even[] = { 0, 1, 2, 3,
+                           4, 5, 6, 7 };
+    const float even_expected[] = { 2.5f, 4.5f };
+    _check_downsample(even, 4, 2, 1, even_expected, 2);
+
+    // one channel is enough for the weights, the others must not mix in
+    const float rgba[] = { 0, 10, 1, 1,   4, 20, 1, 0,
+                           8, 30, 1, 1,  12, 40, 1, 0 };
+    const float rgba_expected[] = { 6, 25, 1, 0.5f };
+    _check_downsample(rgba, 2, 2, 4, rgba_expected, 4);
+
+    // odd: 3 texels down to 1, a third each
+    const float odd3[] = { 0, 1, 2,
+                           3, 4, 5,
+                           6, 7, 8 };
+    const float odd3_expected[] = { 4 };
+    _check_downsample(odd3, 3, 3, 1, odd3_expected, 1);
+
+    // odd: 5 down to 2, weights 2/5 2/5 1/5 and 1/5 2/5 2/5 around texel 2
+    const float odd5[] = { 0, 5, 10, 15, 20 };
+    const float odd5_expected[] = { 4, 16 };
+    _check_downsample(odd5, 5, 1, 1, odd5_expected, 2);
+
+    // 5x3: the same weights across, thirds down
+    const float odd53[] = { 0, 5, 10, 15, 20,
+                            0, 5, 10, 15, 20,
+                            3, 8, 13, 18, 23 };
+    const float odd53_expected[] = { 5, 17 };
+    _check_downsample(odd53, 5, 3, 1, odd53_expected, 2);
+
+    // 1xN keeps its single column, Nx1 its single row
+    const float column[] = { 1, 3, 5, 7 };
+    const float column_expected[] = { 2, 6 };
+    _check_downsample(column, 1, 4, 1, column_expected, 2);
+    _check_downsample(column, 4, 1, 1, column_expected, 2);
+
+    const float column3[] = { 3, 6, 9 };
+    const float column3_expected[] = { 6 };
+    _check_downsample(column3, 1, 3, 1, column3_expected, 1);
+
+    const float single[] = { 0.25f, 0.5f };
+    _check_downsample(single, 1, 1, 2, single, 2);
+}
+
+// Decoding an 8-bit sRGB value to linear and back has to land within one
+// 8-bit step of where it started.
+static void _test_srgb_round_trip(void) {
+    for (int v = 0; v < 256; v++) {
+        float linear = mipmap_srgb_to_linear(v / 255.0f);
+        float back = mipmap_linear_to_srgb(linear) * 255.0f;
+        if (fabsf(back - (float)v) > 1.0f) {
+            fprintf(stderr, "sRGB %d came back as %g\n", v, back);
+            test_failures++;
+        }
+    }
+    CHECK(mipmap_srgb_to_linear(0.0f) == 0.0f);
+    CHECK(fabsf(mipmap_srgb_to_linear(1.0f) - 1.0f) < MIPMAP_EPSILON);
+    CHECK(mipmap_linear_to_srgb(0.0f) == 0.0f);
+    CHECK(fabsf(mipmap_linear_to_srgb(1.0f) - 1.0f) < MIPMAP_EPSILON);
+}
+
+void test_mipmap(void) {
+    _test_downsample();
+    _test_srgb_round_trip();
+}
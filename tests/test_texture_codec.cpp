@@ -0,0 +1,235 @@
+#include "test.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "file_view.h"
+#include "texture_codec.h"
+
+#define CODEC_SIZE 32
+
+static uint32_t _codec_rand(uint32_t *state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+// Smooth gradients, which is what block compression is built for, with a
+// little noise so no block is a single color.
+static void _gradient(uint8_t *rgba, uint32_t width, uint32_t height, uint32_t seed) {
+    uint32_t state = seed;
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            uint8_t *texel = &rgba[((size_t)y * width + x) * 4];
+            texel[0] = (uint8_t)(x * 255 / (width - 1));
+            texel[1] = (uint8_t)(y * 255 / (height - 1));
+            texel[2] = (uint8_t)(128 + _codec_rand(&state) % 8);
+            texel[3] = (uint8_t)((x + y) * 255 / (width + height - 2));
+        }
+    }
+}
+
+static int _max_error(const uint8_t *a, const uint8_t *b, size_t texels, int channels) {
+    int worst = 0;
+    for (size_t i = 0; i < texels; i++) {
+        for (int c = 0; c < channels; c++) {
+            int error = abs((int)a[i * 4 + c] - (int)b[i * 4 + c]);
+            if (error > worst) worst = error;
+        }
+    }
+    return worst;
+}
+
+// Worst channel error over a gradient, per format. BC1 has no alpha and
+// rounds color to 565, BC3 adds 8-step alpha, BC7 mode 6 keeps 7 bits per
+// endpoint channel and 16 steps.
+static void _test_encode_decode(void) {
+    const struct { BlockFormat format; int channels; int bound; } cases[] = {
+        { BLOCK_FORMAT_BC1, 3, 24 },
+        { BLOCK_FORMAT_BC3, 4, 24 },
+        { BLOCK_FORMAT_BC7, 4, 16 },
+    };
+    uint8_t rgba[CODEC_SIZE * CODEC_SIZE * 4];
+    uint8_t decoded[CODEC_SIZE * CODEC_SIZE * 4];
+    uint8_t blocks[CODEC_SIZE * CODEC_SIZE];
+    _gradient(rgba, CODEC_SIZE, CODEC_SIZE, 1);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        CHECK(texture_level_size(cases[i].format, CODEC_SIZE, CODEC_SIZE) <= sizeof(blocks));
+        texture_encode(cases[i].format, rgba, CODEC_SIZE, CODEC_SIZE, blocks);
+        texture_decode(cases[i].format, blocks, CODEC_SIZE, CODEC_SIZE, decoded);
+        int error = _max_error(rgba, decoded, CODEC_SIZE * CODEC_SIZE, cases[i].channels);
+        if (error > cases[i].bound) {
+            fprintf(stderr, "format %d: error %d, expected at most %d\n", cases[i].format, error, cases[i].bound);
+            test_failures++;
+        }
+        // BC1 decodes opaque
+        if (cases[i].format == BLOCK_FORMAT_BC1) CHECK(decoded[3] == 255);
+    }
+
+    // partial edge blocks encode as if the last row and column repeated,
+    // and decode into the texels that exist and no further
+    uint8_t small[6 * 5 * 4];
+    uint8_t padded[8 * 8 * 4];
+    uint8_t small_decoded[6 * 5 * 4 + 4];
+    uint8_t padded_decoded[8 * 8 * 4];
+    uint8_t padded_blocks[4 * 16];
+    _gradient(small, 6, 5, 2);
+    for (uint32_t y = 0; y < 8; y++) {
+        for (uint32_t x = 0; x < 8; x++) {
+            memcpy(&padded[(y * 8 + x) * 4], &small[((y < 5 ? y : 4) * 6 + (x < 6 ? x : 5)) * 4], 4);
+        }
+    }
+    memset(small_decoded, 0xab, sizeof(small_decoded));
+    texture_encode(BLOCK_FORMAT_BC7, small, 6, 5, blocks);
+    texture_encode(BLOCK_FORMAT_BC7, padded, 8, 8, padded_blocks);
+    CHECK(memcmp(blocks, padded_blocks, sizeof(padded_blocks)) == 0);
+    texture_decode(BLOCK_FORMAT_BC7, blocks, 6, 5, small_decoded);
+    texture_decode(BLOCK_FORMAT_BC7, padded_blocks, 8, 8, padded_decoded);
+    for (uint32_t y = 0; y < 5; y++) {
+        CHECK(memcmp(&small_decoded[y * 6 * 4], &padded_decoded[y * 8 * 4], 6 * 4) == 0);
+    }
+    CHECK(small_decoded[sizeof(small)] == 0xab);
+}
+
+static void _temp_path(char *path, size_t size) {
+    const char *dir = getenv("TMPDIR");
+    snprintf(path, size, "%s/test_texture_%d.ctx", dir && dir[0] ? dir : "/tmp", (int)getpid());
+}
+
+// The cooked file is read back the way the texture loader does it.
+static void _test_file_round_trip(void) {
+    uint8_t rgba[CODEC_SIZE * CODEC_SIZE * 4];
+    uint8_t blocks[6][CODEC_SIZE * CODEC_SIZE];
+    const uint8_t *levels[6];
+    _gradient(rgba, CODEC_SIZE, CODEC_SIZE, 3);
+    // 32x32 has 6 levels down to 1x1, the small ones in a single block
+    for (uint32_t i = 0; i < 6; i++) {
+        uint32_t size = CODEC_SIZE >> i;
+        texture_encode(BLOCK_FORMAT_BC3, rgba, size, size, blocks[i]);
+        levels[i] = blocks[i];
+    }
+
+    char path[512];
+    _temp_path(path, sizeof(path));
+    CHECK(texture_file_write(path, BLOCK_FORMAT_BC3, TEXTURE_FILE_SRGB, CODEC_SIZE, CODEC_SIZE, levels, 6) == 0);
+    // one level past 1x1, or a level 0 that is not whole blocks, is not written
+    CHECK(texture_file_write(path, BLOCK_FORMAT_BC3, 0, 8, 8, levels, 5) != 0);
+    CHECK(texture_file_write(path, BLOCK_FORMAT_BC3, 0, 6, 8, levels, 1) != 0);
+
+    FileView file;
+    if (file_view_open(path, &file) != 0) {
+        fprintf(stderr, "Could not read back %s\n", path);
+        test_failures++;
+        remove(path);
+        return;
+    }
+    TextureFile cooked;
+    CHECK(texture_file_parse(file.data, file.size, &cooked) == 0);
+    CHECK(cooked.header->format == BLOCK_FORMAT_BC3);
+    CHECK(cooked.header->flags == TEXTURE_FILE_SRGB);
+    CHECK(cooked.header->width == CODEC_SIZE && cooked.header->height == CODEC_SIZE);
+    CHECK(cooked.header->level_count == 6);
+    for (uint32_t i = 0; i < cooked.header->level_count && i < 6; i++) {
+        size_t size = texture_level_size(BLOCK_FORMAT_BC3, CODEC_SIZE >> i, CODEC_SIZE >> i);
+        CHECK(cooked.levels[i].offset % TEXTURE_FILE_ALIGNMENT == 0);
+        CHECK(cooked.levels[i].size == size);
+        CHECK(memcmp(cooked.data + cooked.levels[i].offset, blocks[i], size) == 0);
+    }
+
+    // every truncation cuts into the last level
+    for (size_t size = 0; size < file.size; size++) {
+        if (texture_file_parse(file.data, size, &cooked) == 0) {
+            fprintf(stderr, "%zu of %zu bytes parsed\n", size, file.size);
+            test_failures++;
+        }
+    }
+    file_view_close(&file);
+    remove(path);
+}
+
+// A valid header, level index and zeroed blocks for an 8x8 BC1 texture,
+// which the malformed cases then break one field at a time.
+typedef struct SmallFile {
+    TextureFileHeader header;
+    TextureFileLevel levels[5];
+    uint8_t data[80];
+} SmallFile;
+
+static void _small_file(SmallFile *file, uint32_t level_count) {
+    memset(file, 0, sizeof(*file));
+    file->header = (TextureFileHeader){
+        .magic = TEXTURE_FILE_MAGIC,
+        .format = BLOCK_FORMAT_BC1,
+        .flags = 0,
+        .width = 8,
+        .height = 8,
+        .level_count = level_count
+    };
+    size_t offset = (offsetof(SmallFile, data) + TEXTURE_FILE_ALIGNMENT - 1) / TEXTURE_FILE_ALIGNMENT
+                    * TEXTURE_FILE_ALIGNMENT;
+    for (uint32_t i = 0; i < level_count; i++) {
+        uint32_t size = 8 >> i ? 8 >> i : 1;
+        file->levels[i].offset = offset;
+        file->levels[i].size = texture_level_size(BLOCK_FORMAT_BC1, size, size);
+        offset += TEXTURE_FILE_ALIGNMENT;
+    }
+}
+
+static int _small_parses(const SmallFile *file) {
+    TextureFile parsed;
+    return texture_file_parse(file, sizeof(*file), &parsed) == 0;
+}
+
+static void _test_malformed_headers(void) {
+    SmallFile file;
+    _small_file(&file, 4);
+    CHECK(_small_parses(&file));
+
+    // 8x8 goes 8, 4, 2, 1: a fifth level would be 1x1 again
+    _small_file(&file, 5);
+    CHECK(!_small_parses(&file));
+
+    _small_file(&file, 4);
+    file.header.magic ^= 1;
+    CHECK(!_small_parses(&file));
+
+    _small_file(&file, 4);
+    file.header.format = 0;
+    CHECK(!_small_parses(&file));
+    file.header.format = BLOCK_FORMAT_BC7 + 1;
+    CHECK(!_small_parses(&file));
+
+    _small_file(&file, 4);
+    file.header.width = 0;
+    CHECK(!_small_parses(&file));
+
+    _small_file(&file, 4);
+    file.header.height = 6;
+    CHECK(!_small_parses(&file));
+
+    _small_file(&file, 4);
+    file.header.level_count = 0;
+    CHECK(!_small_parses(&file));
+    file.header.level_count = UINT32_MAX;
+    CHECK(!_small_parses(&file));
+
+    _small_file(&file, 4);
+    file.levels[1].size += 8;
+    CHECK(!_small_parses(&file));
+
+    _small_file(&file, 4);
+    file.levels[2].offset += 4;
+    CHECK(!_small_parses(&file));
+
+    _small_file(&file, 4);
+    file.levels[3].offset = sizeof(file) + TEXTURE_FILE_ALIGNMENT;
+    CHECK(!_small_parses(&file));
+    file.levels[3].offset = UINT64_MAX - 15;
+    CHECK(!_small_parses(&file));
+}
+
+void test_texture_codec(void) {
+    _test_encode_decode();
+    _test_file_round_trip();
+    _test_malformed_headers();
+}
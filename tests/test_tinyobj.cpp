@@ -0,0 +1,481 @@
+#include "test.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The parser allocates through these, so a test can make allocation number
+// _alloc_budget (from 0) fail and the rest succeed. Negative never fails.
+static long _alloc_budget = -1;
+static long _alloc_count = 0;
+
+static int _alloc_allowed(void) {
+    _alloc_count++;
+    if (_alloc_budget < 0) return 1;
+    return _alloc_budget-- != 0;
+}
+static void *_test_malloc(size_t size) { return _alloc_allowed() ? malloc(size) : NULL; }
+static void *_test_calloc(size_t count, size_t size) { return _alloc_allowed() ? calloc(count, size) : NULL; }
+static void *_test_realloc(void *p, size_t size) { return _alloc_allowed() ? realloc(p, size) : NULL; }
+
+// opt in to the NEON scanner so an aarch64 run checks it
+#define TINYOBJ_ENABLE_NEON
+#define TINYOBJ_MALLOC _test_malloc
+#define TINYOBJ_CALLOC _test_calloc
+#define TINYOBJ_REALLOC _test_realloc
+#define TINYOBJ_FREE free
+// shard small inputs, on any number of cores
+static long _test_cpus = 1;
+#define TINYOBJ_MIN_LINES_PER_THREAD 8
+#define TINYOBJ_ONLINE_CPUS() _test_cpus
+#define TINYOBJ_LOADER_C_IMPLEMENTATION
+#include "tinyobj_loader_c.h"
+
+#define FLOAT_SWEEP_COUNT 2000000
+
+// parseFloat has to return exactly what strtof does, -0 and ties included,
+// and stop at the end of the token.
+static void _check_float(const char *number) {
+    char token[80];
+    snprintf(token, sizeof(token), "%s ", number);
+    const char *p = token;
+    float parsed = parseFloat(&p);
+    float expected = strtof(number, NULL);
+    if (memcmp(&parsed, &expected, sizeof(float)) != 0 || *p != ' ') {
+        fprintf(stderr, "parseFloat(\"%s\") = %.9g, strtof = %.9g\n", number, parsed, expected);
+        test_failures++;
+    }
+}
+
+static const char *_edge_cases[] = {
+    "0", "-0", "+0", "0.0", "-0.0", "0.", ".0", ".5", "5.", "+1.25", "-0.5",
+    "1.198639", "-0.000001", "0.1", "0.2", "0.3", "0.7", "3.14159265",
+    "16777215", "16777216", "16777217", "16777218", "-16777217",
+    "1677721.6", "167772.17", "0.16777216", "0.16777217",
+    "0.0000000001", "0.00000000001", "1.0000000001", "9999999999",
+    "123456789012345678", "1234567890123456789", "0.123456789012345678",
+    "340282346638528859811704183484516925440", "3.4028235e38", "3.4028236e38",
+    "1e-45", "1.4e-45", "7e-46", "1.17549435e-38", "1e10", "1E10", "1.5e-3",
+    "-2.5E+7", "1e0", "1e+0", "1e-0", "0e5", "00000.5", "000001",
+    "0.30000001192092896", "0.1000000014901161", "2.0000002384185791",
+};
+
+static uint32_t _rand(uint32_t *state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+// Mostly the fixed point form exporters write, with enough long mantissas,
+// exponents and values around 2^24 to cross into the slow path.
+static void _random_number(uint32_t *state, char *out) {
+    char *p = out;
+    uint32_t r = _rand(state);
+    if (r % 3 == 0) *p++ = '-';
+    else if (r % 17 == 0) *p++ = '+';
+
+    if (r % 11 == 0) {
+        p += sprintf(p, "%u", 16777216u - 8 + _rand(state) % 16);
+    } else {
+        int int_digits = (int)(_rand(state) % 10);
+        int frac_digits = (int)(_rand(state) % 13);
+        if (int_digits == 0 && frac_digits == 0) int_digits = 1;
+        for (int i = 0; i < int_digits; i++) *p++ = (char)('0' + _rand(state) % 10);
+        if (frac_digits > 0 || _rand(state) % 8 == 0) *p++ = '.';
+        for (int i = 0; i < frac_digits; i++) *p++ = (char)('0' + _rand(state) % 10);
+    }
+    if (_rand(state) % 7 == 0) {
+        *p++ = _rand(state) % 2 ? 'e' : 'E';
+        uint32_t sign = _rand(state) % 3;
+        if (sign == 1) *p++ = '-';
+        if (sign == 2) *p++ = '+';
+        p += sprintf(p, "%u", _rand(state) % 50);
+    }
+    *p = '\0';
+}
+
+static void _test_parse_float(void) {
+    for (size_t i = 0; i < sizeof(_edge_cases) / sizeof(_edge_cases[0]); i++) _check_float(_edge_cases[i]);
+
+    uint32_t state = 2024;
+    int failures = test_failures;
+    for (int i = 0; i < FLOAT_SWEEP_COUNT && test_failures - failures < 20; i++) {
+        char number[64];
+        _random_number(&state, number);
+        _check_float(number);
+    }
+}
+
+typedef struct Scanner {
+    const char *name;
+    void (*scan)(const char *buf, size_t end_idx, LineScan *scan);
+} Scanner;
+
+static void _scan_scalar(const char *buf, size_t end_idx, LineScan *scan) {
+    scan_lines_scalar(buf, 0, end_idx, scan);
+}
+
+// Every vector scanner this build and CPU can run.
+static size_t _vector_scanners(Scanner *out) {
+    size_t count = 0;
+#if defined(TINYOBJ_SIMD_X86)
+    out[count++] = (Scanner){ "sse2", scan_lines_sse2 };
+    if (__builtin_cpu_supports("avx2")) out[count++] = (Scanner){ "avx2", scan_lines_avx2 };
+#elif defined(TINYOBJ_SIMD_NEON)
+    out[count++] = (Scanner){ "neon", scan_lines_neon };
+#endif
+    (void)out;
+    return count;
+}
+
+// Starts small so the line table grows, as it can in get_line_infos.
+static void _run_scan(const Scanner *scanner, const char *buf, size_t len, LineScan *scan) {
+    scan->capacity = 4;
+    scan->infos = (LineInfo*)malloc(sizeof(LineInfo) * scan->capacity);
+    scan->num_lines = 0;
+    scan->prev_pos = 0;
+    scan->last_line_ending = 0;
+    scan->failed = 0;
+    scanner->scan(buf, len, scan);
+}
+
+static int _scans_equal(const LineScan *a, const LineScan *b) {
+    return a->failed == b->failed && a->num_lines == b->num_lines && a->prev_pos == b->prev_pos
+        && a->last_line_ending == b->last_line_ending
+        && memcmp(a->infos, b->infos, sizeof(LineInfo) * a->num_lines) == 0;
+}
+
+// Short random buffers dense in '\n', '\r' and '\0', so line endings land
+// on every lane, straddle vector boundaries and end up in the scalar tail.
+static void _test_scan_lines(void) {
+    static const char alphabet[] = { 'v', ' ', '1', '.', '\n', '\r', '\0' };
+    Scanner scalar = { "scalar", _scan_scalar };
+    Scanner scanners[4];
+    size_t scanner_count = _vector_scanners(scanners);
+
+    uint32_t state = 99;
+    char buf[160];
+    for (int round = 0; round < 20000; round++) {
+        size_t len = _rand(&state) % sizeof(buf);
+        for (size_t i = 0; i < len; i++) buf[i] = alphabet[_rand(&state) % sizeof(alphabet)];
+
+        LineScan expected;
+        _run_scan(&scalar, buf, len, &expected);
+        for (size_t s = 0; s < scanner_count; s++) {
+            LineScan scan;
+            _run_scan(&scanners[s], buf, len, &scan);
+            if (!_scans_equal(&scan, &expected)) {
+                fprintf(stderr, "%s line scan differs from scalar on a %zu byte buffer\n", scanners[s].name, len);
+                test_failures++;
+            }
+            free(scan.infos);
+        }
+        free(expected.infos);
+    }
+}
+
+// In-memory OBJ and mtl text, whatever names the parser asks for.
+typedef struct TestFiles {
+    const char *obj;
+    const char *mtl;  // NULL for none
+} TestFiles;
+
+static void _read_files(void *ctx, const char *filename, int is_mtl, const char *obj_filename,
+                        char **buf, size_t *len) {
+    (void)filename;
+    (void)obj_filename;
+    const TestFiles *files = (const TestFiles*)ctx;
+    const char *text = is_mtl ? files->mtl : files->obj;
+    *buf = (char*)text;
+    *len = text ? strlen(text) + 1 : 0;  // include NUL
+}
+
+static int _parse_string(const char *obj, unsigned int flags, tinyobj_attrib_t *attrib,
+                         tinyobj_shape_t **shapes, size_t *num_shapes) {
+    TestFiles files = { obj, NULL };
+    tinyobj_material_t *materials = NULL;
+    size_t num_materials = 0;
+    // a failed parse leaves shapes alone, keep them safe to free
+    *shapes = NULL;
+    *num_shapes = 0;
+    int ret = tinyobj_parse_obj(attrib, shapes, num_shapes, &materials, &num_materials, "test.obj",
+                                _read_files, &files, flags);
+    if (ret == TINYOBJ_SUCCESS) tinyobj_materials_free(materials, num_materials);
+    return ret;
+}
+
+// Wider than the fixed face buffer the parser used to have, followed by a
+// triangle so the grown scratch is reused.
+#define POLYGON_VERTS 300
+
+static char *_polygon_obj(void) {
+    size_t cap = POLYGON_VERTS * 24 + 64;
+    char *obj = (char*)malloc(cap);
+    size_t pos = 0;
+    for (int i = 0; i < POLYGON_VERTS; i++) pos += snprintf(obj + pos, cap - pos, "v %d 0 0\n", i);
+    pos += snprintf(obj + pos, cap - pos, "f");
+    for (int i = 1; i <= POLYGON_VERTS; i++) pos += snprintf(obj + pos, cap - pos, " %d", i);
+    snprintf(obj + pos, cap - pos, "\nf -3 -2 -1\n");
+    return obj;
+}
+
+static void _test_large_polygon(void) {
+    char *obj = _polygon_obj();
+    tinyobj_attrib_t attrib;
+    tinyobj_shape_t *shapes = NULL;
+    size_t num_shapes = 0;
+
+    CHECK(_parse_string(obj, 0, &attrib, &shapes, &num_shapes) == TINYOBJ_SUCCESS);
+    CHECK(attrib.num_face_num_verts == 2);
+    CHECK(attrib.num_faces == POLYGON_VERTS + 3);
+    if (attrib.num_face_num_verts == 2 && attrib.num_faces == POLYGON_VERTS + 3) {
+        CHECK(attrib.face_num_verts[0] == POLYGON_VERTS);
+        CHECK(attrib.face_num_verts[1] == 3);
+        int in_order = 1;
+        for (int i = 0; i < POLYGON_VERTS; i++) in_order &= attrib.faces[i].v_idx == i;
+        CHECK(in_order);
+        for (int i = 0; i < 3; i++) CHECK(attrib.faces[POLYGON_VERTS + i].v_idx == POLYGON_VERTS - 3 + i);
+    }
+    tinyobj_attrib_free(&attrib);
+    tinyobj_shapes_free(shapes, num_shapes);
+
+    // a fan around the first vertex
+    CHECK(_parse_string(obj, TINYOBJ_FLAG_TRIANGULATE, &attrib, &shapes, &num_shapes) == TINYOBJ_SUCCESS);
+    size_t tri_count = POLYGON_VERTS - 2 + 1;
+    CHECK(attrib.num_face_num_verts == tri_count);
+    CHECK(attrib.num_faces == 3 * tri_count);
+    if (attrib.num_face_num_verts == tri_count && attrib.num_faces == 3 * tri_count) {
+        int fan = 1;
+        for (int t = 0; t < POLYGON_VERTS - 2; t++) {
+            fan &= attrib.face_num_verts[t] == 3;
+            fan &= attrib.faces[3 * t].v_idx == 0;
+            fan &= attrib.faces[3 * t + 1].v_idx == t + 1;
+            fan &= attrib.faces[3 * t + 2].v_idx == t + 2;
+        }
+        CHECK(fan);
+        const tinyobj_vertex_index_t *last = &attrib.faces[3 * (tri_count - 1)];
+        CHECK(last[0].v_idx == POLYGON_VERTS - 3 && last[1].v_idx == POLYGON_VERTS - 2
+              && last[2].v_idx == POLYGON_VERTS - 1);
+    }
+    tinyobj_attrib_free(&attrib);
+    tinyobj_shapes_free(shapes, num_shapes);
+    free(obj);
+}
+
+// More materials than HASH_TABLE_DEFAULT_SIZE, so the table grows.
+static const char *_oom_mtl =
+    "newmtl red\nKd 1 0 0\nnewmtl green\nKd 0 1 0\nnewmtl m2\nnewmtl m3\nnewmtl m4\n"
+    "newmtl m5\nnewmtl m6\nnewmtl m7\nnewmtl m8\nnewmtl m9\nnewmtl m10\nnewmtl m11\n";
+
+static const char *_oom_obj =
+    "mtllib test.mtl\no a\nv 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\nvt 0 0\nvn 0 0 1\n"
+    "usemtl red\nf 1/1/1 2/1/1 3/1/1 4/1/1\ng b\nusemtl green\nf -3 -2 -1\n";
+
+static int _parse_with_budget(const TestFiles *files, int use_arena, long budget, tinyobj_arena_t *arena,
+                              tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes, size_t *num_shapes,
+                              tinyobj_material_t **materials, size_t *num_materials) {
+    _alloc_budget = budget;
+    int ret = use_arena
+        ? tinyobj_parse_obj_arena(attrib, shapes, num_shapes, materials, num_materials, "test.obj",
+                                  _read_files, (void*)files, TINYOBJ_FLAG_TRIANGULATE, arena)
+        : tinyobj_parse_obj(attrib, shapes, num_shapes, materials, num_materials, "test.obj",
+                            _read_files, (void*)files, TINYOBJ_FLAG_TRIANGULATE);
+    _alloc_budget = -1;
+    return ret;
+}
+
+// Fails each allocation of a parse in turn. Every attempt has to either
+// succeed or report TINYOBJ_ERROR_OUT_OF_MEMORY, never crash or drop data.
+static void _test_out_of_memory(int use_arena) {
+    TestFiles files = { _oom_obj, _oom_mtl };
+    long allocations = 0;
+    int failures_seen = 0;
+    for (long budget = 0; budget <= allocations; budget++) {
+        tinyobj_attrib_t attrib;
+        tinyobj_shape_t *shapes = NULL;
+        size_t num_shapes = 0;
+        tinyobj_material_t *materials = NULL;
+        size_t num_materials = 0;
+        tinyobj_arena_t arena;
+        tinyobj_arena_init(&arena, 0);
+
+        if (budget == 0) {
+            // count the allocations of a parse that never fails
+            _alloc_count = 0;
+            _parse_with_budget(&files, use_arena, -1, &arena, &attrib, &shapes, &num_shapes,
+                               &materials, &num_materials);
+            allocations = _alloc_count;
+            if (!use_arena) tinyobj_attrib_free(&attrib);
+            tinyobj_shapes_free(shapes, num_shapes);
+            tinyobj_materials_free(materials, num_materials);
+            tinyobj_arena_free(&arena);
+            tinyobj_arena_init(&arena, 0);
+        }
+
+        int ret = _parse_with_budget(&files, use_arena, budget, &arena, &attrib, &shapes, &num_shapes,
+                                     &materials, &num_materials);
+        if (ret == TINYOBJ_ERROR_OUT_OF_MEMORY) {
+            failures_seen++;
+            tinyobj_arena_free(&arena);
+            continue;
+        }
+        CHECK(ret == TINYOBJ_SUCCESS);
+        if (ret == TINYOBJ_SUCCESS) {
+            // a shape name is the one allocation allowed to fail quietly
+            CHECK(num_materials == 12);
+            CHECK(num_shapes == 2);
+            CHECK(attrib.num_face_num_verts == 3);
+            if (attrib.num_face_num_verts == 3) {
+                CHECK(attrib.material_ids[0] == 0 && attrib.material_ids[1] == 0);
+                CHECK(attrib.material_ids[2] == 1);
+            }
+            if (!use_arena) tinyobj_attrib_free(&attrib);
+            tinyobj_shapes_free(shapes, num_shapes);
+            tinyobj_materials_free(materials, num_materials);
+        }
+        tinyobj_arena_free(&arena);
+    }
+    CHECK(failures_seen > 10);
+}
+
+static const char *_shard_mtl = "newmtl a\nKd 1 0 0\nnewmtl b\nKd 0 1 0\nnewmtl c\nKd 0 0 1\n";
+
+// Random lines where relative indices, usemtl and o/g often sit in a
+// different shard than what they refer to. Every relative index stays in
+// range of what the lines above it defined.
+static char *_shard_obj(uint32_t *state, size_t line_count) {
+    size_t cap = line_count * 64 + 64;
+    char *obj = (char*)malloc(cap);
+    size_t pos = snprintf(obj, cap, "mtllib test.mtl\n");
+    int v = 0, vt = 0, vn = 0;
+    for (size_t line = 0; line < line_count; line++) {
+        uint32_t kind = _rand(state) % 20;
+        if (kind < 5 || v < 3) {
+            pos += snprintf(obj + pos, cap - pos, "v %u %u -%u\n", _rand(state) % 100, _rand(state) % 100,
+                            _rand(state) % 100);
+            v++;
+        } else if (kind < 7) {
+            pos += snprintf(obj + pos, cap - pos, "vt 0.%u 0.%u\n", _rand(state) % 100, _rand(state) % 100);
+            vt++;
+        } else if (kind < 9) {
+            pos += snprintf(obj + pos, cap - pos, "vn 0 %u 1\n", _rand(state) % 10);
+            vn++;
+        } else if (kind < 15) {
+            int corners = 3 + (int)(_rand(state) % 3);
+            pos += snprintf(obj + pos, cap - pos, "f");
+            for (int c = 0; c < corners; c++) {
+                int relative = _rand(state) % 2;
+                int iv = 1 + (int)(_rand(state) % (uint32_t)v);
+                pos += snprintf(obj + pos, cap - pos, " %d", relative ? iv - v - 1 : iv);
+                if (vt && vn) {
+                    int it = 1 + (int)(_rand(state) % (uint32_t)vt);
+                    int in = 1 + (int)(_rand(state) % (uint32_t)vn);
+                    pos += snprintf(obj + pos, cap - pos, "/%d/%d", relative ? it - vt - 1 : it,
+                                    relative ? in - vn - 1 : in);
+                }
+            }
+            pos += snprintf(obj + pos, cap - pos, "\n");
+        } else if (kind == 15) {
+            // d is not in the mtl
+            pos += snprintf(obj + pos, cap - pos, "usemtl %c\n", "abcd"[_rand(state) % 4]);
+        } else if (kind == 16) {
+            pos += snprintf(obj + pos, cap - pos, "%c part%u\n", _rand(state) % 2 ? 'o' : 'g', _rand(state) % 1000);
+        } else if (kind == 17) {
+            pos += snprintf(obj + pos, cap - pos, "# comment\n");
+        } else {
+            pos += snprintf(obj + pos, cap - pos, "\n");
+        }
+    }
+    return obj;
+}
+
+typedef struct ParseResult {
+    int ret;
+    tinyobj_attrib_t attrib;
+    tinyobj_shape_t *shapes;
+    size_t num_shapes;
+    tinyobj_material_t *materials;
+    size_t num_materials;
+} ParseResult;
+
+static void _parse_result(const TestFiles *files, unsigned int flags, ParseResult *out) {
+    out->shapes = NULL;
+    out->num_shapes = 0;
+    out->materials = NULL;
+    out->num_materials = 0;
+    out->ret = tinyobj_parse_obj(&out->attrib, &out->shapes, &out->num_shapes, &out->materials,
+                                 &out->num_materials, "test.obj", _read_files, (void*)files, flags);
+}
+
+static void _free_result(ParseResult *result) {
+    if (result->ret != TINYOBJ_SUCCESS) return;
+    tinyobj_attrib_free(&result->attrib);
+    tinyobj_shapes_free(result->shapes, result->num_shapes);
+    tinyobj_materials_free(result->materials, result->num_materials);
+}
+
+#define SAME_ARRAY(a, b, count) ((count) == 0 || memcmp((a), (b), sizeof(*(a)) * (count)) == 0)
+
+static int _results_equal(const ParseResult *a, const ParseResult *b) {
+    const tinyobj_attrib_t *x = &a->attrib, *y = &b->attrib;
+    if (a->ret != b->ret || a->ret != TINYOBJ_SUCCESS) return 0;
+    if (x->num_vertices != y->num_vertices || x->num_normals != y->num_normals
+        || x->num_texcoords != y->num_texcoords || x->num_faces != y->num_faces
+        || x->num_face_num_verts != y->num_face_num_verts) return 0;
+    if (!SAME_ARRAY(x->vertices, y->vertices, 3 * x->num_vertices)) return 0;
+    if (!SAME_ARRAY(x->normals, y->normals, 3 * x->num_normals)) return 0;
+    if (!SAME_ARRAY(x->texcoords, y->texcoords, 2 * x->num_texcoords)) return 0;
+    if (!SAME_ARRAY(x->faces, y->faces, x->num_faces)) return 0;
+    if (!SAME_ARRAY(x->face_num_verts, y->face_num_verts, x->num_face_num_verts)) return 0;
+    if (!SAME_ARRAY(x->material_ids, y->material_ids, x->num_face_num_verts)) return 0;
+    if (a->num_materials != b->num_materials || a->num_shapes != b->num_shapes) return 0;
+    for (size_t i = 0; i < a->num_shapes; i++) {
+        const tinyobj_shape_t *p = &a->shapes[i], *q = &b->shapes[i];
+        if (p->face_offset != q->face_offset || p->length != q->length) return 0;
+        if ((p->name == NULL) != (q->name == NULL) || (p->name && strcmp(p->name, q->name) != 0)) return 0;
+    }
+    return 1;
+}
+
+// The parallel parse splits lines into shards and stitches them with prefix
+// sums; it has to give exactly what the serial parse does.
+static void _test_sharded_parse(void) {
+    uint32_t state = 7;
+    const long cpu_counts[] = { 2, 3, 4, 7, 32 };
+    for (int round = 0; round < 40; round++) {
+        size_t line_count = 20 + _rand(&state) % 300;
+        char *obj = _shard_obj(&state, line_count);
+        TestFiles files = { obj, _shard_mtl };
+        unsigned int triangulate = round % 2 ? TINYOBJ_FLAG_TRIANGULATE : 0;
+
+        ParseResult serial;
+        _parse_result(&files, triangulate, &serial);
+        CHECK(serial.ret == TINYOBJ_SUCCESS);
+        for (size_t c = 0; c < sizeof(cpu_counts) / sizeof(cpu_counts[0]); c++) {
+            _test_cpus = cpu_counts[c];
+            ParseResult sharded;
+            _parse_result(&files, triangulate | TINYOBJ_FLAG_PARALLEL, &sharded);
+            if (!_results_equal(&serial, &sharded)) {
+                fprintf(stderr, "%zu lines parsed on %ld shards differ from the serial parse\n",
+                        line_count, _test_cpus);
+                test_failures++;
+            }
+            _free_result(&sharded);
+        }
+        _test_cpus = 1;
+        _free_result(&serial);
+        free(obj);
+    }
+    // the inputs above really are split
+    _test_cpus = 4;
+    CHECK(choose_num_shards(100, TINYOBJ_FLAG_PARALLEL) == 4);
+    CHECK(choose_num_shards(100, 0) == 1);
+    _test_cpus = 1;
+}
+
+void test_tinyobj(void) {
+    _test_parse_float();
+    _test_scan_lines();
+    _test_large_polygon();
+    _test_out_of_memory(0);
+    _test_out_of_memory(1);
+    _test_sharded_parse();
+}
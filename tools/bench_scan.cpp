@@ -0,0 +1,147 @@
+// Line scanner throughput on a synthetic OBJ held in memory. Every scanner
+// the build and CPU support is timed and checked against the scalar one.
+//
+//     bench_scan [size in MB, default 500]
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+// opt in to the NEON scanner so an aarch64 run checks it
+#define TINYOBJ_ENABLE_NEON
+#define TINYOBJ_LOADER_C_IMPLEMENTATION
+#include "tinyobj_loader_c.h"
+
+#define BENCH_RUNS 3
+
+typedef struct Scanner {
+    const char *name;
+    void (*scan)(const char *buf, size_t end_idx, LineScan *scan);
+} Scanner;
+
+static void _scan_scalar(const char *buf, size_t end_idx, LineScan *scan) {
+    scan_lines_scalar(buf, 0, end_idx, scan);
+}
+
+static double _now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint32_t _rand(uint32_t *state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+// Vertices, normals, texcoords and faces in the proportions of an exported
+// mesh, with the occasional CRLF line and comment.
+static char *_generate_obj(size_t size) {
+    char *buf = (char*)malloc(size);
+    if (!buf) return NULL;
+    uint32_t state = 1;
+    size_t pos = 0;
+    char line[128];
+    while (pos < size) {
+        uint32_t kind = _rand(&state) % 16;
+        int len;
+        if (kind < 6) {
+            len = snprintf(line, sizeof(line), "v %.6f %.6f %.6f", (_rand(&state) % 20000) / 1000.0 - 10.0,
+                           (_rand(&state) % 20000) / 1000.0 - 10.0, (_rand(&state) % 20000) / 1000.0 - 10.0);
+        } else if (kind < 9) {
+            len = snprintf(line, sizeof(line), "vn %.4f %.4f %.4f", (_rand(&state) % 2000) / 1000.0 - 1.0,
+                           (_rand(&state) % 2000) / 1000.0 - 1.0, (_rand(&state) % 2000) / 1000.0 - 1.0);
+        } else if (kind < 11) {
+            len = snprintf(line, sizeof(line), "vt %.6f %.6f", (_rand(&state) % 1000) / 1000.0,
+                           (_rand(&state) % 1000) / 1000.0);
+        } else if (kind < 15) {
+            uint32_t a = _rand(&state) % 100000 + 1, b = _rand(&state) % 100000 + 1, c = _rand(&state) % 100000 + 1;
+            len = snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u", a, a, a, b, b, b, c, c, c);
+        } else {
+            len = snprintf(line, sizeof(line), "# group %u", _rand(&state));
+        }
+        if (_rand(&state) % 64 == 0) line[len++] = '\r';
+        line[len++] = '\n';
+
+        size_t n = (size_t)len < size - pos ? (size_t)len : size - pos;
+        memcpy(buf + pos, line, n);
+        pos += n;
+    }
+    return buf;
+}
+
+// Same starting capacity as get_line_infos.
+static int _run(const Scanner *scanner, const char *buf, size_t size, LineScan *scan) {
+    scan->capacity = size / 32 + 16;
+    scan->infos = (LineInfo*)malloc(sizeof(LineInfo) * scan->capacity);
+    scan->num_lines = 0;
+    scan->prev_pos = 0;
+    scan->last_line_ending = 0;
+    scan->failed = scan->infos == NULL;
+    if (!scan->failed) scanner->scan(buf, size, scan);
+    return scan->failed ? -1 : 0;
+}
+
+static int _scans_equal(const LineScan *a, const LineScan *b) {
+    return a->num_lines == b->num_lines && a->prev_pos == b->prev_pos
+        && a->last_line_ending == b->last_line_ending
+        && memcmp(a->infos, b->infos, sizeof(LineInfo) * a->num_lines) == 0;
+}
+
+int main(int argc, char **argv) {
+    size_t megabytes = argc > 1 ? strtoul(argv[1], NULL, 10) : 500;
+    size_t size = megabytes << 20;
+    if (size == 0) {
+        fprintf(stderr, "usage: %s [size in MB]\n", argv[0]);
+        return 1;
+    }
+
+    char *buf = _generate_obj(size);
+    if (!buf) {
+        fprintf(stderr, "Out of memory generating a %zu MB OBJ\n", megabytes);
+        return 1;
+    }
+
+    Scanner scanners[4];
+    size_t scanner_count = 0;
+    scanners[scanner_count++] = (Scanner){ "scalar", _scan_scalar };
+#if defined(TINYOBJ_SIMD_X86)
+    scanners[scanner_count++] = (Scanner){ "sse2", scan_lines_sse2 };
+    if (__builtin_cpu_supports("avx2")) scanners[scanner_count++] = (Scanner){ "avx2", scan_lines_avx2 };
+#elif defined(TINYOBJ_SIMD_NEON)
+    scanners[scanner_count++] = (Scanner){ "neon", scan_lines_neon };
+#endif
+
+    LineScan expected;
+    if (_run(&scanners[0], buf, size, &expected) != 0) {
+        fprintf(stderr, "Out of memory scanning lines\n");
+        return 1;
+    }
+    printf("%zu MB, %zu lines\n", megabytes, expected.num_lines);
+
+    int mismatches = 0;
+    for (size_t s = 0; s < scanner_count; s++) {
+        double best = 0.0;
+        for (int run = 0; run < BENCH_RUNS; run++) {
+            LineScan scan;
+            double start = _now_s();
+            int result = _run(&scanners[s], buf, size, &scan);
+            double elapsed = _now_s() - start;
+            if (result != 0) {
+                fprintf(stderr, "Out of memory scanning lines\n");
+                return 1;
+            }
+            if (run == 0 && !_scans_equal(&scan, &expected)) {
+                fprintf(stderr, "%s differs from scalar\n", scanners[s].name);
+                mismatches++;
+            }
+            if (run == 0 || elapsed < best) best = elapsed;
+            free(scan.infos);
+        }
+        printf("%-8s %6.2f GB/s\n", scanners[s].name, (double)size / best / 1e9);
+    }
+
+    free(expected.infos);
+    free(buf);
+    return mismatches ? 1 : 0;
+}
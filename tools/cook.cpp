@@ -0,0 +1,121 @@
+// Offline texture cooker: decodes an image, builds its mip chain on the CPU
+// with the same filter as the GPU generator, and writes every level as BC
+// blocks for the texture loader to upload as is.
+//
+//     cook <input> <output> <bc1|bc3|bc7> [--srgb]
+#include <stdio.h>
+#include <string.h>
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#include "file_view.h"
+#include "mipmap.h"
+#include "texture_codec.h"
+
+static int _parse_format(const char *name, BlockFormat *out_format) {
+    if (strcmp(name, "bc1") == 0) *out_format = BLOCK_FORMAT_BC1;
+    else if (strcmp(name, "bc3") == 0) *out_format = BLOCK_FORMAT_BC3;
+    else if (strcmp(name, "bc7") == 0) *out_format = BLOCK_FORMAT_BC7;
+    else return -1;
+    return 0;
+}
+
+static uint8_t _to_unorm8(float c) {
+    if (c < 0.0f) c = 0.0f;
+    if (c > 1.0f) c = 1.0f;
+    return (uint8_t)(c * 255.0f + 0.5f);
+}
+
+int main(int argc, char **argv) {
+    BlockFormat format;
+    if (argc < 4 || _parse_format(argv[3], &format) != 0) {
+        fprintf(stderr, "usage: %s <input> <output> <bc1|bc3|bc7> [--srgb]\n", argv[0]);
+        return 1;
+    }
+    const char *input = argv[1];
+    const char *output = argv[2];
+    bool srgb = argc > 4 && strcmp(argv[4], "--srgb") == 0;
+
+    FileView file;
+    if (file_view_open(input, &file) != 0) {
+        fprintf(stderr, "Failed to open %s\n", input);
+        return 1;
+    }
+    int width = 0, height = 0, channels = 0;
+    stbi_uc *pixels = stbi_load_from_memory((const stbi_uc*)file.data, (int)file.size, &width, &height, &channels, 4);
+    file_view_close(&file);
+    if (!pixels) {
+        fprintf(stderr, "Failed to decode %s: %s\n", input, stbi_failure_reason());
+        return 1;
+    }
+    // WebGPU only creates BC textures whose level 0 is whole blocks
+    if (width % TEXTURE_BLOCK_DIM != 0 || height % TEXTURE_BLOCK_DIM != 0) {
+        fprintf(stderr, "%s is %dx%d, block compression needs multiples of %d\n",
+                input, width, height, TEXTURE_BLOCK_DIM);
+        stbi_image_free(pixels);
+        return 1;
+    }
+
+    uint32_t w = (uint32_t)width, h = (uint32_t)height;
+    uint32_t level_count = 1;
+    while (level_count < TEXTURE_FILE_MAX_LEVELS && ((w | h) >> level_count) != 0) level_count++;
+
+    // levels are filtered in linear space and stored encoded, like the
+    // render path of the mipmap generator
+    size_t texel_count = (size_t)w * h;
+    float *linear = (float*)malloc(texel_count * 4 * sizeof(float));
+    float *next = (float*)malloc(texel_count * sizeof(float));  // a quarter of the texels
+    uint8_t *rgba = (uint8_t*)malloc(texel_count * 4);
+    if (!linear || !next || !rgba) {
+        fprintf(stderr, "Out of memory cooking %s\n", input);
+        free(rgba);
+        free(next);
+        free(linear);
+        stbi_image_free(pixels);
+        return 1;
+    }
+    for (size_t i = 0; i < texel_count * 4; i++) {
+        float c = pixels[i] / 255.0f;
+        linear[i] = srgb && i % 4 != 3 ? mipmap_srgb_to_linear(c) : c;
+    }
+    stbi_image_free(pixels);
+
+    uint8_t *levels[TEXTURE_FILE_MAX_LEVELS];
+    size_t total = 0;
+    for (uint32_t level = 0; level < level_count; level++) {
+        size_t count = (size_t)w * h;
+        for (size_t i = 0; i < count * 4; i++) {
+            rgba[i] = _to_unorm8(srgb && i % 4 != 3 ? mipmap_linear_to_srgb(linear[i]) : linear[i]);
+        }
+        size_t size = texture_level_size(format, w, h);
+        levels[level] = (uint8_t*)malloc(size);
+        if (!levels[level]) {
+            fprintf(stderr, "Out of memory encoding level %u of %s\n", level, input);
+            for (uint32_t i = 0; i < level; i++) free(levels[i]);
+            free(rgba);
+            free(next);
+            free(linear);
+            return 1;
+        }
+        texture_encode(format, rgba, w, h, levels[level]);
+        total += size;
+
+        if (level + 1 < level_count) {
+            mipmap_downsample_reference(linear, w, h, 4, next);
+            w = w > 1 ? w / 2 : 1;
+            h = h > 1 ? h / 2 : 1;
+            memcpy(linear, next, (size_t)w * h * 4 * sizeof(float));
+        }
+    }
+
+    int result = texture_file_write(output, format, srgb ? TEXTURE_FILE_SRGB : 0,
+                                    (uint32_t)width, (uint32_t)height, levels, level_count);
+    if (result == 0) {
+        printf("%s: %dx%d, %u levels, %zu KB of %s\n", output, width, height, level_count, total / 1024, argv[3]);
+    }
+
+    for (uint32_t level = 0; level < level_count; level++) free(levels[level]);
+    free(rgba);
+    free(next);
+    free(linear);
+    return result == 0 ? 0 : 1;
+}